@@ -32,6 +32,7 @@ SOFTWARE.
 #define SYSCALL_REM_INT_HANDLER             0x0012
 #define SYSCALL_GET_SYSTICKS                0x0020
 #define SYSCALL_SLEEP                       0x0021
+#define SYSCALL_GET_MICROSECONDS            0x0022
 
 // screen (0x0100-0x01ff)
 #define SYSCALL_GET_SCREEN_INFO             0x0100
@@ -56,6 +57,11 @@ SOFTWARE.
 #define SYSCALL_DISK_ABS_READ               0x0302
 #define SYSCALL_DISK_ABS_WRITE              0x0303
 #define SYSCALL_DISK_GET_BOOTDISK           0x0304
+#define SYSCALL_DISK_AIO_SETUP              0x0305
+#define SYSCALL_DISK_AIO_SUBMIT             0x0306
+#define SYSCALL_DISK_AIO_DESTROY            0x0307
+#define SYSCALL_DISK_STATS                  0x0308
+#define SYSCALL_DISK_STATS_RESET            0x0309
 
 // filesystem (0x0400-0x04ff)
 #define SYSCALL_GET_FS                      0x0400
@@ -66,6 +72,13 @@ SOFTWARE.
 #define SYSCALL_FS_MKDIR                    0x0405
 #define SYSCALL_FS_GET_FILE_INFO            0x0406
 #define SYSCALL_FS_GET_DIR_CONTENTS         0x0407
+#define SYSCALL_FS_OPEN                     0x0408
+#define SYSCALL_FS_READ_AT                  0x0409
+#define SYSCALL_FS_WRITE_AT                 0x040a
+#define SYSCALL_FS_SEEK                     0x040b
+#define SYSCALL_FS_CLOSE                    0x040c
+#define SYSCALL_FS_OPENDIR                  0x040d
+#define SYSCALL_FS_READDIR                  0x040e
 
 // program (0x0500-0x05ff)
 #define SYSCALL_GET_PROGRAM_INFO            0x0500
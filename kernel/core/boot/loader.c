@@ -36,8 +36,12 @@ SOFTWARE.
 
 #define LOADER_MAGICNUMBER_MULTIBOOT    0x2BADB002
 
+#define LOADER_MULTIBOOT_FLAG_MODS      0x08
+#define LOADER_PAGE_MASK                0xFFFFF000
+
 static void loader_multiboot_compliant(void);
 static void loader_multiboot_convertInfoStruct(void);
+static void loader_multiboot_relocateModule(void);
  
 extern const uint32_t MAGICNUMBER;
 extern uint32_t *BOOTLOADER_STRUCT_ADDR;
@@ -107,6 +111,48 @@ static void loader_multiboot_convertInfoStruct(void)
     } 
     
     loader_info.total_memory = info->mem_upper + info->mem_lower; 
+
+    if((info->flags & LOADER_MULTIBOOT_FLAG_MODS) && info->mods_count)
+    {
+        multiboot_module_t *mod = (multiboot_module_t *) info->mods_addr;
+
+        loader_info.module_start = mod->mod_start;
+        loader_info.module_size = mod->mod_end - mod->mod_start;
+
+        loader_multiboot_relocateModule();
+    }
+}
+
+/* GRUB puts modules right behind the kernel, which is where the kmalloc space and the
+paging tables go. So, before memory_init() gets there, move the module to the last pages of
+the memory the kernel manages (see memory.c; it counts 1000 bytes per KiB) */
+static void loader_multiboot_relocateModule(void)
+{
+    uint32_t end = loader_info.total_memory * 1000;
+    uint32_t size = loader_info.module_size;
+
+    if(!size || size >= end)
+        { loader_info.module_size = 0; return; }
+
+    uint32_t dest = (end - size) & LOADER_PAGE_MASK;
+
+    /* already as high as it gets */
+    if(dest <= loader_info.module_start)
+        return;
+
+    /* the destination can overlap the end of the module, so copy from back to front */
+    uint8_t *d = (uint8_t *) dest;
+    uint8_t *s = (uint8_t *) loader_info.module_start;
+
+    for(uint32_t i = size; i > 0; --i)
+        d[i - 1] = s[i - 1];
+
+    loader_info.module_start = dest;
+
+#ifndef NO_DEBUG_INFO
+    print_value("[LOADER] Boot module moved to %x, ", dest);
+    print_value("%i bytes\n\n", size);
+#endif
 }
 
 
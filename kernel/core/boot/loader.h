@@ -33,6 +33,8 @@ typedef struct
     unsigned int  mmap_length;
     unsigned int  total_memory;
     unsigned int  boot_drive;
+    unsigned int  module_start; /* first boot module (e.g. a RAM disk image), moved to the top of memory */
+    unsigned int  module_size;  /* in bytes, 0 if there is none */
 } LOADER_INFO;
 
 unsigned char loader_detect(void);
@@ -29,6 +29,8 @@ SOFTWARE.
 #include "../../include/file.h"
 
 #include "../../dsk/diskio.h"
+#include "../../dsk/ioqueue.h"
+#include "../../dsk/dcache.h"
 
 #include "../../memory/memory.h"
 #include "../../memory/paging.h"
@@ -74,6 +76,25 @@ SOFTWARE.
 #define FAT_EMPTY_CLUSTER           0x00
 
 #define DIR_UNUSED_ENTRY            0xE5
+#define DIR_ENTRIES_PER_SECTOR      (FAT32_SECTOR_SIZE / sizeof(FAT32_DIR))
+
+#define FAT_ENTRY_MASK              0x0FFFFFFFU
+#define FAT_ENTRIES_PER_SECTOR      (FAT32_SECTOR_SIZE / sizeof(uint32_t))
+#define FAT_CACHE_SECTORS           128U /* per partition */
+#define FAT_FLUSH_RUN_SECTORS       32U  /* most adjacent dirty FAT sectors written at once */
+
+#define FAT_FLAGS_NO_MIRRORING      (1U << 7) /* only the active FAT is in use */
+#define FAT_FLAGS_ACTIVE_FAT        0x0F
+
+#define FSINFO_LEAD_SIGNATURE       0x41615252
+#define FSINFO_STRUCT_SIGNATURE     0x61417272
+#define FSINFO_TRAIL_SIGNATURE      0xAA550000
+#define FSINFO_UNKNOWN              0xFFFFFFFF
+
+#define FAT_MAP_READ_SECTORS        128U /* FAT sectors read at once while building the free map */
+
+#define FAT_DIR_INDEXES             8U  /* directories indexed at once */
+#define FAT_DIR_INDEX_MIN_CLUSTERS  2U  /* smaller directories are simply searched */
 
 typedef struct 
 {
@@ -132,17 +153,80 @@ typedef struct
     uint32_t fSize; 
 } __attribute__ ((packed)) FAT32_DIR;
 
+typedef struct
+{
+    uint32_t lead_sig;
+    uint8_t resv[480];
+    uint32_t struct_sig;
+    uint32_t free_count;    // free clusters, FSINFO_UNKNOWN if not known
+    uint32_t next_free;     // where to start looking for a free cluster, FSINFO_UNKNOWN if not known
+    uint8_t resv2[12];
+    uint32_t trail_sig;
+} __attribute__((packed)) FAT32_FSINFO;
+
+typedef struct fat_cache_entry_t
+{
+    uint32_t sector;    // sector within the FAT, MAX if the slot is unused
+    uint32_t last_used;
+    bool_t dirty;
+} fat_cache_entry_t;
+
 typedef struct fs_info_t
 {
     uint8_t disk;
     uint8_t part;
    
    FAT32_EBPB *ebpb;
-} __attribute__((packed)) fs_info_t;
+
+   uint32_t fat_lba;        // first sector of the first FAT
+   uint32_t n_clusters;     // number of FAT entries in use (including the two reserved ones)
+
+   // FAT sectors, cached until the slot is needed for another sector; dirty ones are
+   // written to every FAT by fat_cache_flush() (allocated on first use)
+   uint8_t *fat_cache;
+   fat_cache_entry_t fat_cache_entries[FAT_CACHE_SECTORS];
+   uint32_t fat_cache_hint;  // slot used last, chain walks stay in the same sector for a while
+   uint32_t fat_cache_clock;
+
+   // one bit per cluster, set if the cluster is free (built on the first allocation)
+   uint32_t *free_map;
+   uint32_t free_clusters;  // FSINFO_UNKNOWN until known
+   uint32_t next_free;      // allocation hint
+
+   FAT32_FSINFO *fsinfo;    // NULL if the volume has no (valid) FSInfo sector
+   bool_t fsinfo_dirty;
+} fs_info_t;
 
 
 fs_info_t partition_info[FAT_MAX_PARTITIONS];
 
+typedef struct fat_dir_index_entry_t
+{
+    char name[TOTAL_FILENAME_LEN];
+    uint16_t index;     // of the entry within its cluster
+    uint32_t cluster;   // the part of the directory the entry is in
+    uint32_t next;      // next entry in the bucket, MAX if none
+} fat_dir_index_entry_t;
+
+// hash index of the names in a directory (only the 8.3 name, the entry itself is read from disk)
+typedef struct fat_dir_index_t
+{
+    uint8_t disk;
+    uint8_t part;
+    uint32_t dir_cluster;   // first cluster of the directory, 0 if the slot is unused
+    uint32_t last_used;
+
+    uint32_t n_buckets;     // power of two
+    uint32_t n_entries;
+    uint32_t capacity;
+
+    uint32_t *buckets;
+    fat_dir_index_entry_t *entries;
+} fat_dir_index_t;
+
+fat_dir_index_t dir_indexes[FAT_DIR_INDEXES];
+uint32_t dir_index_clock = 0;
+
 /* the indentifier for drivers + information about our driver */
 struct DRIVER FAT_driver_id = {(uint32_t) 0xB14D05, "VIREODRV", (FS_TYPE_FAT32 | DRIVER_TYPE_FS), (uint32_t) (fat_handler)};
 
@@ -159,12 +243,10 @@ void fat_handler(uint32_t *drv)
             size_t size;
             file_t *f = fat_read((const char *) drv[1], &size);
 
-            if(f == NULL)
-                drv[4] = EXIT_CODE_GLOBAL_GENERAL_FAIL;
-
+            // a file that isn't there and a failed read both leave f at NULL
             drv[2] = (uint32_t) f;
-            drv[3] = size;
-            drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+            drv[3] = (f) ? size : 0;
+            drv[4] = (f) ? EXIT_CODE_GLOBAL_SUCCESS : EXIT_CODE_GLOBAL_GENERAL_FAIL;
         
             break;
         }
@@ -193,6 +275,26 @@ void fat_handler(uint32_t *drv)
             drv[2] = (uint32_t) fat_get_dir_contents((const char *) drv[1], (size_t *) &drv[3], (err_t *) &drv[4]);
         break;
 
+        case FS_COMMAND_OPEN:
+            drv[4] = fat_open((const char *) drv[1], (fs_handle_t *) drv[2]);
+        break;
+
+        case FS_COMMAND_READ_AT:
+            drv[3] = fat_read_at((fs_handle_t *) drv[1], (void *) drv[2], (size_t) drv[3], (err_t *) &drv[4]);
+        break;
+
+        case FS_COMMAND_WRITE_AT:
+            drv[3] = fat_write_at((fs_handle_t *) drv[1], (const void *) drv[2], (size_t) drv[3], (err_t *) &drv[4]);
+        break;
+
+        case FS_COMMAND_OPENDIR:
+            drv[4] = fat_opendir((const char *) drv[1], (fs_handle_t *) drv[2]);
+        break;
+
+        case FS_COMMAND_READDIR:
+            drv[3] = fat_readdir((fs_handle_t *) drv[1], (fs_dir_contents_t *) drv[2], (size_t) drv[3], (err_t *) &drv[4]);
+        break;
+
         default:
             drv[4] = EXIT_CODE_GLOBAL_UNSUPPORTED;
         break;
@@ -201,15 +303,22 @@ void fat_handler(uint32_t *drv)
     
 }
 
-static FAT32_EBPB *fat_get_ebpb(uint8_t disk, uint8_t part)
+static fs_info_t *fat_get_info(uint8_t disk, uint8_t part)
 {
     for(uint32_t i = 0; i < FAT_MAX_PARTITIONS; ++i)
-        if(partition_info[i].disk == disk && partition_info[i].part == part)
-            return partition_info[i].ebpb;
+        if(partition_info[i].ebpb && partition_info[i].disk == disk && partition_info[i].part == part)
+            return &partition_info[i];
     
     return NULL;
 }
 
+static FAT32_EBPB *fat_get_ebpb(uint8_t disk, uint8_t part)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+    
+    return (info) ? info->ebpb : NULL;
+}
+
 static uint32_t fat_cluster_lba(uint8_t disk, uint8_t part, uint32_t cluster)
 {
     FAT32_EBPB* info = fat_get_ebpb(disk, part);
@@ -251,6 +360,58 @@ static uint16_t fat_get_empty_info_entry(void)
     return (uint16_t) MAX;
 }
 
+static fat_dir_index_t *fat_dir_index_get(uint8_t disk, uint8_t part, uint32_t dir_cluster)
+{
+    for(uint32_t i = 0; i < FAT_DIR_INDEXES; ++i)
+        if(dir_indexes[i].dir_cluster == dir_cluster && dir_indexes[i].disk == disk && dir_indexes[i].part == part)
+            return &dir_indexes[i];
+    
+    return NULL;
+}
+
+static void fat_dir_index_free(fat_dir_index_t *dindex)
+{
+    vfree(dindex->buckets);
+    dindex->buckets = NULL;
+    dindex->dir_cluster = 0;
+}
+
+/* forgets the index of a directory, dir_cluster MAX forgets all directories of the partition */
+static void fat_dir_index_drop(uint8_t disk, uint8_t part, uint32_t dir_cluster)
+{
+    for(uint32_t i = 0; i < FAT_DIR_INDEXES; ++i)
+        if(dir_indexes[i].dir_cluster && dir_indexes[i].disk == disk && dir_indexes[i].part == part &&
+            (dir_cluster == MAX || dir_indexes[i].dir_cluster == dir_cluster))
+            fat_dir_index_free(&dir_indexes[i]);
+}
+
+/* the free count and next free cluster of the FSInfo sector are hints, they are only used when they make sense */
+static void fat_read_fsinfo(fs_info_t *info, uint32_t startLBA)
+{
+    uint16_t sector = info->ebpb->FSinfo;
+    info->fsinfo = NULL;
+
+    if(!sector || sector == 0xFFFF)
+        return;
+
+    FAT32_FSINFO *fsinfo = kmalloc(sizeof(FAT32_FSINFO));
+
+    if(!fsinfo)
+        return;
+    
+    if(read(info->disk, startLBA + sector, 1U, (uint8_t *) fsinfo) || fsinfo->lead_sig != FSINFO_LEAD_SIGNATURE ||
+        fsinfo->struct_sig != FSINFO_STRUCT_SIGNATURE || fsinfo->trail_sig != FSINFO_TRAIL_SIGNATURE)
+        { kfree(fsinfo); return; }
+    
+    info->fsinfo = fsinfo;
+
+    if(fsinfo->free_count <= info->n_clusters - FAT_CLUSTER_TABLE_LAST_RESERVED)
+        info->free_clusters = fsinfo->free_count;
+
+    if(fsinfo->next_free >= FAT_CLUSTER_TABLE_LAST_RESERVED && fsinfo->next_free < info->n_clusters)
+        info->next_free = fsinfo->next_free;
+}
+
 err_t fat_init(uint8_t disk, uint8_t part)
 {
     /* do we know this partition already? */
@@ -287,6 +448,28 @@ err_t fat_init(uint8_t disk, uint8_t part)
 
     /* only support 512 bytes per sector */
     ASSERT(sector_size == FAT32_SECTOR_SIZE);
+
+    /* where the FAT is and how much of it is used */
+    BPB *bpb = &info_entry->ebpb->bpb;
+    uint32_t total_sectors = (bpb->nSect) ? bpb->nSect : bpb->lnSect;
+    uint32_t data_sectors = total_sectors - (bpb->resvSect + bpb->nFAT * info_entry->ebpb->sectFAT32);
+    uint32_t fat_entries = info_entry->ebpb->sectFAT32 * FAT_ENTRIES_PER_SECTOR;
+
+    info_entry->fat_lba = startLBA + bpb->resvSect;
+    info_entry->n_clusters = data_sectors / bpb->SectClust + FAT_CLUSTER_TABLE_LAST_RESERVED;
+    info_entry->n_clusters = (info_entry->n_clusters > fat_entries) ? fat_entries : info_entry->n_clusters;
+    info_entry->fat_cache = NULL;
+    info_entry->fat_cache_hint = 0;
+    info_entry->fat_cache_clock = 0;
+
+    info_entry->free_map = NULL;
+    info_entry->free_clusters = FSINFO_UNKNOWN;
+    info_entry->next_free = FAT_CLUSTER_TABLE_LAST_RESERVED;
+    info_entry->fsinfo_dirty = FALSE;
+    fat_read_fsinfo(info_entry, startLBA);
+
+    dcache_invalidate_part(disk, part);
+    fat_dir_index_drop(disk, part, MAX);
     
     #ifndef NO_DEBUG_INFO
     print_value("[FAT_DRIVER] Drive: %i\n", (uint32_t) disk);
@@ -305,70 +488,344 @@ err_t fat_init(uint8_t disk, uint8_t part)
     return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
-static uint32_t fat_read_fat(uint8_t disk, uint8_t part, uint32_t cluster, uint32_t *last_sector, void *buffer)
+/* the FATs to write to, all of them unless mirroring is disabled */
+static void fat_get_copies(fs_info_t *info, uint32_t *first, uint32_t *count)
 {
-    if(!buffer)
-        return MAX;
-    
-    FAT32_EBPB *info = fat_get_ebpb(disk, part);
+    uint16_t flags = info->ebpb->fat_flags;
 
-    if(!info)
-        return MAX;
-    
-    /* what do we need to read? */  
-    uint32_t sector_of_fat = (info->bpb.resvSect) + MBR_getStartLBA(disk, part);
-    uint32_t fat_sector = (uint32_t) sector_of_fat + ((cluster * 4) / FAT32_SECTOR_SIZE);
+    *first = (flags & FAT_FLAGS_NO_MIRRORING) ? (flags & FAT_FLAGS_ACTIVE_FAT) : 0;
+    *count = (flags & FAT_FLAGS_NO_MIRRORING) ? 1 : info->ebpb->bpb.nFAT;
+}
+
+static err_t fat_cache_write_back(fs_info_t *info, uint32_t slot)
+{
+    fat_cache_entry_t *e = &info->fat_cache_entries[slot];
+    uint32_t first, count;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    fat_get_copies(info, &first, &count);
+
+    for(uint32_t c = first; c < (first + count) && !err; ++c)
+    {
+        uint32_t lba = info->fat_lba + c * info->ebpb->sectFAT32 + e->sector;
+        err = write(info->disk, lba, 1U, &info->fat_cache[slot * FAT32_SECTOR_SIZE]);
+    }
+
+    if(!err)
+        e->dirty = FALSE;
+
+    return err;
+}
+
+/* returns the cached FAT sector (`sector` within the FAT), reading it when needed; NULL on error */
+static uint32_t *fat_cache_get(fs_info_t *info, uint32_t sector)
+{
+    fat_cache_entry_t *e = &info->fat_cache_entries[0];
+
+    if(!info->fat_cache)
+    {
+        info->fat_cache = evalloc(FAT_CACHE_SECTORS * FAT32_SECTOR_SIZE, PID_DRIVER);
+
+        if(!info->fat_cache)
+            return NULL;
+        
+        for(uint32_t i = 0; i < FAT_CACHE_SECTORS; ++i)
+            { e[i].sector = MAX; e[i].last_used = 0; e[i].dirty = FALSE; }
+    }
+
+    uint32_t slot = info->fat_cache_hint;
+
+    if(e[slot].sector != sector)
+    {
+        uint32_t victim = 0;
+
+        for(slot = 0; slot < FAT_CACHE_SECTORS; ++slot)
+        {
+            if(e[slot].sector == sector)
+                break;
+            
+            // unused slots have never been used, so they go first
+            if(e[slot].last_used < e[victim].last_used)
+                victim = slot;
+        }
+
+        if(slot >= FAT_CACHE_SECTORS)
+        {
+            slot = victim;
+
+            if(e[slot].dirty && fat_cache_write_back(info, slot))
+                return NULL;
+            
+            uint32_t first, count;
+            fat_get_copies(info, &first, &count);
+
+            e[slot].sector = MAX;
+            
+            if(read(info->disk, info->fat_lba + first * info->ebpb->sectFAT32 + sector, 1U, &info->fat_cache[slot * FAT32_SECTOR_SIZE]))
+                return NULL;
+            
+            e[slot].sector = sector;
+        }
+    }
+
+    e[slot].last_used = ++info->fat_cache_clock;
+    info->fat_cache_hint = slot;
+
+    return (uint32_t *) &info->fat_cache[slot * FAT32_SECTOR_SIZE];
+}
+
+/* writes the dirty FAT sectors to every FAT; adjacent sectors are written together */
+static err_t fat_cache_write_dirty(fs_info_t *info)
+{
+    fat_cache_entry_t *e = &info->fat_cache_entries[0];
+    uint8_t order[FAT_CACHE_SECTORS];
+    uint32_t n = 0;
+
+    // the dirty slots, sorted by sector
+    for(uint32_t i = 0; i < FAT_CACHE_SECTORS; ++i)
+    {
+        if(!e[i].dirty)
+            continue;
+        
+        uint32_t j = n++;
+
+        for(; j && e[order[j - 1]].sector > e[i].sector; --j)
+            order[j] = order[j - 1];
+        
+        order[j] = (uint8_t) i;
+    }
+
+    if(!n)
+        return EXIT_CODE_GLOBAL_SUCCESS;
     
+    // without a buffer to gather runs in every sector is written on its own
+    uint8_t *run_buf = (n > 1) ? evalloc(FAT_FLUSH_RUN_SECTORS * FAT32_SECTOR_SIZE, PID_DRIVER) : NULL;
+    uint32_t first, count;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    fat_get_copies(info, &first, &count);
+
+    // one FAT after the other, so that the writes to each FAT are in order
+    for(uint32_t c = first; c < (first + count) && !err; ++c)
+    {
+        for(uint32_t i = 0; i < n && !err;)
+        {
+            uint32_t sector = e[order[i]].sector, len = 1;
+            uint8_t *data = &info->fat_cache[order[i] * FAT32_SECTOR_SIZE];
+
+            while(run_buf && i + len < n && len < FAT_FLUSH_RUN_SECTORS && e[order[i + len]].sector == sector + len)
+                len++;
+            
+            if(len > 1)
+            {
+                for(uint32_t k = 0; k < len; ++k)
+                    memcpy(&run_buf[k * FAT32_SECTOR_SIZE], &info->fat_cache[order[i + k] * FAT32_SECTOR_SIZE], FAT32_SECTOR_SIZE);
+                
+                data = run_buf;
+            }
+
+            err = write(info->disk, info->fat_lba + c * info->ebpb->sectFAT32 + sector, len, data);
+            i += len;
+        }
+    }
+
+    for(uint32_t i = 0; i < n && !err; ++i)
+        e[order[i]].dirty = FALSE;
+
+    vfree(run_buf);
+    return err;
+}
+
+/* writes all changes to the FAT(s) to disk */
+static err_t fat_cache_flush(uint8_t disk, uint8_t part)
+{
+    fs_info_t *info = fat_get_info(disk, part);
     err_t err = EXIT_CODE_GLOBAL_SUCCESS;
 
-    // do not read from disk if we read the sector in the previous
-    // 'run' (saves quite some time)
-    if(*(last_sector) != fat_sector)
-        err = read(disk, fat_sector, 1U, (uint8_t *) buffer);
+    if(!info || !info->fat_cache)
+        return EXIT_CODE_GLOBAL_SUCCESS;
+
+    err = fat_cache_write_dirty(info);
+
+    if(err || !info->fsinfo || !info->fsinfo_dirty)
+        return err;
     
-    if(err)
-        return NULL;
+    info->fsinfo->free_count = info->free_clusters;
+    info->fsinfo->next_free = info->next_free;
+
+    err = write(disk, MBR_getStartLBA(disk, part) + info->ebpb->FSinfo, 1U, (uint8_t *) info->fsinfo);
+    info->fsinfo_dirty = (err) ? TRUE : FALSE;
+
+    return err;
+}
+
+/* returns the FAT entry of cluster (i.e. the next cluster), or MAX on error */
+static uint32_t fat_read_fat(uint8_t disk, uint8_t part, uint32_t cluster)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+
+    if(!info || cluster >= info->n_clusters)
+        return MAX;
+    
+    uint32_t *table = fat_cache_get(info, cluster / FAT_ENTRIES_PER_SECTOR);
+
+    if(!table)
+        return MAX;
+
+    return table[cluster % FAT_ENTRIES_PER_SECTOR] & FAT_ENTRY_MASK;
+}
+
+/* keeps the free map, free count and allocation hint up to date when a cluster is (de)allocated */
+static void fat_map_set(fs_info_t *info, uint32_t cluster, bool_t free)
+{
+    if(info->free_map)
+    {
+        if(free)
+            info->free_map[cluster / 32U] |= (1U << (cluster % 32U));
+        else
+            info->free_map[cluster / 32U] &= ~(1U << (cluster % 32U));
+    }
 
-    // calculate the entry, read and return it
-    uint32_t entry = (cluster * 4) % FAT32_SECTOR_SIZE;
-    uint8_t *table = buffer;
+    if(info->free_clusters != FSINFO_UNKNOWN)
+        info->free_clusters = (free) ? info->free_clusters + 1 : info->free_clusters - 1;
 
-    // store information for next time
-    *(last_sector) = fat_sector;
+    if(!free)
+        info->next_free = (cluster + 1 < info->n_clusters) ? cluster + 1 : FAT_CLUSTER_TABLE_LAST_RESERVED;
 
-    return (*((uint32_t *) &table[entry])) & 0x0FFFFFFF;
+    info->fsinfo_dirty = TRUE;
 }
 
+/* changes the FAT entry of cluster in the cache, see fat_cache_flush() */
 static void fat_write_cluster_to_table(uint8_t disk, uint8_t part, uint32_t cluster, uint32_t points_to_cluster)
 {
-    uint8_t *buffer = kmalloc(FAT32_SECTOR_SIZE);
-    uint32_t last_sector = 0;
+    fs_info_t *info = fat_get_info(disk, part);
 
-    fat_read_fat(disk, part, cluster, &last_sector, buffer);
+    if(!info || cluster >= info->n_clusters)
+        return;
     
-    uint32_t entry = (cluster * 4) % FAT32_SECTOR_SIZE;
+    uint32_t *table = fat_cache_get(info, cluster / FAT_ENTRIES_PER_SECTOR);
 
-    uint32_t *table_entry = (uint32_t *) (&buffer[entry]);
-    *(table_entry) = points_to_cluster & 0x0FFFFFFF;
+    if(!table)
+        return;
+
+    // the upper four bits are reserved and should be left alone
+    uint32_t *entry = &table[cluster % FAT_ENTRIES_PER_SECTOR];
+    bool_t was_free = ((*entry & FAT_ENTRY_MASK) == FAT_EMPTY_CLUSTER) ? TRUE : FALSE;
+    bool_t is_free = ((points_to_cluster & FAT_ENTRY_MASK) == FAT_EMPTY_CLUSTER) ? TRUE : FALSE;
 
-    write(disk, last_sector, 1U, buffer);
+    *entry = (*entry & ~FAT_ENTRY_MASK) | (points_to_cluster & FAT_ENTRY_MASK);
+    info->fat_cache_entries[info->fat_cache_hint].dirty = TRUE;
+
+    if(was_free == is_free)
+        return;
 
-    kfree(buffer);
+    fat_map_set(info, cluster, is_free);
 }
 
+/* reads the whole FAT once to find out which clusters are free */
+static err_t fat_map_build(fs_info_t *info)
+{
+    uint32_t words = (info->n_clusters + 31U) / 32U;
+    uint32_t *map = evalloc(words * sizeof(uint32_t), PID_DRIVER);
+    uint32_t *fat = evalloc(FAT_MAP_READ_SECTORS * FAT32_SECTOR_SIZE, PID_DRIVER);
+
+    if(!map || !fat)
+        { vfree(map); vfree(fat); return EXIT_CODE_GLOBAL_OUT_OF_MEMORY; }
+
+    // the FAT on disk has to be up to date
+    err_t err = fat_cache_flush(info->disk, info->part);
+
+    uint32_t first, count;
+    fat_get_copies(info, &first, &count);
+
+    uint32_t fat_sectors = (info->n_clusters + FAT_ENTRIES_PER_SECTOR - 1) / FAT_ENTRIES_PER_SECTOR;
+    uint32_t free_clusters = 0;
+    memset(map, words * sizeof(uint32_t), 0);
+
+    for(uint32_t sector = 0; sector < fat_sectors && !err; sector += FAT_MAP_READ_SECTORS)
+    {
+        uint32_t n = (fat_sectors - sector < FAT_MAP_READ_SECTORS) ? fat_sectors - sector : FAT_MAP_READ_SECTORS;
+        err = read(info->disk, info->fat_lba + first * info->ebpb->sectFAT32 + sector, n, (uint8_t *) fat);
+
+        uint32_t cluster = sector * FAT_ENTRIES_PER_SECTOR;
+
+        for(uint32_t i = 0; i < n * FAT_ENTRIES_PER_SECTOR && !err && cluster < info->n_clusters; ++i, ++cluster)
+        {
+            if(cluster < FAT_CLUSTER_TABLE_LAST_RESERVED || (fat[i] & FAT_ENTRY_MASK) != FAT_EMPTY_CLUSTER)
+                continue;
+
+            map[cluster / 32U] |= (1U << (cluster % 32U));
+            free_clusters++;
+        }
+    }
+
+    vfree(fat);
+
+    if(err)
+        { vfree(map); return err; }
+
+    // the FSInfo count is only a hint, this one is exact
+    info->fsinfo_dirty = (info->free_clusters != free_clusters) ? TRUE : info->fsinfo_dirty;
+    info->free_clusters = free_clusters;
+    info->free_map = map;
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/* first free cluster in [from, to) according to the free map, MAX if there is none */
+static uint32_t fat_map_find(fs_info_t *info, uint32_t from, uint32_t to)
+{
+    uint32_t w = from / 32U;
+    uint32_t bits = info->free_map[w] & ~((1U << (from % 32U)) - 1U);
+
+    while(!bits)
+    {
+        if(++w >= (to + 31U) / 32U)
+            return MAX;
+        
+        bits = info->free_map[w];
+    }
+
+    uint32_t cluster = w * 32U;
+
+    while(!(bits & 1U))
+        { bits >>= 1; cluster++; }
+
+    return (cluster < to) ? cluster : MAX;
+}
+
+/* *start: cluster to start searching at (0 to use the allocation hint); output: first free cluster, or MAX if there is none */
 static void fat_find_empty_cluster(uint8_t disk, uint8_t part, uint32_t *start)
 {
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
+    fs_info_t *info = fat_get_info(disk, part);
+
+    if(!info)
+        { *start = MAX; return; }
+    
+    uint32_t hint = (*start >= FAT_CLUSTER_TABLE_LAST_RESERVED && *start < info->n_clusters) ? *start : info->next_free;
 
-    uint32_t cluster = (!start) ? FAT_CLUSTER_TABLE_LAST_RESERVED + 1 : *start;
-    uint32_t res = 0;
+    if(info->free_map || !fat_map_build(info))
+    {
+        uint32_t cluster = fat_map_find(info, hint, info->n_clusters);
+        
+        if(cluster == MAX)
+            cluster = fat_map_find(info, FAT_CLUSTER_TABLE_LAST_RESERVED, hint);
+        
+        *start = cluster;
+        return;
+    }
 
-    while((res = (fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer))) != 0)
-        cluster++;
+    // no memory for the free map, look through the FAT itself
+    for(uint32_t i = 0; i < info->n_clusters - FAT_CLUSTER_TABLE_LAST_RESERVED; ++i)
+    {
+        uint32_t cluster = hint + i;
+        cluster = (cluster >= info->n_clusters) ? cluster - info->n_clusters + FAT_CLUSTER_TABLE_LAST_RESERVED : cluster;
+        
+        if(fat_read_fat(disk, part, cluster) == FAT_EMPTY_CLUSTER)
+            { *start = cluster; return; }
+    }
 
-    kfree(fat_table_buffer);
-    *start = cluster;
+    *start = MAX;
 }
 
 static void fat_read_cluster(uint8_t disk, uint8_t part, uint32_t cluster, void *buffer, uint32_t sect_clust)
@@ -403,6 +860,197 @@ static uint32_t fat_search_dir_part(FAT32_DIR *dir, const char *filename, size_t
 
 }
 
+static uint32_t fat_dir_index_hash(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+
+    for(uint32_t i = 0; i < TOTAL_FILENAME_LEN; ++i)
+        hash = (hash ^ (uint8_t) name[i]) * 16777619U;
+    
+    return hash;
+}
+
+static void fat_dir_index_insert(fat_dir_index_t *dindex, const char *name, uint32_t cluster, uint32_t index)
+{
+    // full, the directory will be indexed again on its next lookup
+    if(dindex->n_entries >= dindex->capacity)
+        { fat_dir_index_free(dindex); return; }
+
+    fat_dir_index_entry_t *e = &dindex->entries[dindex->n_entries];
+    uint32_t bucket = fat_dir_index_hash(name) & (dindex->n_buckets - 1);
+
+    memcpy(&e->name[0], name, TOTAL_FILENAME_LEN);
+    e->index = (uint16_t) index;
+    e->cluster = cluster;
+    e->next = dindex->buckets[bucket];
+
+    dindex->buckets[bucket] = dindex->n_entries++;
+}
+
+static fat_dir_index_entry_t *fat_dir_index_find(fat_dir_index_t *dindex, const char *name)
+{
+    uint32_t i = dindex->buckets[fat_dir_index_hash(name) & (dindex->n_buckets - 1)];
+
+    for(; i != MAX; i = dindex->entries[i].next)
+        if(!strcmp_until(&dindex->entries[i].name[0], name, TOTAL_FILENAME_LEN))
+            return &dindex->entries[i];
+    
+    return NULL;
+}
+
+/* memory for an index; when there is none, the least recently used index makes room */
+static void *fat_dir_index_alloc(size_t size)
+{
+    void *ptr = evalloc(size, PID_DRIVER);
+
+    while(!ptr)
+    {
+        fat_dir_index_t *victim = NULL;
+
+        for(uint32_t i = 0; i < FAT_DIR_INDEXES; ++i)
+            if(dir_indexes[i].dir_cluster && (!victim || dir_indexes[i].last_used < victim->last_used))
+                victim = &dir_indexes[i];
+        
+        if(!victim)
+            return NULL;
+        
+        fat_dir_index_free(victim);
+        ptr = evalloc(size, PID_DRIVER);
+    }
+
+    return ptr;
+}
+
+/* reads the whole directory once and indexes the names in it, returns NULL if the directory is not indexed */
+static fat_dir_index_t *fat_dir_index_build(uint8_t disk, uint8_t part, uint32_t dir_cluster)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    uint32_t per_cluster = cluster_size / sizeof(FAT32_DIR);
+    uint32_t n = 0;
+
+    if(!info)
+        return NULL;
+
+    for(uint32_t c = dir_cluster; c < FAT_CORRUPT_CLUSTER && n < info->n_clusters; c = fat_read_fat(disk, part, c))
+        n++;
+    
+    if(n < FAT_DIR_INDEX_MIN_CLUSTERS)
+        return NULL;
+    
+    // take the least recently used slot
+    fat_dir_index_t *dindex = &dir_indexes[0];
+
+    for(uint32_t i = 0; i < FAT_DIR_INDEXES; ++i)
+    {
+        if(!dir_indexes[i].dir_cluster)
+            { dindex = &dir_indexes[i]; break; }
+        if(dir_indexes[i].last_used < dindex->last_used)
+            dindex = &dir_indexes[i];
+    }
+
+    if(dindex->dir_cluster)
+        fat_dir_index_free(dindex);
+
+    // room for another cluster of entries before the index is full
+    dindex->capacity = (n + 1) * per_cluster;
+    for(dindex->n_buckets = 64; dindex->n_buckets < dindex->capacity / 2; dindex->n_buckets <<= 1);
+
+    uint8_t *mem = fat_dir_index_alloc(dindex->n_buckets * sizeof(uint32_t) + dindex->capacity * sizeof(fat_dir_index_entry_t));
+    FAT32_DIR *dir = evalloc(cluster_size, PID_DRIVER);
+
+    if(!mem || !dir)
+        { vfree(mem); vfree(dir); return NULL; }
+
+    dindex->disk = disk;
+    dindex->part = part;
+    dindex->dir_cluster = dir_cluster;
+    dindex->n_entries = 0;
+    dindex->buckets = (uint32_t *) mem;
+    dindex->entries = (fat_dir_index_entry_t *) &mem[dindex->n_buckets * sizeof(uint32_t)];
+    memset(dindex->buckets, dindex->n_buckets * sizeof(uint32_t), 0xFF);
+
+    bool_t end = FALSE;
+
+    for(uint32_t c = dir_cluster; c < FAT_CORRUPT_CLUSTER && !end && dindex->buckets; c = fat_read_fat(disk, part, c))
+    {
+        if(read(disk, fat_cluster_lba(disk, part, c), cluster_size / FAT32_SECTOR_SIZE, (uint8_t *) dir))
+            { fat_dir_index_free(dindex); break; }
+
+        for(uint32_t i = 0; i < per_cluster && dindex->buckets; ++i)
+        {
+            // the first unused entry ends the directory
+            if(!dir[i].name[0])
+                { end = TRUE; break; }
+
+            if((uint8_t) dir[i].name[0] == DIR_UNUSED_ENTRY || dir[i].attrib == FAT_DIR_ATTRIB_LFN || dir[i].attrib == FAT_DIR_ATTRIB_VOLUME_ID)
+                continue;
+            
+            fat_dir_index_insert(dindex, &dir[i].name[0], c, i);
+        }
+    }
+
+    vfree(dir);
+    return (dindex->buckets) ? dindex : NULL;
+}
+
+/* looks a name up through the index of the directory (built if needed); returns MAX if the directory is not indexed.
+   Otherwise returns the index of the entry within *dir_part_cluster, or FAT_CORRUPT_CLUSTER if the name does not exist */
+static uint32_t fat_dir_index_lookup(uint8_t disk, uint8_t part, uint32_t dir_cluster, const char *filename, FAT32_DIR *odir_entry, uint32_t *dir_part_cluster)
+{
+    fat_dir_index_t *dindex = fat_dir_index_get(disk, part, dir_cluster);
+    dindex = (dindex) ? dindex : fat_dir_index_build(disk, part, dir_cluster);
+
+    if(!dindex)
+        return MAX;
+    
+    dindex->last_used = ++dir_index_clock;
+    fat_dir_index_entry_t *e = fat_dir_index_find(dindex, filename);
+
+    if(!e)
+        return FAT_CORRUPT_CLUSTER;
+
+    // only the sector with the entry has to be read
+    FAT32_DIR *sector = kmalloc(FAT32_SECTOR_SIZE);
+    uint32_t per_sector = FAT32_SECTOR_SIZE / sizeof(FAT32_DIR);
+
+    if(!sector)
+        return MAX;
+    
+    if(read(disk, fat_cluster_lba(disk, part, e->cluster) + e->index / per_sector, 1U, (uint8_t *) sector))
+        { kfree(sector); return MAX; }
+
+    memcpy(odir_entry, &sector[e->index % per_sector], sizeof(FAT32_DIR));
+    *dir_part_cluster = e->cluster;
+
+    kfree(sector);
+    return e->index;
+}
+
+/* keeps the index of a directory in sync with a new entry (old_name NULL) or a removed 
+   entry (new_name NULL) or a renamed one */
+static void fat_dir_index_update(uint8_t disk, uint8_t part, uint32_t dir_cluster, const char *old_name, const char *new_name,
+                                 uint32_t cluster, uint32_t index)
+{
+    fat_dir_index_t *dindex = fat_dir_index_get(disk, part, dir_cluster);
+
+    if(!dindex)
+        return;
+    
+    if(old_name)
+    {
+        fat_dir_index_entry_t *e = fat_dir_index_find(dindex, old_name);
+
+        // the name stays in the bucket chain, it just never matches anything again
+        if(e)
+            e->name[0] = (char) DIR_UNUSED_ENTRY;
+    }
+
+    if(new_name)
+        fat_dir_index_insert(dindex, new_name, cluster, index);
+}
+
 static uint32_t fat_find_in_dir(uint8_t disk, uint8_t part, const char *filename, uint32_t starting_cluster, FAT32_DIR *odir_entry, uint32_t *dir_part_cluster)
 {
     FAT32_EBPB *info = fat_get_ebpb(disk, part);
@@ -413,6 +1061,15 @@ static uint32_t fat_find_in_dir(uint8_t disk, uint8_t part, const char *filename
     // if no cluster is given, assume start at root dir
     uint32_t cluster = (!starting_cluster) ? info->clustLocRootdir : starting_cluster;
 
+    // names (not the markers of unused entries) are looked up through the index of the directory
+    if(filename[0] && (uint8_t) filename[0] != DIR_UNUSED_ENTRY)
+    {
+        uint32_t index = fat_dir_index_lookup(disk, part, cluster, filename, odir_entry, dir_part_cluster);
+
+        if(index != MAX)
+            return (index == FAT_CORRUPT_CLUSTER) ? MAX : index;
+    }
+
     uint32_t cluster_size = fat_get_cluster_size(disk, part);
 
     FAT32_DIR *dir_part = evalloc(cluster_size, PID_DRIVER);
@@ -420,9 +1077,6 @@ static uint32_t fat_find_in_dir(uint8_t disk, uint8_t part, const char *filename
     if(!dir_part)
         return MAX;
 
-    // following two variables/pointers are necessary for fat_read_fat()
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
     
     uint32_t index = MAX;
     
@@ -436,12 +1090,12 @@ static uint32_t fat_find_in_dir(uint8_t disk, uint8_t part, const char *filename
         if(index != MAX)
             break;
         
-        cluster = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer);
+        cluster = fat_read_fat(disk, part, cluster);
     } 
 
-    memcpy(odir_entry, &dir_part[index], sizeof(FAT32_DIR));
+    if(index != MAX)
+        memcpy(odir_entry, &dir_part[index], sizeof(FAT32_DIR));
 
-    kfree(fat_table_buffer);
     vfree(dir_part);
 
     return index;
@@ -501,8 +1155,13 @@ static uint32_t fat_traverse(const char *path, size_t *ofile_size, uint8_t *oatt
     
     FAT32_EBPB *info = fat_get_ebpb(disk, part);
 
+    // the root directory has no entry of its own to take the size and attributes from
     if(start == MAX)
+    {
+        *ofile_size = 0;
+        *oattrib = FAT_DIR_ATTRIB_DIRECTORY;
         return info->clustLocRootdir;
+    }
 
     // buffer for filename is maximum characters long. At this stage
     // this is 8 chars filename, 1 seperator ('.'), 3 chars extension
@@ -517,10 +1176,22 @@ static uint32_t fat_traverse(const char *path, size_t *ofile_size, uint8_t *oatt
             break;
 
         fat_filename_fatcompat(filename);
-        
-        if(fat_find_in_dir(disk, part, filename, starting_cluster, &dir_entry, &ignore) == MAX)
+
+        uint8_t cached = dcache_lookup(disk, part, starting_cluster, filename, &dir_entry);
+
+        if(cached == DCACHE_NEGATIVE)
             { kfree(filename); return MAX; }
 
+        if(cached == DCACHE_MISS && fat_find_in_dir(disk, part, filename, starting_cluster, &dir_entry, &ignore) == MAX)
+        {
+            dcache_insert(disk, part, starting_cluster, filename, NULL, 0);
+            kfree(filename); 
+            return MAX; 
+        }
+
+        if(cached == DCACHE_MISS)
+            dcache_insert(disk, part, starting_cluster, filename, &dir_entry, sizeof(FAT32_DIR));
+
         starting_cluster = (uint32_t) ((dir_entry.clHi << 16u) | dir_entry.clLo);
 
         if(!starting_cluster && !strcmp_until(filename, ".. ", sizeof(".. ") - 1))
@@ -541,11 +1212,6 @@ static size_t fat_get_size_from_n_clusters(uint8_t disk, uint8_t part, uint32_t
 {
     size_t cl_size = fat_get_cluster_size(disk, part);
 
-    // following two variables/pointers are necessary for fat_read_fat()
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
-
-    ASSERT(fat_table_buffer);
 
     uint32_t cluster = st_cluster;
     size_t s = 0;
@@ -553,10 +1219,9 @@ static size_t fat_get_size_from_n_clusters(uint8_t disk, uint8_t part, uint32_t
     while(cluster < FAT_CORRUPT_CLUSTER)
     {
         s += cl_size;
-        cluster = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer);
+        cluster = fat_read_fat(disk, part, cluster);
     }
 
-    kfree(fat_table_buffer);
     return s;
 }
 
@@ -571,6 +1236,10 @@ file_t *fat_read(const char *path, size_t *ofile_size)
     if(starting_cluster == MAX)
         return NULL;
 
+    // an empty file has no clusters to read
+    if(!*ofile_size && !(attributes & FAT_DIR_ATTRIB_DIRECTORY))
+        return evalloc(FAT32_SECTOR_SIZE, PID_DRIVER);
+
     if(!*ofile_size)
         *ofile_size = fat_get_size_from_n_clusters(disk, part, starting_cluster);
     
@@ -581,9 +1250,6 @@ file_t *fat_read(const char *path, size_t *ofile_size)
     if(!file)
         return NULL;
     
-    // following two variables/pointers are necessary for fat_read_fat()
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
     
     uint32_t cluster = starting_cluster;
     FAT32_EBPB *info = fat_get_ebpb(disk, part);
@@ -591,25 +1257,42 @@ file_t *fat_read(const char *path, size_t *ofile_size)
     if(!info)
         return NULL;
 
-    uint32_t sectclust = info->bpb.SectClust;
+    uint32_t cluster_size = info->bpb.SectClust * FAT32_SECTOR_SIZE;
     size_t read_size = alloc_size;
     uint32_t i = 0;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
 
-    // read the file!
-    while(cluster < FAT_CORRUPT_CLUSTER)
+    // the most the driver reads with one command
+    const blkdev_caps_t *caps = diskio_get_caps(disk);
+    uint32_t max_sectors = (caps && caps->max_transfer) ? caps->max_transfer : info->bpb.SectClust;
+
+    // read the file, clusters that follow each other on disk are read together
+    while(cluster < FAT_CORRUPT_CLUSTER && read_size && !err)
     {
-        size_t to_read = (read_size >= (sectclust * FAT32_SECTOR_SIZE)) ? (sectclust * FAT32_SECTOR_SIZE) : read_size;
+        uint32_t first = cluster, n_clusters = 0;
+
+        do
+        {
+            n_clusters++;
+            cluster = fat_read_fat(disk, part, cluster);
+        } while(cluster == first + n_clusters && n_clusters * cluster_size < read_size);
+
+        size_t to_read = (read_size >= n_clusters * cluster_size) ? n_clusters * cluster_size : read_size;
         uint32_t n_sectors = to_read / FAT32_SECTOR_SIZE + ((to_read % FAT32_SECTOR_SIZE) != 0);
-        uint32_t lba = fat_cluster_lba(disk, part, cluster);
+        uint32_t lba = fat_cluster_lba(disk, part, first);
+
+        for(uint32_t done = 0; done < n_sectors && !err; done += max_sectors)
+        {
+            uint32_t n = (n_sectors - done > max_sectors) ? max_sectors : n_sectors - done;
+            err = read(disk, lba + done, n, &buffer[i + done * FAT32_SECTOR_SIZE]);
+        }
 
-        read(disk, lba, n_sectors, &buffer[i]);       
-        cluster = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer);
-        
         read_size -= to_read;
-        i += sectclust * FAT32_SECTOR_SIZE;
+        i += to_read;
     } 
 
-    kfree(fat_table_buffer);
+    if(err)
+        { vfree(file); return NULL; }
 
     return file;
 }
@@ -636,265 +1319,740 @@ static uint32_t fat_grow_dir(uint8_t disk, uint8_t part, uint32_t *dir_cluster)
     uint32_t cluster = 0;
     fat_find_empty_cluster(disk, part, &cluster);
 
+    if(cluster == MAX)
+        return MAX;
+
     *dir_cluster = cluster;
     fat_write_cluster_to_table(disk, part, current_cluster, *dir_cluster);
+    fat_write_cluster_to_table(disk, part, cluster, FAT_LAST_CLUSTER);
 
     return 0;
 }
 
-static uint32_t fat_find_free_index(uint8_t disk, uint8_t part, uint32_t *dir_cluster)
+static uint32_t fat_find_free_index(uint8_t disk, uint8_t part, uint32_t *dir_cluster, uint32_t *onew_cluster)
 {
     FAT32_EBPB *info = fat_get_ebpb(disk, part);
     
     if(!info)
         return MAX;
 
-     // find empty entry
-    char empty_entry_name[2] = {(char) (DIR_UNUSED_ENTRY), 0}; 
-    FAT32_DIR dir_entry;
-    uint32_t dir_part_cluster;
+     // find empty entry
+    char empty_entry_name[2] = {(char) (DIR_UNUSED_ENTRY), 0}; 
+    FAT32_DIR dir_entry;
+    uint32_t dir_part_cluster = MAX;
+
+    uint32_t index = fat_find_in_dir(disk, part, &empty_entry_name[0], *dir_cluster, &dir_entry, &dir_part_cluster);
+
+    // if no empty entry then get the last entry of the directory
+    if(index == MAX)
+    {
+        empty_entry_name[0] = 0;
+        index = fat_find_in_dir(disk, part, &empty_entry_name[0], *dir_cluster, &dir_entry, &dir_part_cluster);
+    }
+
+    if(dir_part_cluster == MAX)
+        return MAX;
+
+    *dir_cluster = dir_part_cluster;
+    *onew_cluster = 0;
+
+    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    bool_t last_entry = (index != MAX) && empty_entry_name[0] == (char) 0 &&
+                        ((index * sizeof(FAT32_DIR)) + sizeof(FAT32_DIR) >= cluster_size);
+
+    // the end of the directory is the very last entry that fits on its cluster (or the directory
+    // is full): grow the directory, so the entries of the new cluster can end it
+    if(index == MAX || last_entry)
+    {
+        uint32_t cluster = *dir_cluster;
+
+        if(fat_grow_dir(disk, part, &cluster) == MAX)
+            return MAX;
+        
+        *onew_cluster = cluster;
+
+        // a full directory gets the entry on the new cluster
+        if(index == MAX)
+            { *dir_cluster = cluster; index = 0; }
+    }
+    
+    return index;
+}
+
+/* the sector that holds entry index of the directory cluster dir_part_cluster */
+static uint32_t fat_dir_entry_lba(uint8_t disk, uint8_t part, uint32_t dir_part_cluster, uint32_t index)
+{
+    return fat_cluster_lba(disk, part, dir_part_cluster) + index / DIR_ENTRIES_PER_SECTOR;
+}
+
+static err_t fat_write_dir(uint8_t disk, uint8_t part, uint32_t fcluster, uint32_t dir_cluster, size_t fsize, uint8_t attrib, char *filename)
+{
+    uint32_t current_dir_cluster = dir_cluster, new_cluster;
+    uint32_t index = fat_find_free_index(disk, part, &dir_cluster, &new_cluster);
+
+    if(index == MAX)
+        return EXIT_CODE_FS_NO_SPACE;
+
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    // a new cluster of the directory is cleared as a whole, its (empty) entries end the directory
+    if(new_cluster)
+    {
+        uint32_t cluster_size = fat_get_cluster_size(disk, part);
+        uint8_t *empty = evalloc(cluster_size, PID_DRIVER);
+
+        if(!empty)
+            return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+
+        memset(empty, cluster_size, 0);
+        err = write(disk, fat_cluster_lba(disk, part, new_cluster), cluster_size / FAT32_SECTOR_SIZE, empty);
+        vfree(empty);
+    }
+
+    // only the sector with the entry is changed
+    FAT32_DIR *dir = kmalloc(FAT32_SECTOR_SIZE);
+
+    if(!dir)
+        return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+
+    uint32_t lba = fat_dir_entry_lba(disk, part, dir_cluster, index);
+
+    if(!err)
+        err = read(disk, lba, 1U, (uint8_t *) dir);
+
+    FAT32_DIR *entry = &dir[index % DIR_ENTRIES_PER_SECTOR];
+
+    entry->attrib = attrib;
+    entry->fSize = fsize;
+    entry->clHi = (uint16_t) (fcluster >> 16u);
+    entry->clLo = (uint16_t) (fcluster & 0xFFFF);
+
+    memcpy(&entry->name[0], filename, TOTAL_FILENAME_LEN);
+
+    if(!err)
+        err = write(disk, lba, 1U, (uint8_t *) dir);
+    
+    if(!err)
+        fat_dir_index_update(disk, part, current_dir_cluster, NULL, filename, dir_cluster, index);
+
+    kfree(dir);
+
+    return err;
+}
+
+/* number of free clusters directly behind cluster, at most max */
+static uint32_t fat_map_free_after(fs_info_t *info, uint32_t cluster, uint32_t max)
+{
+    uint32_t n = 0;
+
+    if(!info->free_map)
+        return 0;
+    
+    for(uint32_t c = cluster + 1; n < max && c < info->n_clusters; ++c, ++n)
+        if(!(info->free_map[c / 32U] & (1U << (c % 32U))))
+            break;
+    
+    return n;
+}
+
+/* finds the smallest run of free clusters that fits want clusters, or the largest run if none does.
+   Returns its first cluster (MAX if the volume is full), *len is the usable length of the run */
+static uint32_t fat_find_free_run(uint8_t disk, uint8_t part, uint32_t want, uint32_t *len)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+    uint32_t best = MAX, best_len = 0;
+
+    *len = 0;
+
+    if(!info)
+        return MAX;
+
+    // no free map, one cluster at a time then
+    if(!info->free_map && fat_map_build(info))
+    {
+        uint32_t cluster = 0;
+        fat_find_empty_cluster(disk, part, &cluster);
+
+        *len = (cluster == MAX) ? 0 : 1;
+        return cluster;
+    }
+
+    uint32_t *map = info->free_map;
+    uint32_t c = FAT_CLUSTER_TABLE_LAST_RESERVED;
+
+    while(c < info->n_clusters)
+    {
+        // skip whole words of used clusters
+        if(!(c % 32U) && !map[c / 32U])
+            { c += 32U; continue; }
+
+        if(!(map[c / 32U] & (1U << (c % 32U))))
+            { c++; continue; }
+
+        uint32_t run = c;
+
+        while(c < info->n_clusters && (map[c / 32U] & (1U << (c % 32U))))
+            c += (!(c % 32U) && map[c / 32U] == MAX && c + 32U <= info->n_clusters) ? 32U : 1U;
+
+        uint32_t run_len = c - run;
+
+        // a run that fits beats one that does not, the smaller the better if it does
+        bool_t fits = (run_len >= want) ? TRUE : FALSE;
+        bool_t better = (best_len >= want) ? (fits && run_len < best_len) : (run_len > best_len);
+
+        if(!better)
+            continue;
+        
+        best = run;
+        best_len = run_len;
+
+        if(run_len == want)
+            break;
+    }
+
+    *len = (best_len > want) ? want : best_len;
+    return best;
+}
+
+/* links count clusters starting at first into a chain that continues at next, 
+   each FAT sector is looked up once */
+static void fat_write_chain(uint8_t disk, uint8_t part, uint32_t first, uint32_t count, uint32_t next)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+    uint32_t last = first + count;
+
+    if(!info || last > info->n_clusters)
+        return;
+
+    for(uint32_t c = first; c < last;)
+    {
+        uint32_t *table = fat_cache_get(info, c / FAT_ENTRIES_PER_SECTOR);
+
+        if(!table)
+            return;
+        
+        uint32_t end = (c / FAT_ENTRIES_PER_SECTOR + 1) * FAT_ENTRIES_PER_SECTOR;
+        end = (end > last) ? last : end;
+
+        for(; c < end; ++c)
+        {
+            uint32_t *entry = &table[c % FAT_ENTRIES_PER_SECTOR];
+            uint32_t to = (c + 1 < last) ? c + 1 : next;
+
+            if((*entry & FAT_ENTRY_MASK) == FAT_EMPTY_CLUSTER)
+                fat_map_set(info, c, FALSE);
+
+            *entry = (*entry & ~FAT_ENTRY_MASK) | (to & FAT_ENTRY_MASK);
+        }
+
+        info->fat_cache_entries[info->fat_cache_hint].dirty = TRUE;
+    }
+}
+
+/* writes a file to newly allocated clusters; cluster is the first one, claimed by the caller. 
+   The file gets as few runs of contiguous clusters as possible, each written with a single write() */
+static err_t fat_write_new_clusters(uint8_t disk, uint8_t part, uint32_t cluster, file_t *buffer, size_t filesize)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    uint32_t sectclust = cluster_size / FAT32_SECTOR_SIZE;
+
+    if(!info)
+        return EXIT_CODE_GLOBAL_GENERAL_FAIL;
+
+    uint32_t left = (filesize + cluster_size - 1) / cluster_size;
+
+    // the first run is whatever is free behind the first cluster
+    uint32_t run = cluster;
+    uint32_t run_len = 1 + fat_map_free_after(info, cluster, left - 1);
+
+    uint8_t *tail = NULL;
+    uint8_t *data = (uint8_t *) buffer;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    while(run_len)
+    {
+        // whole clusters straight from the caller's buffer, only a partial last cluster is padded
+        uint32_t full = filesize / cluster_size;
+        full = (full > run_len) ? run_len : full;
+
+        if(full)
+            err = write(disk, fat_cluster_lba(disk, part, run), full * sectclust, data);
+        
+        data += full * cluster_size;
+        filesize -= full * cluster_size;
+
+        if(!err && full < run_len)
+        {
+            tail = (tail) ? tail : evalloc(cluster_size, PID_DRIVER);
+
+            if(!tail)
+                err = EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+            else
+            {
+                memcpy(tail, data, filesize);
+                memset(&tail[filesize], cluster_size - filesize, 0);
+                err = write(disk, fat_cluster_lba(disk, part, run + full), sectclust, tail);
+
+                data += filesize;
+                filesize = 0;
+            }
+        }
+
+        left -= run_len;
+
+        // claim the run before looking for the next one
+        fat_write_chain(disk, part, run, run_len, FAT_LAST_CLUSTER);
+
+        uint32_t next = FAT_LAST_CLUSTER, next_len = 0;
+
+        if(left && !err)
+            next = fat_find_free_run(disk, part, left, &next_len);
+
+        // out of space, end the file here
+        if(next == MAX)
+            err = EXIT_CODE_FS_NO_SPACE;
+        else if(next != FAT_LAST_CLUSTER)
+            fat_write_cluster_to_table(disk, part, run + run_len - 1, next);
+
+        run = next;
+        run_len = (err) ? 0 : next_len;
+    }
+
+    vfree(tail);
+    return err;
+}
+
+/* frees the chain that starts at from_cluster, or only the clusters behind it if terminate_list is set 
+   (from_cluster then becomes the last cluster). The chain is followed in the FAT cache, one sector at a time */
+static void fat_remove_clusters(uint8_t disk, uint8_t part, uint32_t from_cluster, bool_t terminate_list)
+{
+    fs_info_t *info = fat_get_info(disk, part);
+
+    if(!info)
+        return;
+
+    uint32_t cluster = from_cluster, freed = 0;
+    uint32_t to = (terminate_list) ? FAT_LAST_CLUSTER : FAT_EMPTY_CLUSTER;
+
+    // a free entry also ends the walk, so a chain that loops stops where it was freed
+    while(cluster >= FAT_CLUSTER_TABLE_LAST_RESERVED && cluster < info->n_clusters)
+    {
+        uint32_t sector = cluster / FAT_ENTRIES_PER_SECTOR;
+        uint32_t *table = fat_cache_get(info, sector);
+
+        if(!table)
+            break;
+        
+        info->fat_cache_entries[info->fat_cache_hint].dirty = TRUE;
+
+        // for as long as the chain stays within this sector
+        while(cluster >= FAT_CLUSTER_TABLE_LAST_RESERVED && cluster < info->n_clusters && cluster / FAT_ENTRIES_PER_SECTOR == sector)
+        {
+            uint32_t *entry = &table[cluster % FAT_ENTRIES_PER_SECTOR];
+            uint32_t next = *entry & FAT_ENTRY_MASK;
+
+            *entry = (*entry & ~FAT_ENTRY_MASK) | to;
+
+            if(to == FAT_EMPTY_CLUSTER && next != FAT_EMPTY_CLUSTER && info->free_map)
+                info->free_map[cluster / 32U] |= (1U << (cluster % 32U));
+            
+            freed += (to == FAT_EMPTY_CLUSTER && next != FAT_EMPTY_CLUSTER) ? 1U : 0U;
+            to = FAT_EMPTY_CLUSTER;
+            cluster = next;
+        }
+    }
+
+    if(!freed)
+        return;
+    
+    if(info->free_clusters != FSINFO_UNKNOWN)
+        info->free_clusters += freed;
+    
+    info->fsinfo_dirty = TRUE;
+}
+
+static err_t fat_write_new(uint8_t disk, uint8_t part, char *filename, uint32_t dir_cluster, file_t *buffer, size_t filesize, uint8_t attrib)
+{
+    FAT32_EBPB *info = fat_get_ebpb(disk, part);
+    
+    if(!info)
+        return EXIT_CODE_GLOBAL_GENERAL_FAIL;
+
+    // an empty file has no clusters, its entry points to cluster 0
+    if(!filesize)
+        return fat_write_dir(disk, part, 0, dir_cluster, 0, attrib, filename);
+
+    uint32_t cluster = 0;
+    fat_find_empty_cluster(disk, part, &cluster);
+
+    if(cluster == MAX)
+        return EXIT_CODE_FS_NO_SPACE;
+
+    // claim it, so that growing the directory does not pick the same cluster
+    fat_write_cluster_to_table(disk, part, cluster, FAT_LAST_CLUSTER);
+
+    // the data goes first, the entry is only made for a file that is complete on disk
+    err_t err = fat_write_new_clusters(disk, part, cluster, buffer, filesize);
+
+    if(!err)
+        err = fat_write_dir(disk, part, cluster, dir_cluster, filesize, attrib, filename);
+
+    if(err)
+        fat_remove_clusters(disk, part, cluster, FALSE);
+
+    return err;
+}
+
+/* changes the name, size and attributes of a directory entry; only the sector that holds it is rewritten */
+static err_t fat_overwrite_dir_entry(uint8_t disk, uint8_t part, uint32_t dir_part_cluster, uint32_t dir_entry_index,
+                                char *filename, size_t filesize, uint8_t attrib)
+{
+    FAT32_DIR *dir = kmalloc(FAT32_SECTOR_SIZE);
+
+    if(!dir)
+        return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+
+    uint32_t lba = fat_dir_entry_lba(disk, part, dir_part_cluster, dir_entry_index);
+    FAT32_DIR *entry = &dir[dir_entry_index % DIR_ENTRIES_PER_SECTOR];
+
+    err_t err = read(disk, lba, 1U, (uint8_t *) dir);
+
+    if(!err)
+    {
+        entry->fSize = filesize;
+        entry->attrib = attrib;
+
+        if(filename)
+            memcpy(&entry->name[0], filename, TOTAL_FILENAME_LEN);
+
+        err = write(disk, lba, 1U, (uint8_t *) dir);
+    }
+
+    kfree(dir);
+    return err;
+}
+
+/* updates a directory entry in place, only the sector that holds it is read and written.
+   The 8.3 name of the entry is copied to oname if it is not NULL */
+static err_t fat_update_dir_entry(uint8_t disk, uint8_t part, uint32_t dir_part_cluster, uint32_t dir_entry_index,
+                                size_t filesize, uint8_t attrib, uint32_t start, char *oname)
+{
+    FAT32_DIR *dir = kmalloc(FAT32_SECTOR_SIZE);
+
+    if(!dir)
+        return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+
+    uint32_t lba = fat_dir_entry_lba(disk, part, dir_part_cluster, dir_entry_index);
+    FAT32_DIR *entry = &dir[dir_entry_index % DIR_ENTRIES_PER_SECTOR];
 
-    uint32_t index = fat_find_in_dir(disk, part, &empty_entry_name[0], *dir_cluster, &dir_entry, &dir_part_cluster);
+    err_t err = read(disk, lba, 1U, (uint8_t *) dir);
 
-    // if no empty entry then get the last entry of the directory
-    if(index == MAX)
+    if(!err)
     {
-        empty_entry_name[0] = 0;
-        index = fat_find_in_dir(disk, part, &empty_entry_name[0], *dir_cluster, &dir_entry, &dir_part_cluster);
-    }
+        entry->fSize = filesize;
+        entry->attrib = attrib;
+        entry->clHi = (uint16_t) (start >> 16U);
+        entry->clLo = (uint16_t) start;
 
-    *dir_cluster = dir_part_cluster;
+        err = write(disk, lba, 1U, (uint8_t *) dir);
+    }
 
-    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    if(!err && oname)
+    {
+        memcpy(oname, &entry->name[0], TOTAL_FILENAME_LEN);
+        oname[TOTAL_FILENAME_LEN] = '\0';
+    }
 
-    // check if the entry is the very last one that can fit on a cluster
-    // grow directory if so.
-    if(((index * sizeof(FAT32_DIR)) + sizeof(FAT32_DIR) >= cluster_size) &&
-        empty_entry_name[0] == (char)0)
-            index = fat_grow_dir(disk, part, dir_cluster);
-    
-    return index;
+    kfree(dir);
+    return err;
 }
 
-static err_t fat_write_dir(uint8_t disk, uint8_t part, uint32_t fcluster, uint32_t dir_cluster, size_t fsize, uint8_t attrib, char *filename)
+/* reads the size, start and attributes of an open file back from its directory entry, another
+   handle on the same file may have changed them since this one was opened */
+static err_t fat_handle_refresh(fs_handle_t *h)
 {
-    uint32_t current_dir_cluster = dir_cluster;
-    uint32_t index = fat_find_free_index(disk, part, &dir_cluster);
-
-    if(index == MAX)
-        return EXIT_CODE_FS_NO_SPACE;
+    FAT32_DIR *dir = kmalloc(FAT32_SECTOR_SIZE);
 
-    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    if(!dir)
+        return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
 
-    void *b = evalloc(cluster_size, PID_DRIVER);
-    FAT32_DIR *dir_part = b;
+    FAT32_DIR *entry = &dir[h->dir_index % DIR_ENTRIES_PER_SECTOR];
+    err_t err = read(h->disk, fat_dir_entry_lba(h->disk, h->part, h->dir_part_cluster, h->dir_index), 1U, (uint8_t *) dir);
 
-    uint32_t sectclust = cluster_size / FAT32_SECTOR_SIZE;
-    read(disk, fat_cluster_lba(disk, part, dir_cluster), sectclust, (uint8_t *) dir_part);
+    if(!err && (!entry->name[0] || (uint8_t) entry->name[0] == DIR_UNUSED_ENTRY || (entry->attrib & FAT_DIR_ATTRIB_DIRECTORY)))
+        err = EXIT_CODE_FS_FILE_NOT_FOUND;
 
-    dir_part[index].attrib = attrib;
-    dir_part[index].fSize = fsize;
-    dir_part[index].clHi = (uint16_t) (fcluster >> 16u);
-    dir_part[index].clLo = (uint16_t) (fcluster & 0xFFFF);
+    if(!err)
+    {
+        uint32_t start = ((uint32_t) entry->clHi << 16U) | entry->clLo;
 
-    memcpy(&dir_part[index].name[0], filename, TOTAL_FILENAME_LEN);
+        // the cursor is only kept while it is on the same chain
+        if(start != h->start)
+        {
+            h->cursor_cluster = start;
+            h->cursor_offset = 0;
+        }
 
-    if(current_dir_cluster != dir_cluster)
-        dir_part[index + 1].name[0] = (char) DIR_UNUSED_ENTRY;
-    
-    write(disk, fat_cluster_lba(disk, part, dir_cluster), sectclust, (uint8_t *) b);
+        h->start = start;
+        h->size = entry->fSize;
+        h->attrib = entry->attrib;
+    }
 
-    vfree(b);
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    kfree(dir);
+    return err;
 }
 
-static void fat_write_new_clusters(uint8_t disk, uint8_t part, uint32_t cluster, file_t *buffer, size_t filesize)
+/* moves the cursor of the handle to the cluster that holds offset */
+static err_t fat_handle_seek(fs_handle_t *h, uint32_t offset)
 {
-    uint32_t cluster_size = fat_get_cluster_size(disk, part);
+    uint32_t cluster_size = fat_get_cluster_size(h->disk, h->part);
 
-    // write the file to the disk
-    uint32_t sectclust = cluster_size / FAT32_SECTOR_SIZE;
-    uint8_t *temp_buffer = evalloc(cluster_size, PID_DRIVER);
-    uint32_t i = 0;
-    
-    while(cluster < FAT_CORRUPT_CLUSTER)
-    { 
-        size_t size = (filesize >= (sectclust * FAT32_SECTOR_SIZE)) ? (sectclust * FAT32_SECTOR_SIZE) : filesize;
-        
-        memcpy(temp_buffer, (void *) ((uint32_t)*(&buffer) + i), size);
-        memset(&temp_buffer[size], (sectclust * FAT32_SECTOR_SIZE) - size, 0);
+    // the chain only goes one way
+    if(offset < h->cursor_offset)
+    {
+        h->cursor_cluster = h->start;
+        h->cursor_offset = 0;
+    }
 
-        uint32_t lba = fat_cluster_lba(disk, part, cluster);
-        write(disk, lba, sectclust,  temp_buffer);
+    while(offset - h->cursor_offset >= cluster_size)
+    {
+        uint32_t next = fat_read_fat(h->disk, h->part, h->cursor_cluster);
 
-        filesize -= size;
+        if(next < FAT_CLUSTER_TABLE_LAST_RESERVED || next >= FAT_CORRUPT_CLUSTER)
+            return EXIT_CODE_GLOBAL_GENERAL_FAIL;
         
-        uint32_t next_cluster = cluster + 1;
-        
-        if(filesize)
-            fat_find_empty_cluster(disk, part, &next_cluster);
-        else next_cluster = MAX & 0x0FFFFFFF;
-
-        fat_write_cluster_to_table(disk, part, cluster, next_cluster);
-        cluster = next_cluster;    
-        i += size;
+        h->cursor_cluster = next;
+        h->cursor_offset += cluster_size;
     }
 
-    vfree(temp_buffer);
+    return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
-static err_t fat_write_new(uint8_t disk, uint8_t part, char *filename, uint32_t dir_cluster, file_t *buffer, size_t filesize, uint8_t attrib)
+/* reads or writes size bytes at byte `skip` of the sector at lba; whole sectors go straight from/to 
+   buf, partial ones through a sector buffer (allocated on first use, freed by the caller) */
+static err_t fat_sectors_io(uint8_t disk, uint32_t lba, uint32_t skip, uint8_t *buf, size_t size, bool_t wr, uint8_t **bounce)
 {
-    FAT32_EBPB *info = fat_get_ebpb(disk, part);
-    
-    if(!info)
-        return EXIT_CODE_GLOBAL_GENERAL_FAIL;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
 
-    uint32_t cluster = 0;
-    fat_find_empty_cluster(disk, part, &cluster);
+    while(size && !err)
+    {
+        if(!skip && size >= FAT32_SECTOR_SIZE)
+        {
+            uint32_t n = size / FAT32_SECTOR_SIZE;
+            err = (wr) ? write(disk, lba, n, buf) : read(disk, lba, n, buf);
+
+            lba += n;
+            buf += n * FAT32_SECTOR_SIZE;
+            size -= n * FAT32_SECTOR_SIZE;
+            continue;
+        }
 
-    // read the directory cluster (only the cluster we need to change anything)
-    // and update information
-    err_t err = fat_write_dir(disk, part, cluster, dir_cluster, filesize, attrib, filename);
+        *bounce = (*bounce) ? *bounce : kmalloc(FAT32_SECTOR_SIZE);
 
-    if(err)
-        return err;
-    
-    fat_write_new_clusters(disk, part, cluster, buffer, filesize);
-    
-    return EXIT_CODE_GLOBAL_SUCCESS;
+        if(!*bounce)
+            return EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+        
+        size_t n = (size > FAT32_SECTOR_SIZE - skip) ? FAT32_SECTOR_SIZE - skip : size;
+        err = read(disk, lba, 1U, *bounce);
+
+        if(!err && wr)
+        {
+            memcpy(&(*bounce)[skip], buf, n);
+            err = write(disk, lba, 1U, *bounce);
+        }
+        else if(!err)
+            memcpy(buf, &(*bounce)[skip], n);
+        
+        lba++;
+        buf += n;
+        size -= n;
+        skip = 0;
+    }
+
+    return err;
 }
 
-static void fat_overwrite_dir_entry(uint8_t disk, uint8_t part, uint32_t dir_part_cluster, uint32_t dir_entry_index,
-                                char *filename, size_t filesize, uint8_t attrib)
+/* reads or writes size bytes at h->offset, as far as the clusters of the file go */
+static err_t fat_handle_io(fs_handle_t *h, uint8_t *buf, size_t size, bool_t wr)
 {
-    uint32_t cluster_size = fat_get_cluster_size(disk, part);
-    uint32_t sectclust = cluster_size / FAT32_SECTOR_SIZE;
+    uint32_t cluster_size = fat_get_cluster_size(h->disk, h->part);
+    uint32_t offset = h->offset;
+    uint8_t *bounce = NULL;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    while(size && !err)
+    {
+        if((err = fat_handle_seek(h, offset)))
+            break;
 
-    void *b = evalloc(cluster_size, PID_DRIVER);
-    uint32_t lba = fat_cluster_lba(disk, part, dir_part_cluster);
+        // take the clusters that follow the cursor on disk along
+        uint32_t first = h->cursor_cluster, n = 1;
+        uint32_t in = offset - h->cursor_offset;
+
+        while(in + size > n * cluster_size && fat_read_fat(h->disk, h->part, first + n - 1) == first + n)
+            n++;
+        
+        size_t chunk = (size > n * cluster_size - in) ? n * cluster_size - in : size;
+        uint32_t lba = fat_cluster_lba(h->disk, h->part, first) + in / FAT32_SECTOR_SIZE;
 
-    read(disk, lba, sectclust, (uint8_t *) b);
+        err = fat_sectors_io(h->disk, lba, in % FAT32_SECTOR_SIZE, buf, chunk, wr, &bounce);
 
-    FAT32_DIR *dir_part = b;
+        // the cursor stays at the last cluster of the run
+        h->cursor_cluster = first + n - 1;
+        h->cursor_offset += (n - 1) * cluster_size;
 
-    dir_part[dir_entry_index].fSize = filesize;
-    dir_part[dir_entry_index].attrib = attrib;
+        buf += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
 
-    if(filename)
-        memcpy(&dir_part[dir_entry_index].name[0], filename, TOTAL_FILENAME_LEN);
+    if(bounce)
+        kfree(bounce);
 
-    write(disk, lba, sectclust, (uint8_t *) b);
-    vfree(b);
+    return err;
 }
 
-static uint32_t fat_write_current_clusters(uint8_t disk, uint8_t part, uint32_t cluster, file_t *buffer, size_t *fsize, uint32_t *n_clusters_written)
+/* makes the chain of the handle's file long enough for new_size bytes, 
+   new clusters are taken from behind the last cluster if they are free */
+static err_t fat_handle_grow(fs_handle_t *h, uint32_t new_size)
 {
-    uint32_t cluster_size = fat_get_cluster_size(disk, part);
-    uint32_t sectclust = cluster_size / FAT32_SECTOR_SIZE;
+    fs_info_t *info = fat_get_info(h->disk, h->part);
+    uint32_t cluster_size = fat_get_cluster_size(h->disk, h->part);
 
-    uint8_t *temp_buffer = evalloc(cluster_size, PID_DRIVER);
-    *n_clusters_written = 0;
+    if(!info)
+        return EXIT_CODE_GLOBAL_GENERAL_FAIL;
 
-    // following two variables/pointers are necessary for fat_read_fat()
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
+    // a free map makes growing in place possible
+    if(!info->free_map)
+        fat_map_build(info);
 
-    uint32_t i = 0;
-    size_t filesize = *fsize;
+    uint32_t need = (new_size + cluster_size - 1) / cluster_size;
+    uint32_t have = 0, last = MAX;
 
-    while(filesize)
+    // files without data may not have a cluster
+    if(h->start >= FAT_CLUSTER_TABLE_LAST_RESERVED)
     {
-        uint32_t size = (filesize >= cluster_size) ? cluster_size : filesize;
+        have = (h->size) ? (h->size + cluster_size - 1) / cluster_size : 1;
+
+        err_t err = fat_handle_seek(h, (have - 1) * cluster_size);
 
-        memcpy(temp_buffer, (void *) ((uint32_t)*(&buffer) + i), size);
-        memset(&temp_buffer[size], (sectclust * FAT32_SECTOR_SIZE) - size, 0);
+        if(err)
+            return err;
+        
+        last = h->cursor_cluster;
 
-        uint32_t lba = fat_cluster_lba(disk, part, cluster);
+        // the chain may already be longer than the file
+        uint32_t next;
+        while(have < need && (next = fat_read_fat(h->disk, h->part, last)) >= FAT_CLUSTER_TABLE_LAST_RESERVED && next < FAT_CORRUPT_CLUSTER)
+            { last = next; have++; }
+    }
 
-        write(disk, lba, sectclust,  temp_buffer);
-        *n_clusters_written = *n_clusters_written + 1;
+    while(have < need)
+    {
+        uint32_t left = need - have;
+        uint32_t run = (last == MAX) ? MAX : last + 1;
+        uint32_t run_len = (last == MAX) ? 0 : fat_map_free_after(info, last, left);
 
-        cluster = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer);
+        if(!run_len)
+            run = fat_find_free_run(h->disk, h->part, left, &run_len);
+        
+        if(run == MAX)
+            return EXIT_CODE_FS_NO_SPACE;
+        
+        fat_write_chain(h->disk, h->part, run, run_len, FAT_LAST_CLUSTER);
 
-        i += size;
-        *fsize = (filesize -= size);
+        if(last == MAX)
+            { h->start = h->cursor_cluster = run; h->cursor_offset = 0; }
+        else
+            fat_write_cluster_to_table(h->disk, h->part, last, run);
 
-        if(cluster >= FAT_CORRUPT_CLUSTER)
-            break;        
+        last = run + run_len - 1;
+        have += run_len;
     }
 
-    kfree(fat_table_buffer);
-    vfree(temp_buffer);
-
-    return cluster;
+    return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
-static void fat_remove_clusters(uint8_t disk, uint8_t part, uint32_t from_cluster, bool_t terminate_list)
+/* shortens the chain of a file to the clusters size bytes take, a file of 0 bytes is left without a chain */
+static err_t fat_handle_trim(fs_handle_t *h, uint32_t size)
 {
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
+    uint32_t cluster_size = fat_get_cluster_size(h->disk, h->part);
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
 
-    uint32_t next_cluster = fat_read_fat(disk, part, from_cluster, &last_fat_sector, fat_table_buffer);
+    if(h->start < FAT_CLUSTER_TABLE_LAST_RESERVED)
+        return err;
 
-    if(terminate_list)
-        fat_write_cluster_to_table(disk, part, from_cluster, FAT_LAST_CLUSTER);
+    if(!size)
+    {
+        fat_remove_clusters(h->disk, h->part, h->start, FALSE);
+        h->start = 0;
+    }
     else
-        fat_write_cluster_to_table(disk, part, from_cluster, FAT_EMPTY_CLUSTER);
-
-    uint32_t cluster = next_cluster;
-
-    while(next_cluster < FAT_CORRUPT_CLUSTER)
     {
-        next_cluster = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer);
-        
-        fat_write_cluster_to_table(disk, part, cluster, FAT_EMPTY_CLUSTER);
-        cluster = next_cluster;
+        uint32_t keep = (size + cluster_size - 1) / cluster_size;
+        err = fat_handle_seek(h, (keep - 1) * cluster_size);
+
+        if(!err && fat_read_fat(h->disk, h->part, h->cursor_cluster) < FAT_CORRUPT_CLUSTER)
+            fat_remove_clusters(h->disk, h->part, h->cursor_cluster, TRUE);
     }
 
-    kfree(fat_table_buffer);
+    // the cursor may have been on one of the clusters that are gone now
+    h->cursor_cluster = h->start;
+    h->cursor_offset = 0;
+
+    return err;
 }
 
-static err_t fat_write_existing(uint8_t disk, uint8_t part, uint32_t dir_part_cluster, FAT32_DIR *entry, uint32_t dir_entry_index, file_t *buffer, 
-                                size_t filesize, uint8_t attrib)
+/* gives back the clusters a failed write added to the chain; the directory entry still has the old size and start.
+   An empty file that has a cluster (older versions gave empty files one) keeps it, its entry points there */
+static void fat_handle_undo_grow(fs_handle_t *h, uint32_t old_size, uint32_t old_start)
 {
-    fat_overwrite_dir_entry(disk, part, dir_part_cluster, dir_entry_index, NULL, filesize, attrib);
-    
-    uint32_t n_clusters_written = 0;
-    uint32_t cluster = (uint32_t) ((entry->clHi << 16u) | entry->clLo);
-    uint32_t last_cluster_written = fat_write_current_clusters(disk, part, cluster, buffer, &filesize, &n_clusters_written);
-    
-    // Check if the same amount of clusters were written as currently in use --> file size as big or negligable increase in size
-    if(last_cluster_written >= FAT_CORRUPT_CLUSTER && !filesize)
-        return EXIT_CODE_GLOBAL_SUCCESS;
+    fat_handle_trim(h, (old_size || !old_start) ? old_size : 1U);
+}
+
+static err_t fat_write_existing(uint8_t disk, uint8_t part, uint32_t dir_cluster, uint32_t dir_part_cluster, FAT32_DIR *entry, uint32_t dir_entry_index, 
+                                file_t *buffer, size_t filesize, uint8_t attrib)
+{
+    fs_handle_t h = {
+        .disk = disk,
+        .part = part,
+        .attrib = attrib,
+        .size = entry->fSize,
+        .start = (uint32_t) ((entry->clHi << 16u) | entry->clLo),
+        .offset = 0,
+        .dir_cluster = dir_cluster,
+        .dir_part_cluster = dir_part_cluster,
+        .dir_index = dir_entry_index,
+    };
+
+    h.cursor_cluster = h.start;
+    h.cursor_offset = 0;
+
+    // bigger file: extend the chain first, the whole file is then written in runs
+    // straight from the buffer
+    err_t err = (filesize > h.size) ? fat_handle_grow(&h, filesize) : EXIT_CODE_GLOBAL_SUCCESS;
+
+    if(!err)
+        err = fat_handle_io(&h, (uint8_t *) buffer, filesize, TRUE);
     
-    // Less clusters written --> smaller file
-    if(last_cluster_written != FAT_CORRUPT_CLUSTER && !filesize)
+    if(err)
     {
-        fat_remove_clusters(disk, part, last_cluster_written, TRUE);
-        return EXIT_CODE_GLOBAL_SUCCESS;
+        if(filesize > h.size)
+            fat_handle_undo_grow(&h, entry->fSize, (uint32_t) ((entry->clHi << 16u) | entry->clLo));
+        
+        return err;
     }
-    
-    // Bigger file
-    uint32_t result;
 
-    // following two variables/pointers are necessary for fat_read_fat()
-    uint32_t last_fat_sector = 0;
-    void *fat_table_buffer = kmalloc(FAT32_SECTOR_SIZE);
-
-    while((result = fat_read_fat(disk, part, cluster, &last_fat_sector, fat_table_buffer)) < FAT_CORRUPT_CLUSTER)
-        cluster = result;
-    
-    kfree(fat_table_buffer);
-    
-    // update fat with new
-    uint32_t new_cluster = 0;
-    fat_find_empty_cluster(disk, part, &new_cluster);
+    // an empty file has no chain at all
+    err = fat_update_dir_entry(disk, part, dir_part_cluster, dir_entry_index, filesize, attrib, (filesize) ? h.start : 0, NULL);
 
-    fat_write_cluster_to_table(disk, part, cluster, new_cluster);
-    fat_write_new_clusters(disk, part, cluster, buffer, filesize);
+    // smaller file: the chain ends at the last cluster still in use. It is only cut once the entry
+    // no longer needs the clusters, a failed entry write leaves them to the old entry
+    if(!err && (filesize < h.size || !filesize))
+        err = fat_handle_trim(&h, filesize);
 
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    return err;
 }
 
 static err_t fat_check_file_exists(uint8_t disk, uint8_t part, const char *path, char *filename, FAT32_DIR *dir_entry, uint32_t *dir_cluster, uint32_t *dir_part_cluster, uint32_t *dir_index)
@@ -947,12 +2105,23 @@ err_t fat_write(const char *path, file_t *buffer, size_t file_size, uint8_t attr
     if((err && err != EXIT_CODE_FS_FILE_NOT_FOUND) || dir_cluster == MAX)
         return err;
 
+    // batch the data cluster, FAT and directory writes of this file
+    ioqueue_plug(disk);
+
     if(dir_index == MAX)
         err = fat_write_new(disk, part, &filename[0], dir_cluster, buffer, file_size, attrib);
     else
-       err = fat_write_existing(disk, part, dir_part_cluster, &dir_entry, dir_index, buffer, file_size, attrib);
+        err = fat_write_existing(disk, part, dir_cluster, dir_part_cluster, &dir_entry, dir_index, buffer, file_size, attrib);
 
-    return err;
+    // the entry was created or its size changed
+    dcache_invalidate(disk, part, dir_cluster, &filename[0]);
+
+    err_t ferr = fat_cache_flush(disk, part);
+    err_t qerr = ioqueue_unplug(disk);
+
+    err = (err) ? err : ferr;
+
+    return (err) ? err : qerr;
 }
 
 err_t fat_rename(char *path, char *new_name)
@@ -991,16 +2160,54 @@ err_t fat_rename(char *path, char *new_name)
         return EXIT_CODE_FS_FILE_EXISTS; 
     }
     
+    char old_name[TOTAL_FILENAME_LEN + 1];
+    memcpy(&old_name[0], &filename[0], sizeof(old_name));
+
+    dcache_invalidate(disk, part, dir_cluster, &old_name[0]);
     fat_get_last_from_path(&filename[0], new_path);
+    dcache_invalidate(disk, part, dir_cluster, &filename[0]);
     
     kfree(new_path);
     
     // write the new file name
-    fat_overwrite_dir_entry(disk, part, dir_cluster, dir_index, &filename[0], dir_entry.fSize, dir_entry.attrib);
+    err = fat_overwrite_dir_entry(disk, part, dir_part_cluster, dir_index, &filename[0], dir_entry.fSize, dir_entry.attrib);
+
+    if(err)
+        return err;
+    
+    fat_dir_index_update(disk, part, dir_cluster, &old_name[0], &filename[0], dir_part_cluster, dir_index);
 
     return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
+/* TRUE if the directory that starts at cluster holds nothing but "." and ".." */
+static bool_t fat_dir_is_empty(uint8_t disk, uint8_t part, uint32_t cluster, err_t *err)
+{
+    fs_handle_t h;
+    memset(&h, sizeof(fs_handle_t), 0);
+
+    h.disk = disk;
+    h.part = part;
+    h.flags = FS_DIR_NAMES_ONLY;
+    h.start = h.cursor_cluster = cluster;
+
+    // "." and ".." come first, a third entry means there is something in it
+    fs_dir_contents_t *c = kmalloc(3 * sizeof(fs_dir_contents_t));
+
+    if(!c)
+        { *err = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return FALSE; }
+
+    size_t n = fat_readdir(&h, c, 3, err);
+    bool_t empty = TRUE;
+
+    for(size_t i = 0; i < n; ++i)
+        if(strcmp(c[i].name, ".") && strcmp(c[i].name, ".."))
+            empty = FALSE;
+
+    kfree(c);
+    return empty;
+}
+
 err_t fat_delete(char *path)
 {
     uint8_t disk, part;
@@ -1018,15 +2225,51 @@ err_t fat_delete(char *path)
     if(dir_cluster < FAT_CLUSTER_TABLE_LAST_RESERVED)
         return EXIT_CODE_FS_FILE_NOT_FOUND;
 
-    filename[0] = (char) (DIR_UNUSED_ENTRY);
-    filename[1] = 0;
+    // only the clusters of the directory itself would be freed, not those of what is in it
+    if(dir_entry.attrib & FAT_DIR_ATTRIB_DIRECTORY)
+    {
+        err = EXIT_CODE_GLOBAL_SUCCESS;
+        bool_t empty = fat_dir_is_empty(disk, part, (uint32_t) ((dir_entry.clHi << 16u) | dir_entry.clLo), &err);
+
+        if(err)
+            return err;
+        if(!empty)
+            return EXIT_CODE_FS_DIR_NOT_EMPTY;
+    }
+
+    // the clusters of a directory can be reused, so what is cached about its contents has to go as well
+    if(dir_entry.attrib & FAT_DIR_ATTRIB_DIRECTORY)
+    {
+        dcache_invalidate_part(disk, part);
+        fat_dir_index_drop(disk, part, (uint32_t) ((dir_entry.clHi << 16u) | dir_entry.clLo));
+    }
+    else
+        dcache_invalidate(disk, part, dir_cluster, &filename[0]);
+
+    // the index still needs the name, the entry gets a copy of it marked unused
+    char unused[TOTAL_FILENAME_LEN + 1];
+    memcpy(&unused[0], &filename[0], sizeof(unused));
 
-    fat_overwrite_dir_entry(disk, part, dir_part_cluster, dir_index, &filename[0], 0, 0);
+    unused[0] = (char) (DIR_UNUSED_ENTRY);
+    unused[1] = 0;
 
+    ioqueue_plug(disk);
+
+    err = fat_overwrite_dir_entry(disk, part, dir_part_cluster, dir_index, &unused[0], 0, 0);
+
+    // the name and the clusters are only let go of once nothing points to them anymore
     uint32_t cluster = (uint32_t) ((dir_entry.clHi << 16u) | dir_entry.clLo);
-    fat_remove_clusters(disk, part, cluster, FALSE);
 
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    if(!err)
+    {
+        fat_dir_index_update(disk, part, dir_cluster, &filename[0], NULL, 0, 0);
+        fat_remove_clusters(disk, part, cluster, FALSE);
+    }
+
+    err = (err) ? err : fat_cache_flush(disk, part);
+    err_t qerr = ioqueue_unplug(disk);
+
+    return (err) ? err : qerr;
 }
 
 static void fat_create_dir(uint8_t disk, uint8_t part, uint32_t cluster_parent, char *path, err_t *err)
@@ -1047,8 +2290,16 @@ static void fat_create_dir(uint8_t disk, uint8_t part, uint32_t cluster_parent,
     uint32_t cl = 0;
     fat_find_empty_cluster(disk, part, &cl);
 
+    if(cl == MAX)
+    {
+        *err = EXIT_CODE_FS_NO_SPACE;
+        kfree(actual_path);
+        vfree(dir);
+        return;
+    }
+
     dir[0].clLo = (uint16_t) (cl & 0xFFFF);
-    dir[0].clHi = (uint16_t) ((cl << 16) & 0xFFFF);
+    dir[0].clHi = (uint16_t) (cl >> 16);
     dir[0].attrib = FAT_DIR_ATTRIB_DIRECTORY;
 
     dir[1].name[0] = '.';
@@ -1056,7 +2307,7 @@ static void fat_create_dir(uint8_t disk, uint8_t part, uint32_t cluster_parent,
     fat_filename_fatcompat(&dir[1].name[0]);
 
     dir[1].clLo = (uint16_t) (cluster_parent & 0xFFFF);
-    dir[1].clHi = (uint16_t) ((cluster_parent << 16) & 0xFFFF);
+    dir[1].clHi = (uint16_t) (cluster_parent >> 16);
     dir[1].attrib = FAT_DIR_ATTRIB_DIRECTORY;
 
     *err = fat_write(actual_path, dir, FAT32_SECTOR_SIZE, FAT_DIR_ATTRIB_DIRECTORY);
@@ -1078,6 +2329,8 @@ err_t fat_mkdir(char *path)
     uint8_t disk, part;
     fat_get_disk_from_path(path, &disk, &part);
 
+    ioqueue_plug(disk);
+
     while(str_get_part(&filename[0], path, "/", &pindex))
     {
         old_cluster = cluster;
@@ -1102,11 +2355,20 @@ err_t fat_mkdir(char *path)
         fat_create_dir(disk, part, old_cluster, checking_path, &err);
 
         if(err)
-            { vfree(checking_path); return err; }
+            { fat_cache_flush(disk, part); ioqueue_unplug(disk); vfree(checking_path); return err; }
     }
 
     vfree(checking_path);
 
+    // the clusters of the new directories
+    err_t ferr = fat_cache_flush(disk, part);
+    err_t qerr = ioqueue_unplug(disk);
+
+    qerr = (ferr) ? ferr : qerr;
+
+    if(qerr)
+        return qerr;
+
     // if the cluster was never MAX, the file was found
     // meaning it already exists.
     if(cluster != MAX)
@@ -1187,18 +2449,19 @@ fs_file_info_t *fat_get_file_info(const char *path, err_t *err)
 
 static void fat_convert_filename_to_readable(const char *original, char *out)
 {
-    uint32_t i = find_in_str(original, " ");
-
-    i = (i < FAT_MAX_FILENAME_LEN) ? i : FILE_NAME_LEN;
+    uint32_t i = 0;
 
-    memcpy(out, original, i);
+    // both the name and the extension are padded with spaces
+    for(uint32_t j = 0; j < FILE_NAME_LEN && original[j] != ' '; ++j)
+        out[i++] = original[j];
 
-    if(original[FAT_MAX_FILENAME_LEN - FILE_EXT_LEN] != ' ')
+    if(original[FILE_NAME_LEN] != ' ')
         out[i++] = '.';
     
-    memcpy(&out[i], &original[FAT_MAX_FILENAME_LEN - FILE_EXT_LEN], FILE_EXT_LEN);
+    for(uint32_t j = FILE_NAME_LEN; j < TOTAL_FILENAME_LEN && original[j] != ' '; ++j)
+        out[i++] = original[j];
 
-    out[i + FILE_EXT_LEN] = '\0';
+    out[i] = '\0';
 }
 
 static uint8_t fat_file_is_directory(const char *path)
@@ -1262,3 +2525,197 @@ fs_dir_contents_t *fat_get_dir_contents(const char *path, size_t *osize, err_t *
 
     return c;
 }
+
+err_t fat_open(const char *path, fs_handle_t *h)
+{
+    uint8_t disk, part;
+    fat_get_disk_from_path(path, &disk, &part);
+
+    if(!fat_get_info(disk, part))
+        return EXIT_CODE_FS_FILE_NOT_FOUND;
+
+    char filename[TOTAL_FILENAME_LEN + 1];
+    FAT32_DIR dir_entry;
+    uint32_t dir_cluster, dir_part_cluster, dir_index = MAX;
+
+    // read-only files can be opened, they just can't be written to
+    err_t err = fat_check_file_exists(disk, part, path, &filename[0], &dir_entry, &dir_cluster, &dir_part_cluster, &dir_index);
+
+    if(err && err != EXIT_CODE_FS_FILE_READ_ONLY)
+        return err;
+    if(dir_index == MAX)
+        return EXIT_CODE_FS_FILE_NOT_FOUND;
+    if(dir_entry.attrib & FAT_DIR_ATTRIB_DIRECTORY)
+        return EXIT_CODE_GLOBAL_INVALID;
+    
+    h->disk = disk;
+    h->part = part;
+    h->attrib = dir_entry.attrib;
+    h->size = dir_entry.fSize;
+    h->start = (uint32_t) ((dir_entry.clHi << 16u) | dir_entry.clLo);
+    h->offset = 0;
+
+    h->dir_cluster = dir_cluster;
+    h->dir_part_cluster = dir_part_cluster;
+    h->dir_index = dir_index;
+
+    h->cursor_cluster = h->start;
+    h->cursor_offset = 0;
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/* returns the number of bytes read, reads stop at the end of the file */
+size_t fat_read_at(fs_handle_t *h, void *buffer, size_t size, err_t *err)
+{
+    // another handle may have appended to the file
+    if((*err = fat_handle_refresh(h)))
+        return 0;
+
+    if(h->offset >= h->size)
+        return 0;
+    
+    size = (size > h->size - h->offset) ? h->size - h->offset : size;
+    *err = fat_handle_io(h, (uint8_t *) buffer, size, FALSE);
+
+    return (*err) ? 0 : size;
+}
+
+/* returns the number of bytes written. Writes may go past the end of the file (appends),
+   but may not start beyond it */
+size_t fat_write_at(fs_handle_t *h, const void *buffer, size_t size, err_t *err)
+{
+    // the size and chain are taken from the entry, not from when the handle was opened
+    if((*err = fat_handle_refresh(h)))
+        return 0;
+
+    if(h->attrib & FAT_DIR_ATTRIB_READ_ONLY)
+        { *err = EXIT_CODE_FS_FILE_READ_ONLY; return 0; }
+    if(h->offset > h->size || size > MAX - h->offset)
+        { *err = EXIT_CODE_GLOBAL_OUT_OF_RANGE; return 0; }
+
+    uint32_t end = h->offset + size, start = h->start;
+
+    ioqueue_plug(h->disk);
+
+    if(end > h->size)
+        *err = fat_handle_grow(h, end);
+
+    if(!*err)
+        *err = fat_handle_io(h, (uint8_t *) buffer, size, TRUE);
+
+    // only the size changed, one sector of the directory is rewritten for it
+    if(!*err && end > h->size)
+    {
+        char name[TOTAL_FILENAME_LEN + 1];
+        *err = fat_update_dir_entry(h->disk, h->part, h->dir_part_cluster, h->dir_index, end, h->attrib, h->start, &name[0]);
+
+        h->size = (*err) ? h->size : end;
+
+        if(!*err)
+            dcache_invalidate(h->disk, h->part, h->dir_cluster, &name[0]);
+    }
+
+    // a failed append leaves the file as it was, the clusters added for it are given back
+    if(*err && end > h->size)
+        fat_handle_undo_grow(h, h->size, start);
+
+    err_t ferr = fat_cache_flush(h->disk, h->part);
+    err_t qerr = ioqueue_unplug(h->disk);
+
+    *err = (*err) ? *err : ferr;
+    *err = (*err) ? *err : qerr;
+
+    return (*err) ? 0 : size;
+}
+
+err_t fat_opendir(const char *path, fs_handle_t *h)
+{
+    uint8_t disk, part;
+    fat_get_disk_from_path(path, &disk, &part);
+
+    if(!fat_get_info(disk, part))
+        return EXIT_CODE_FS_FILE_NOT_FOUND;
+    
+    size_t size;
+    uint8_t attrib;
+    uint32_t cluster = fat_traverse(path, &size, &attrib);
+
+    if(cluster == MAX)
+        return EXIT_CODE_FS_FILE_NOT_FOUND;
+    if(!(attrib & FAT_DIR_ATTRIB_DIRECTORY))
+        return EXIT_CODE_GLOBAL_INVALID;
+    
+    memset(h, sizeof(fs_handle_t), 0);
+
+    h->disk = disk;
+    h->part = part;
+    h->attrib = attrib;
+    h->start = h->cursor_cluster = cluster;
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/* returns the number of entries read into out (at most max), one sector of the directory is read at a time */
+size_t fat_readdir(fs_handle_t *h, fs_dir_contents_t *out, size_t max, err_t *err)
+{
+    uint32_t cluster_size = fat_get_cluster_size(h->disk, h->part);
+    FAT32_DIR *sector = NULL;
+    uint32_t sector_lba = MAX;
+    size_t n = 0;
+
+    *err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    while(n < max)
+    {
+        // on to the next cluster of the directory, if there is one
+        if(h->offset - h->cursor_offset >= cluster_size)
+        {
+            uint32_t next = fat_read_fat(h->disk, h->part, h->cursor_cluster);
+
+            if(next < FAT_CLUSTER_TABLE_LAST_RESERVED || next >= FAT_CORRUPT_CLUSTER)
+                break;
+            
+            h->cursor_cluster = next;
+            h->cursor_offset += cluster_size;
+        }
+
+        uint32_t in = h->offset - h->cursor_offset;
+        uint32_t lba = fat_cluster_lba(h->disk, h->part, h->cursor_cluster) + in / FAT32_SECTOR_SIZE;
+
+        if(lba != sector_lba)
+        {
+            sector = (sector) ? sector : kmalloc(FAT32_SECTOR_SIZE);
+
+            if(!sector)
+                { *err = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; break; }
+            if((*err = read(h->disk, lba, 1U, (uint8_t *) sector)))
+                break;
+            
+            sector_lba = lba;
+        }
+
+        FAT32_DIR *entry = &sector[(in % FAT32_SECTOR_SIZE) / sizeof(FAT32_DIR)];
+
+        // the end of the directory, the offset stays here
+        if(entry->name[0] == 0)
+            break;
+        
+        h->offset += sizeof(FAT32_DIR);
+
+        if(entry->name[0] == (char) DIR_UNUSED_ENTRY || entry->attrib == FAT_DIR_ATTRIB_LFN || 
+            entry->attrib == FAT_DIR_ATTRIB_VOLUME_ID)
+                continue;
+        
+        fat_convert_filename_to_readable(entry->name, out[n].name);
+
+        out[n].attrib = (h->flags & FS_DIR_NAMES_ONLY) ? 0 : entry->attrib;
+        out[n].file_size = (h->flags & FS_DIR_NAMES_ONLY) ? 0 : entry->fSize;
+        n++;
+    }
+
+    if(sector)
+        kfree(sector);
+
+    return n;
+}
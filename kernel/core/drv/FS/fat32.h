@@ -36,5 +36,10 @@ err_t fat_delete(char *path);
 err_t fat_mkdir(char *path);
 fs_file_info_t *fat_get_file_info(const char *path, err_t *err);
 fs_dir_contents_t *fat_get_dir_contents(const char *path, size_t *osize, err_t *oerr);
+err_t fat_open(const char *path, fs_handle_t *h);
+size_t fat_read_at(fs_handle_t *h, void *buffer, size_t size, err_t *err);
+size_t fat_write_at(fs_handle_t *h, const void *buffer, size_t size, err_t *err);
+err_t fat_opendir(const char *path, fs_handle_t *h);
+size_t fat_readdir(fs_handle_t *h, fs_dir_contents_t *out, size_t max, err_t *err);
 
 #endif
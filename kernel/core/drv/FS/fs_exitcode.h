@@ -29,5 +29,7 @@ SOFTWARE.
 #define EXIT_CODE_FS_FILE_READ_ONLY        0x12
 #define EXIT_CODE_FS_FILE_EXISTS           0x13
 #define EXIT_CODE_FS_NO_SPACE              0x14
+#define EXIT_CODE_FS_FILE_IN_USE           0x15
+#define EXIT_CODE_FS_DIR_NOT_EMPTY         0x16
 
 #endif
\ No newline at end of file
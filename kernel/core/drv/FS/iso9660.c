@@ -46,6 +46,7 @@ SOFTWARE.
 
 #include "../../dsk/diskio.h"
 #include "../../dsk/diskdefines.h"
+#include "../../dsk/dcache.h"
 
 #include "../../util/util.h"
 
@@ -162,6 +163,22 @@ void iso_handler(uint32_t * drv)
 			drv[2] = (uint32_t) iso_get_dir_contents((char *) drv[1], drv);
 		break;
 
+		case FS_COMMAND_OPEN:
+			iso_open((const char *) drv[1], (fs_handle_t *) drv[2]);
+		break;
+
+		case FS_COMMAND_READ_AT:
+			drv[3] = iso_read_at((fs_handle_t *) drv[1], (uint8_t *) drv[2], (size_t) drv[3]);
+		break;
+
+		case FS_COMMAND_OPENDIR:
+			iso_opendir((const char *) drv[1], (fs_handle_t *) drv[2]);
+		break;
+
+		case FS_COMMAND_READDIR:
+			drv[3] = iso_readdir((fs_handle_t *) drv[1], (fs_dir_contents_t *) drv[2], (size_t) drv[3]);
+		break;
+
 		default:
             gerror = EXIT_CODE_GLOBAL_UNSUPPORTED;
         break;
@@ -227,6 +244,7 @@ void iso_init(uint8_t drive)
 
 	// save all interesting data
 	iso_save_pvd_data(buffer, info);
+	dcache_invalidate_part(drive, 0);
 
 	if(n_atapi_devs < IDE_DRIVER_MAX_DRIVES)
 		atapi_devices |= (1u << drive);
@@ -374,7 +392,7 @@ static uint32_t iso_search_dir_bfr(uint32_t *bfr, size_t bfr_size, const char *f
 
 static uint32_t iso_search_dir(uint8_t drive, uint32_t dir_lba, const char *filename, size_t *fsize, direntry_t *out_entry)
 {
-	uint32_t flba; // file lba
+	uint32_t flba = 0; // file lba
 	uint32_t *bfr;
 
 	size_t size = iso_get_dir_size(drive, dir_lba);
@@ -385,21 +403,24 @@ static uint32_t iso_search_dir(uint8_t drive, uint32_t dir_lba, const char *file
 	size_t bfr_size = iso_alloc_dir_buffer(size, &bfr);
 
 	if(!bfr || !bfr_size)
-	{gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return 0;}
+	{gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return MAX;}
 	
 	uint32_t nlba = size / ISO_SECTOR_SIZE + ((size % ISO_SECTOR_SIZE) != 0);
 	const uint32_t to_read = (bfr_size / ISO_SECTOR_SIZE);
 
+	// the whole directory at once if the buffer is large enough, otherwise a sector at a time
 	while(nlba)
 	{
-		read(drive, dir_lba, to_read, (uint8_t *) bfr);
-		flba = iso_search_dir_bfr(bfr, bfr_size, filename, fsize, out_entry);
+		uint32_t n = (nlba < to_read) ? nlba : to_read;
+
+		read(drive, dir_lba, n, (uint8_t *) bfr);
+		flba = iso_search_dir_bfr(bfr, n * ISO_SECTOR_SIZE, filename, fsize, out_entry);
 
-		if(flba || !(nlba--))
+		if(flba)
 			break;
 
-		iso_free_bfr(bfr);
-		dir_lba++;
+		nlba = nlba - n;
+		dir_lba = dir_lba + n;
 	}
 
 	iso_free_bfr(bfr);
@@ -440,13 +461,33 @@ static uint32_t iso_remove_parent_dir_notation_from_path(char *path)
 	return 1u;
 }
 
+// looks a name up in a directory, lookups are remembered in the dentry cache
+static uint32_t iso_lookup(uint8_t drive, uint32_t dir_lba, const char *name, direntry_t *entry)
+{
+	uint8_t cached = dcache_lookup(drive, 0, dir_lba, name, entry);
+
+	if(cached == DCACHE_HIT)
+		return entry->lba_extend;
+	else if(cached == DCACHE_NEGATIVE)
+		return 0;
+
+	size_t fsize;
+	uint32_t flba = iso_search_dir(drive, dir_lba, name, &fsize, entry);
+
+	// the directory could not be read, that says nothing about the name
+	if(flba == MAX)
+		return MAX;
+
+	dcache_insert(drive, 0, dir_lba, name, (flba) ? entry : NULL, sizeof(direntry_t));
+	return flba;
+}
+
 // use this function to convert a path into the lba of the file
 static uint32_t iso_traverse(const char *path, size_t *fsize, direntry_t *entry)
 {
 	// convert drive identifier (e.g. 'CD0') to something useful
 	uint8_t drive = (uint8_t) ((drive_convert_drive_id((const char *) path)) >> DISKIO_DISK_NUMBER);
 
-	// save file name
 	char * p = create_backup_str(path);
 	to_uc(p, strlen(p));
 
@@ -454,22 +495,42 @@ static uint32_t iso_traverse(const char *path, size_t *fsize, direntry_t *entry)
 	iso_remove_current_dir_symbols_from_path(p);
 
 	char *filename = iso_allocate_bfr(ISO_MAX_FILENAME_LEN + 1);
-	reverse_path(p, filename);
-
 	cd_info_t *info = iso_get_cd_info_entry(drive);
-	uint32_t dir_lba = (p[0] == '\0') ? (info->rootdir_lba) : iso_path_to_dir_lba(drive, p);
+
+	direntry_t e;
+	entry = (entry) ? entry : &e;
+	*fsize = 0;
+
+	uint32_t start = find_in_str(p, "/");
+	start = (start == MAX) ? strlen(p) : start + 1;
+
+	// walk the path from the root directory, one directory at a time
+	uint32_t flba = info->rootdir_lba, part = 0, n = 0;
+
+	while(flba && flba != MAX && str_get_part(filename, &p[start], "/", &part) && filename[0] != '\0')
+	{
+		// everything but the last part of the path has to be a directory
+		if(n++ && !(entry->file_flags & FF_DIRECTORY))
+			{ flba = 0; break; }
+
+		flba = iso_lookup(drive, flba, filename, entry);
+	}
+
+	// the root directory is described by its own '.' entry (which has an empty name)
+	if(!n)
+		flba = iso_lookup(drive, flba, "", entry);
+
 	iso_free_bfr(p);
+	iso_free_bfr(filename);
 
-	if(dir_lba == MAX)
-		{ iso_free_bfr(filename); return MAX; }
+	if(!flba || flba == MAX)
+		return flba;
 
-	uint32_t flba = iso_search_dir(drive, dir_lba, (const char *) filename, fsize, entry);
+	*fsize = entry->size;
 
 	if((entry->file_flags & (FF_DIRECTORY)) == (FF_DIRECTORY))
 		*fsize = iso_get_dir_size(drive, flba);
 
-	iso_free_bfr(filename);
-
 	return flba;
 }
 
@@ -508,217 +569,6 @@ size_t iso_get_dir_size(uint8_t drive, uint32_t dir_lba)
 	return size;
 }
 
-static uint32_t iso_read_path_table_buffer(uint8_t *buffer, size_t buffer_size, const char *filename, uint16_t *entry, uint16_t *o_parent_entry)
-{
-	uint32_t read_bytes = 0;
-	uint16_t minimum_entry = *entry;
-	*(entry) = 0;
-	
-	size_t filename_len = strlen(filename);
-	
-	while(read_bytes < buffer_size)
-	{
-		pathtable_t *p = (pathtable_t *) &buffer[read_bytes];
-		uint16_t ident_len = (uint16_t) (p->ident_len);
-
-		if(!(p->ident_len) && !(p->parent))
-		 break;
-
-		const char *str = (const char *) &buffer[read_bytes + sizeof(pathtable_t)];
-
-		// compare string
-		if((*(entry) >= minimum_entry) && (filename_len == ident_len) && !strcmp_until(str, filename, ident_len))
-		{
-			*o_parent_entry = (uint16_t) ((p->parent) - 1);
-			return p->lba;
-		}
-		
-		// add amount of bytes read: base entry size, length of the identifier and padding byte 
-		read_bytes = (uint32_t) (read_bytes + sizeof(pathtable_t) + ident_len + (ident_len % 2 == 1));
-
-		*entry = (uint16_t) (*(entry) + 1);
-	}
-
-	return MAX;
-}
-
-static uint32_t iso_find_in_path_table(uint8_t drive, const char *filename, uint16_t *o_entry, uint16_t *o_parent_entry)
-{
-	void *buffer = iso_allocate_bfr(PAGE_SIZE);
-	
-	cd_info_t *info = iso_get_cd_info_entry(drive);
-	
-	size_t path_table_size = info->path_table_size;
-	uint32_t path_lba = info->path_table_lba;
-
-	uint16_t minimum_entry = *o_entry;
-	uint16_t entry = 0;
-
-	uint32_t dir_lba = 0;
-
-	while(path_table_size)
-	{
-		read(drive, path_lba, (PAGE_SIZE / ISO_SECTOR_SIZE), buffer);
-
-		size_t s = (path_table_size > PAGE_SIZE) ? PAGE_SIZE : path_table_size;
-
-		// set the minimum entry number of the next directory name in the path table
-		uint16_t e = ((uint16_t) (((int32_t)minimum_entry - (int32_t)entry) > 0)) ? (uint16_t) (minimum_entry - entry) : (uint16_t) 0;
-		
-		dir_lba = iso_read_path_table_buffer(buffer, s, filename, &e, o_parent_entry);
-		entry = (uint16_t) (entry + e);
-		
-		if(dir_lba != MAX)
-			break;
-
-		path_table_size = path_table_size - s;
-		path_lba = path_lba + (PAGE_SIZE / ISO_SECTOR_SIZE);
-	}
-
-	iso_free_bfr(buffer);
-	*o_entry = entry;
-	return dir_lba;
-}
-
-static bool_t iso_check_pathtable_parents(uint8_t drive, const char *parents_path, uint16_t parent_entry)
-{
-	char *parent_name = iso_allocate_bfr(ISO_MAX_FILENAME_LEN + 1),
-		 *next = iso_allocate_bfr(ISO_MAX_FILENAME_LEN + 1);
-	
-	uint16_t entry = parent_entry;
-		
-	if(!parent_name || !next)
-	{gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return false; }
-
-	uint32_t part = 0;
-	bool_t result = true;
-
-	while(result)
-	{
-		if(!str_get_part(parent_name, parents_path, "/", &part))
-			break;
-
-		if(parent_name[0] == '\0' && parent_entry == 0)
-			break;
-
-		uint16_t e = entry, parent = 0;
-		uint32_t lba = 0;
-
-		lba = iso_find_in_path_table(drive, parent_name, &e, &parent);
-
-		// check if the parent was found, and the
-		// entry is equal to the the parent's entry number
-		if((e != entry) || (lba == MAX))
-		{result = false; break;}
-
-		entry = parent;
-	}
-
-	iso_free_bfr(parent_name);
-	iso_free_bfr(next);
-
-	return result;
-}
-
-uint32_t iso_path_to_dir_lba(uint8_t drive, const char *path)
-{
-	char *filename = iso_allocate_bfr(ISO_MAX_FILENAME_LEN + 1);
-
-	ASSERT(filename);
-
-	if(!filename)
-	{gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return 0;}
-
-	uint32_t part = 0;
-	str_get_part(filename, path, "/", &part);
-
-	uint32_t start_parent_path = find_in_str(path, "/");
-	start_parent_path = (start_parent_path == MAX) ? strlen(path) : start_parent_path + 1;
-
-	uint16_t parent_entry = 0;
-	uint16_t entry = 0;
-	uint32_t lba = 0;
-	
-	while(1)
-	{
-		lba = iso_find_in_path_table(drive, filename, &entry, &parent_entry);
-
-		if(lba == MAX)
-			break;
-		
-		if(iso_check_pathtable_parents(drive, &path[start_parent_path], parent_entry))
-			break;
-
-		// add one to the entry (iso_find_in_path_table() returns the last entry number checked or the entry number of
-		// the correct directory)
-		entry = (uint16_t) (entry + 1);
-	}
-
-	iso_free_bfr(filename);
-
-	return lba;
-}
-
-// !! WARNING !!
-// Destroy's original string!
-void reverse_path(char *path, char *out_filename)
-{
-	ASSERT(out_filename);
-
-	char *backup = create_backup_str(path);
-	ASSERT(backup);
-
-	memcpy(backup, path, strlen(path));
-	
-	// remove disk identifier from backup
-	size_t s = find_in_str(path, "/");
-	remove_from_str(backup, s + 1);
-
-	uint32_t b_index = strlen(backup);
-
-	// the last file in the path is the filename
-	for(; b_index > 0; b_index--)
-		if(backup[b_index] == '/')
-			break;
-
-	// if b_index == 0 then there was no '/', meaning only a filename exists
-	// in the path	
-	b_index = (b_index) ? b_index + 1 : 0;
-	memcpy(out_filename, &backup[b_index], strlen(&backup[b_index]) + 1);
-
-	if(!b_index)
-	{
-		path[0] = '\0';
-		kfree(backup);
-		return;
-	}
-
-	backup[b_index - 1] = '\0';
-
-	// copy the rest of the path
-	uint32_t p_index = 0;
-	b_index = strlen(backup);
-	for(; b_index > 0; b_index--)
-	{
-		if(backup[b_index] != '/')
-			continue;
-
-		size_t size = strlen(&backup[b_index + 1]);
-		memcpy(&path[p_index], &backup[b_index + 1], size);
-		backup[b_index] = '\0';
-
-		p_index += size;
-		path[p_index] = '/';
-		p_index++;
-	}
-
-	s = strlen(&backup[b_index]);
-	memcpy(&path[p_index], &backup[b_index], s);
-	path[s + p_index] = '\0';
-
-	kfree(backup);
-}
-
 void iso_read(const char * path, uint32_t *drv)
 {
 	size_t fsize = 0;
@@ -735,7 +585,8 @@ void iso_read(const char * path, uint32_t *drv)
 	uint32_t nlba = (fsize / ISO_SECTOR_SIZE) + ((fsize % ISO_SECTOR_SIZE) != 0);
 	uint8_t drive = (uint8_t) (drive_convert_drive_id((const char *) path) >> DISKIO_DISK_NUMBER);
 
-	uint8_t *bfr = evalloc(fsize, PID_DRIVER);
+	// whole sectors are read
+	uint8_t *bfr = evalloc((nlba) ? nlba * ISO_SECTOR_SIZE : ISO_SECTOR_SIZE, PID_DRIVER);
 
 	if(!bfr)
 	{
@@ -745,10 +596,9 @@ void iso_read(const char * path, uint32_t *drv)
 		return; 
 	}
 
+	// an empty file is read as a buffer of size 0
 	if(nlba)
 		read(drive, flba, nlba, bfr);
-	else
-		{ vfree(bfr); bfr = NULL; gerror = EXIT_CODE_FS_FILE_NOT_FOUND; }
 
 	drv[2] = (uint32_t) bfr;
 	drv[3] = fsize;
@@ -792,6 +642,71 @@ static uint16_t iso_convert_time_to_fat_time(uint32_t time)
 	return (uint16_t) (sec | (min << FAT_MINUTE_OFFSET) | (h << FAT_HOUR_OFFSET));
 }
 
+void iso_open(const char *path, fs_handle_t *h)
+{
+	size_t fsize = 0;
+	direntry_t entry;
+	uint32_t flba = iso_traverse(path, &fsize, &entry);
+
+	if(!flba || flba == MAX)
+		{ gerror = EXIT_CODE_FS_FILE_NOT_FOUND; return; }
+	if(entry.file_flags & FF_DIRECTORY)
+		{ gerror = EXIT_CODE_GLOBAL_INVALID; return; }
+
+	h->disk = (uint8_t) (drive_convert_drive_id(path) >> DISKIO_DISK_NUMBER);
+	h->part = 0;
+	h->attrib = (uint8_t) (iso_convert_fileflags_to_fat_filetype(entry.file_flags) | FAT_FILE_ATTRIB_READONLY);
+	h->size = fsize;
+	h->start = flba;
+	h->offset = 0;
+}
+
+// files on a CD are a single extent, so reading at an offset is only a matter of finding the sector
+size_t iso_read_at(fs_handle_t *h, uint8_t *buffer, size_t size)
+{
+	if(h->offset >= h->size)
+		return 0;
+
+	size = (size > h->size - h->offset) ? h->size - h->offset : size;
+
+	uint32_t lba = h->start + h->offset / ISO_SECTOR_SIZE;
+	uint32_t skip = h->offset % ISO_SECTOR_SIZE;
+	uint8_t *bfr = NULL;
+	size_t left = size;
+
+	while(left && !gerror)
+	{
+		// whole sectors go straight into the buffer
+		if(!skip && left >= ISO_SECTOR_SIZE)
+		{
+			uint32_t n = left / ISO_SECTOR_SIZE;
+			gerror = read(h->disk, lba, n, buffer);
+
+			lba += n;
+			buffer += n * ISO_SECTOR_SIZE;
+			left -= n * ISO_SECTOR_SIZE;
+			continue;
+		}
+
+		bfr = (bfr) ? bfr : evalloc(ISO_SECTOR_SIZE, PID_DRIVER);
+
+		if(!bfr)
+			{ gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; break; }
+		
+		size_t n = (left > ISO_SECTOR_SIZE - skip) ? ISO_SECTOR_SIZE - skip : left;
+		gerror = read(h->disk, lba, 1, bfr);
+		memcpy(buffer, &bfr[skip], n);
+
+		lba++;
+		buffer += n;
+		left -= n;
+		skip = 0;
+	}
+
+	vfree(bfr);
+	return (gerror) ? 0 : size;
+}
+
 fs_file_info_t *iso_get_file_info(const char *path)
 {
 	size_t fsize;
@@ -822,7 +737,7 @@ fs_file_info_t *iso_get_file_info(const char *path)
 	return info;
 }
 
-static void iso_fill_dircontent_entry(char *filename, size_t fname_len, uint8_t file_flags, size_t size, fs_dir_contents_t *entry)
+static void iso_fill_dircontent_entry(char *filename, size_t fname_len, uint8_t file_flags, size_t size, uint8_t flags, fs_dir_contents_t *entry)
 {
 	uint32_t x = find_in_str(filename, ";");
 
@@ -842,6 +757,10 @@ static void iso_fill_dircontent_entry(char *filename, size_t fname_len, uint8_t
 		fname_len--;
 	
 	entry->name[fname_len] = '\0';
+
+	if(flags & FS_DIR_NAMES_ONLY)
+		{ entry->attrib = 0; entry->file_size = 0; return; }
+
 	entry->attrib = iso_convert_fileflags_to_fat_filetype(file_flags);
 	entry->file_size = size;
 }
@@ -893,7 +812,7 @@ fs_dir_contents_t *iso_get_dir_contents(const char *path, uint32_t *drv)
 
 		i += size;
 		
-		iso_fill_dircontent_entry(file, entry->ident_len, entry->file_flags, entry->size, &c[outi++]);
+		iso_fill_dircontent_entry(file, entry->ident_len, entry->file_flags, entry->size, 0, &c[outi++]);
 	}
 
 	vfree(dir);
@@ -903,3 +822,63 @@ fs_dir_contents_t *iso_get_dir_contents(const char *path, uint32_t *drv)
 
 	return c;
 }
+
+void iso_opendir(const char *path, fs_handle_t *h)
+{
+	size_t fsize = 0;
+	direntry_t entry;
+	uint32_t flba = iso_traverse(path, &fsize, &entry);
+
+	if(!flba || flba == MAX)
+		{ gerror = EXIT_CODE_FS_FILE_NOT_FOUND; return; }
+	if(!(entry.file_flags & FF_DIRECTORY))
+		{ gerror = EXIT_CODE_GLOBAL_INVALID; return; }
+
+	memset(h, sizeof(fs_handle_t), 0);
+
+	h->disk = (uint8_t) (drive_convert_drive_id(path) >> DISKIO_DISK_NUMBER);
+	h->attrib = (uint8_t) (iso_convert_fileflags_to_fat_filetype(entry.file_flags) | FAT_FILE_ATTRIB_READONLY);
+	h->size = fsize;
+	h->start = flba;
+}
+
+// directory entries never cross a sector boundary, so a directory is read one sector at a time
+size_t iso_readdir(fs_handle_t *h, fs_dir_contents_t *out, size_t max)
+{
+	uint8_t *bfr = NULL;
+	uint32_t bfr_lba = MAX;
+	size_t n = 0;
+
+	while(n < max && h->offset < h->size && !gerror)
+	{
+		uint32_t lba = h->start + h->offset / ISO_SECTOR_SIZE;
+		uint32_t in = h->offset % ISO_SECTOR_SIZE;
+
+		if(lba != bfr_lba)
+		{
+			bfr = (bfr) ? bfr : evalloc(ISO_SECTOR_SIZE, PID_DRIVER);
+
+			if(!bfr)
+				{ gerror = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; break; }
+			if((gerror = read(h->disk, lba, 1, bfr)))
+				break;
+			
+			bfr_lba = lba;
+		}
+
+		direntry_t *entry = (direntry_t *) &bfr[in];
+		size_t size = (size_t) ((entry->DR_len) + ((entry->DR_len) % 2 != 0));
+
+		// the rest of the sector is padding
+		if(!size || in + size > ISO_SECTOR_SIZE)
+			{ h->offset += ISO_SECTOR_SIZE - in; continue; }
+
+		h->offset += size;
+
+		char *file = ((char *)&(entry->ident_len) + sizeof(uint8_t));
+		iso_fill_dircontent_entry(file, entry->ident_len, entry->file_flags, entry->size, h->flags, &out[n++]);
+	}
+
+	vfree(bfr);
+	return n;
+}
@@ -41,13 +41,14 @@ unsigned int iso_get_dir_size(unsigned char drive, unsigned int dir_lba);
 unsigned int *iso_search_in_path_table(unsigned char drive, char *filename, unsigned char reset);
 
 unsigned short iso_search_path_table(const char *file, unsigned char drive, unsigned int start_lba, unsigned int *b_ptr);
-unsigned int iso_path_to_dir_lba(unsigned char drive, const char *path);
-
-void reverse_path(char *path, char *out_filename);
 
 unsigned short *iso_read_drive(unsigned char drive, unsigned int lba, unsigned int sctr_read);
 void iso_read(const char * path, unsigned int *drv);
 fs_file_info_t *iso_get_file_info(const char *path);
 fs_dir_contents_t *iso_get_dir_contents(const char *path, uint32_t *drv);
+void iso_open(const char *path, fs_handle_t *h);
+unsigned int iso_read_at(fs_handle_t *h, unsigned char *buffer, unsigned int size);
+void iso_opendir(const char *path, fs_handle_t *h);
+unsigned int iso_readdir(fs_handle_t *h, fs_dir_contents_t *out, unsigned int max);
 
 #endif
\ No newline at end of file
@@ -68,6 +68,7 @@ drv[1] (parameter1) --> old path (+ old filename)
 drv[4] (parameter4) --> (returns) error code
 
     WARNING: this function will not care about if the file is write protected (it will delete it anyway)
+    directories are only deleted when they are empty (EXIT_CODE_FS_DIR_NOT_EMPTY)
 */
 
 #define FS_COMMAND_MKDIR 0x14
@@ -97,4 +98,54 @@ drv[4] (parameter4) --> (returns) error code
     * = See FS_TYPES.H
 */
 
+#define FS_COMMAND_OPEN 0x17
+/*
+    drv[1] (parameter1) --> path to the file
+    drv[2] (parameter2) --> pointer to a handle (fs_handle_t, see FS_TYPES.H) that is filled in
+    drv[4] (parameter4) --> (returns) error code
+
+    directories can't be opened
+*/
+
+#define FS_COMMAND_READ_AT 0x18
+/*
+    drv[1] (parameter1) --> handle, as filled in by FS_COMMAND_OPEN (reads at handle->offset)
+    drv[2] (parameter2) --> buffer
+    drv[3] (parameter3) --> number of bytes to read, (returns) number of bytes read
+    drv[4] (parameter4) --> (returns) error code
+
+    reads stop at the end of the file; FAT32 reads handle->size back from the directory entry first,
+    so a read of 0 bytes brings it up to date
+*/
+
+#define FS_COMMAND_WRITE_AT 0x19
+/*
+    drv[1] (parameter1) --> handle, as filled in by FS_COMMAND_OPEN (writes at handle->offset, which may
+                             be the end of the file to append; handle->size and handle->start are
+                             read back from the directory entry first, then updated)
+    drv[2] (parameter2) --> buffer
+    drv[3] (parameter3) --> number of bytes to write, (returns) number of bytes written
+    drv[4] (parameter4) --> (returns) error code
+*/
+
+#define FS_COMMAND_OPENDIR 0x1a
+/*
+    drv[1] (parameter1) --> path to the directory
+    drv[2] (parameter2) --> pointer to a handle (fs_handle_t, see FS_TYPES.H) that is filled in
+    drv[4] (parameter4) --> (returns) error code
+
+    the caller may set handle->flags (FS_DIR_*) afterwards
+*/
+
+#define FS_COMMAND_READDIR 0x1b
+/*
+    drv[1] (parameter1) --> handle, as filled in by FS_COMMAND_OPENDIR
+    drv[2] (parameter2) --> buffer of fs_dir_contents_t (see FS_TYPES.H)
+    drv[3] (parameter3) --> number of entries that fit in the buffer, (returns) number of entries read
+    drv[4] (parameter4) --> (returns) error code
+
+    continues where the previous FS_COMMAND_READDIR on the handle stopped, 
+    0 entries are returned at the end of the directory
+*/
+
 #endif
@@ -22,14 +22,26 @@
 bits 32
 
 section .text
-global ASM_IDE_IRQ
-extern IDE_IRQ
-ASM_IDE_IRQ:
-; IRQ handler for the ide thing (assembly side)
+global ASM_IDE_IRQ_PRIMARY
+extern IDE_IRQ_primary
+ASM_IDE_IRQ_PRIMARY:
+; IRQ handler for the primary channel (IRQ 14, assembly side)
 ;	input: n/a
 ;	ouput: n/a
 pushad
 	cld
-	call IDE_IRQ
+	call IDE_IRQ_primary
+popad
+iret
+
+global ASM_IDE_IRQ_SECONDARY
+extern IDE_IRQ_secondary
+ASM_IDE_IRQ_SECONDARY:
+; IRQ handler for the secondary channel (IRQ 15, assembly side)
+;	input: n/a
+;	ouput: n/a
+pushad
+	cld
+	call IDE_IRQ_secondary
 popad
 iret
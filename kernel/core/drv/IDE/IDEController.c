@@ -29,6 +29,7 @@ SOFTWARE.
 #include "../../include/exit_code.h"
 #include "../../include/types.h"
 #include "../../dsk/diskdefines.h"
+#include "../../dsk/blkdev.h"
 
 #include "../../cpu/interrupts/IDT.h"
 #include "../../hardware/pic.h"
@@ -41,6 +42,7 @@ SOFTWARE.
 
 #include "../../hardware/pci.h"
 #include "../../hardware/driver.h"
+#include "../../hardware/timer.h"
 
 #include "../../memory/memory.h"
 
@@ -92,78 +94,147 @@ SOFTWARE.
 #define ATAPI_IDENTIFY          0xA1
 #define ATA_IDENTIFY            0xEC
 
+#define IDE_MAX_SECTORS_PER_COMMAND 255 /* sector count register is 8 bits, 0 would mean 256 */
+#define ATAPI_MAX_SECTORS_PER_COMMAND 0xFFFF /* READ(12) takes 32 bits, this keeps a command under 128 MiB */
+#define ATAPI_MAX_BYTE_COUNT        0xF800 /* largest DRQ block we ask for: 31 sectors, below the 0xFFFE limit */
+
+/* delays from the ATA specification */
+#define IDE_SETTLE_NS       400     /* after selecting a drive or sending a command */
+#define IDE_SRST_US         5       /* minimal duration of a software reset */
+#define IDE_SRST_WAIT_US    2000    /* after a software reset, before the status can be trusted */
+
+/* a command that makes no progress for this long has failed (a drive that hangs, a lost IRQ);
+   CD drives may take several seconds to spin up */
+#define IDE_TIMEOUT_US      10000000
+
+/* ide_quirk_t.flags */
+#define IDE_QUIRK_CTRL_PORTS    1U << 0 /* control block ports in BARs 1 and 3 are wrong, use the ones below */
+#define IDE_QUIRK_SETTLE_DELAY  1U << 1 /* reading the alternate status does not delay long enough, use settle_ns */
+
+typedef struct
+{
+    uint32_t id;            /* PCI device and vendor id (register 0) */
+    uint8_t flags;
+    uint16_t p_ctrl_port;
+    uint16_t s_ctrl_port;
+    uint32_t settle_ns;
+} ide_quirk_t;
+
+/* controllers that need something other than the defaults */
+static const ide_quirk_t ide_quirks[] = {
+    /* ICH4 (8086:24cb), according to the datasheet the control blocks are at 0x3f4 and 0x374.
+       The alternate status register is not at the expected offset, so time the settle delay instead */
+    {0x24CB8086, IDE_QUIRK_CTRL_PORTS | IDE_QUIRK_SETTLE_DELAY, 0x3F4, 0x374, IDE_SETTLE_NS},
+};
+
+#define IDE_QUIRKS_COUNT (sizeof(ide_quirks) / sizeof(ide_quirk_t))
+
 /* Flags stuff */
 #define IDE_FLAG_INIT_RAN   1 /* used by init to say it did ran and did it's thing */
-#define IDE_FLAG_IRQ        1 << 2
 
+#define IDE_CHANNELS        2
+#define IDE_PRIMARY         0
+#define IDE_SECONDARY       1
+
+/* states of the request state machine of a channel */
+#define IDE_STATE_IDLE      0 /* next command of the request still has to be issued */
+#define IDE_STATE_PACKET    1 /* ATAPI: waiting for the drive to accept the command packet */
+#define IDE_STATE_DATA      2 /* waiting for the drive to be ready for the next data block */
+#define IDE_STATE_FINISH    3 /* PATA write: waiting for the drive to finish the command */
+
+
+/* words in the IDENTIFY (PACKET) DEVICE data */
+#define ATA_IDENT_SERIAL        10
+#define ATA_IDENT_MODEL         27
+#define ATA_IDENT_MULTIPLE_CUR  59
+#define ATA_IDENT_CAPABILITIES  49
+#define ATA_IDENT_LBA28         60
+#define ATA_IDENT_MWDMA         63
+#define ATA_IDENT_CMDSET_SUP    82
+#define ATA_IDENT_CMDSET_SUP2   83
+#define ATA_IDENT_CMDSET_EN     85
+#define ATA_IDENT_UDMA          88
+#define ATA_IDENT_LBA48         100
+#define ATA_IDENT_SECTOR_INFO   106
+#define ATA_IDENT_SECTOR_SIZE   117
+
+#define ATA_IDENT_WORDS         256
+
+#define ATA_LBA28_MAX_SECTORS   0x10000000U
 
 typedef struct
 {
     uint8_t type;
-    /* there'll be more here, probably */
+    uint16_t identify[ATA_IDENT_WORDS];     /* as returned by the drive during init */
+    blkdev_caps_t caps;                     /* parsed from identify */
 } DRIVE_INFO;
 
+/* the primary and secondary channel are independent, each runs its own request */
+typedef struct
+{
+    uint16_t base_port;
+    uint16_t ctrl_port;
+    volatile uint8_t irq;       /* set by the IRQ handler of this channel */
+
+    uint8_t state;
+    blkdev_req_t *req;          /* request being executed, NULL if idle */
+    uint32_t lba;               /* next sector of the request */
+    uint32_t left;              /* sectors of the request still to go */
+    uint32_t cmd_sectors;       /* sectors of the current command */
+    uint32_t cmd_left;          /* PATA: data blocks of the current command still to go,
+                                   ATAPI: bytes of the current command still to go */
+    uint8_t *buf;
+    uint32_t progress;          /* timer_timestamp() of the last step the drive made */
+} ide_channel_t;
+
 /* functions defined here, because it *should* be private to the driver */
 
 void IDEController_handler(uint32_t *drv);
 
-extern void ASM_IDE_IRQ(void);
+extern void ASM_IDE_IRQ_PRIMARY(void);
+extern void ASM_IDE_IRQ_SECONDARY(void);
 
-void IDE_IRQ(void);
+void IDE_IRQ_primary(void);
+void IDE_IRQ_secondary(void);
 
 static void IDE_software_reset(uint16_t port);
 static void IDE_wait(void);
 static uint8_t IDE_polling(uint16_t port, bool errTest);
 static uint16_t IDE_getPort(uint8_t drive);
 static uint8_t IDE_getSlavebit(uint8_t drive);
-static void IDEClearFlagBit(uint16_t flag_bit);
 
 static void IDEDriverInit(unsigned int device);
 #ifndef NO_DEBUG_INFO
 static void IDEPrintWelcome(void);
 #endif
 static void IDE_enumerate(void);
-static uint8_t IDE_getDriveType(uint16_t port, uint8_t slavebit);
+static uint8_t IDE_getDriveType(uint16_t port, uint8_t slavebit, uint16_t *identify);
+static uint8_t IDE_identify(uint8_t drive, uint16_t *buf);
+static void IDE_parseIdentify(uint8_t drive);
 
-static uint8_t IDE_readPIO28(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf);
-static uint8_t IDE_writePIO28(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf);
-static uint8_t IDE_readPIO28_atapi(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf);
+static err_t ide_blk_read(uint8_t unit, uint32_t lba, uint32_t nlba, uint8_t *buf);
+static err_t ide_blk_write(uint8_t unit, uint32_t lba, uint32_t nlba, const uint8_t *buf);
+static uint8_t IDE_flush(uint8_t drive);
 
 static void IDE_reportDrives(uint8_t *drive_list);
+static void IDE_getBlkdevOps(blkdev_ops_t *ops);
 
 DRIVE_INFO drive_info_t[IDE_DRIVER_MAX_DRIVES];
 uint32_t PCI_controller;
 
-uint16_t p_base_port;
-uint16_t p_ctrl_port;
-uint16_t s_base_port;
-uint16_t s_ctrl_port;
+ide_channel_t ide_channels[IDE_CHANNELS];
 
 /* some flag values:
         - bit 0: if set, init executed succesfully
-        - bit 1: IRQ fired
         */
 uint16_t ide_flags = 0;
 
+/* quirks of the controller we drive, NULL if it needs none */
+const ide_quirk_t *ide_quirk = NULL;
+
 /* the indentifier for drivers + information about our driver */
 struct DRIVER IDE_driver_id = {(uint32_t) 0xB14D05, "VIREODRV", (IDEController_PCI_CLASS_SUBCLASS | DRIVER_TYPE_PCI), (uint32_t) (IDEController_handler)};
 
-static uint32_t ide_get_max_addr(uint8_t drive)
-{
-    uint16_t port = IDE_getPort(drive);
-    
-    outb(port | ATA_PORT_COMSTAT, ATA_COMMAND_MAX_ADDR);
-
-    IDE_polling(port, false);
-
-    uint32_t lba = (uint32_t) inb(port | ATA_PORT_LBALOW);
-    lba += (uint32_t) inb(port | ATA_PORT_LBAMID) << 8;
-    lba += (uint32_t) inb(port | ATA_PORT_LBAHI) << 16;
-    lba += (uint32_t) (inb(port | ATA_PORT_SELECT) & 0x0F) << 24;
-    
-    return lba;
-}
-
 void IDEController_handler(uint32_t *drv)
 {
     uint8_t error = 0;
@@ -183,10 +254,7 @@ or has executed succesfully in the past */
         break;
 
         case IDE_COMMAND_READ:
-            if(drive_info_t[drv[1]].type == DRIVE_TYPE_IDE_PATA)
-                error = IDE_readPIO28((uint8_t) drv[1], drv[2], (uint8_t) drv[3], (uint16_t *) drv[4]);
-            if(drive_info_t[drv[1]].type == DRIVE_TYPE_IDE_PATAPI)
-                error = IDE_readPIO28_atapi((uint8_t) drv[1], drv[2], (uint8_t) drv[3], (uint16_t *) drv[4]);
+            error = ide_blk_read((uint8_t) drv[1], drv[2], drv[3], (uint8_t *) drv[4]);
         break;
 
         case IDE_COMMAND_WRITE:
@@ -196,7 +264,8 @@ or has executed succesfully in the past */
                 break;
             }
 
-            IDE_writePIO28((uint8_t) drv[1], drv[2], (uint8_t) drv[3], (uint16_t *) drv[4]);
+            error = ide_blk_write((uint8_t) drv[1], drv[2], drv[3], (uint8_t *) drv[4]);
+            error = (error) ? error : IDE_flush((uint8_t) drv[1]);
         break;
 
         case IDE_COMMAND_REPORTDRIVES:
@@ -207,7 +276,14 @@ or has executed succesfully in the past */
         break;
 
         case IDE_COMMAND_GET_MAX_ADDRESS:
-            drv[2] = ide_get_max_addr((uint8_t) drv[1]);
+            drv[2] = (drv[1] < IDE_DRIVER_MAX_DRIVES) ? drive_info_t[drv[1]].caps.max_lba : 0;
+        break;
+
+        case IDE_COMMAND_GET_BLKDEV_OPS:
+            if(drv[1])
+                IDE_getBlkdevOps((blkdev_ops_t *) drv[1]);
+            else
+                error = EXIT_CODE_GLOBAL_OUT_OF_RANGE;
         break;
 
         default:
@@ -224,34 +300,44 @@ or has executed succesfully in the past */
     
 }
 
-// ISR
-void IDE_IRQ(void)
+// ISRs
+void IDE_IRQ_primary(void)
+{
+    ide_channels[IDE_PRIMARY].irq = 1;
+
+    PIC_EOI(14);
+}
+
+void IDE_IRQ_secondary(void)
 {
-    ide_flags = ide_flags | IDE_FLAG_IRQ;
+    ide_channels[IDE_SECONDARY].irq = 1;
 
-    PIC_EOI(0x0F);
+    PIC_EOI(15);
 }
 
 static void IDE_software_reset(uint16_t port){
     uint8_t value = (uint8_t) inb(port);
     outb(port, (value | 0x04));
 
-    sleep(5);
+    udelay(IDE_SRST_US);
 
     /* unset the reset bit */
     value = (uint8_t) inb(port);
     outb(port, ((uint8_t)(value & 0xFFFBU)));
+
+    udelay(IDE_SRST_WAIT_US);
 }
 
 static void IDE_wait(void)
 {
-    if(pciGetReg0(PCI_controller) == 0x24CB8086)
-    { sleep(4); return; }
-
-    inb(p_ctrl_port);
-    inb(p_ctrl_port);
-    inb(p_ctrl_port);
-    inb(p_ctrl_port);
+    if(ide_quirk && (ide_quirk->flags & IDE_QUIRK_SETTLE_DELAY))
+    { ndelay(ide_quirk->settle_ns); return; }
+
+    /* each read of the alternate status takes about 100 ns */
+    inb(ide_channels[IDE_PRIMARY].ctrl_port);
+    inb(ide_channels[IDE_PRIMARY].ctrl_port);
+    inb(ide_channels[IDE_PRIMARY].ctrl_port);
+    inb(ide_channels[IDE_PRIMARY].ctrl_port);
 }
 
 static uint8_t IDE_polling(uint16_t port, bool errTest)
@@ -280,7 +366,7 @@ static uint8_t IDE_polling(uint16_t port, bool errTest)
 
 static uint16_t IDE_getPort(uint8_t drive)
 {
-    return (drive > 1) ? s_base_port : p_base_port;
+    return ide_channels[drive / 2].base_port;
 }
 
 static uint8_t IDE_getSlavebit(uint8_t drive)
@@ -288,11 +374,6 @@ static uint8_t IDE_getSlavebit(uint8_t drive)
     return (drive % 2) ? (uint8_t) 1 : 0;
 }
 
-static void IDEClearFlagBit(uint16_t flag_bit)
-{
-    ide_flags = ide_flags & (uint16_t)~(flag_bit);
-}
-
 static void IDEDriverInit(uint32_t device)
 {
     uint8_t drive, slavebit;
@@ -300,19 +381,26 @@ static void IDEDriverInit(uint32_t device)
 
     PCI_controller = device & (uint32_t)~(DRIVER_TYPE_PCI);
 
+    /* look up the quirks of this controller once, instead of on every delay */
+    uint32_t id = pciGetReg0(PCI_controller);
+
+    for(uint32_t i = 0; i < IDE_QUIRKS_COUNT; ++i)
+        if(ide_quirks[i].id == id)
+            ide_quirk = &ide_quirks[i];
+
     /* get the ports for both primary and secondary */
     IDE_enumerate();
     
-    IDE_software_reset(p_ctrl_port);
-    IDE_software_reset(s_ctrl_port);
+    IDE_software_reset(ide_channels[IDE_PRIMARY].ctrl_port);
+    IDE_software_reset(ide_channels[IDE_SECONDARY].ctrl_port);
 
-    /* register our IRQ handler */
-    IDT_add_handler(0x2E, (uint32_t) ASM_IDE_IRQ);
-    IDT_add_handler(0x2F, (uint32_t) ASM_IDE_IRQ);
+    /* register our IRQ handlers, one per channel (IRQ 14 and 15) */
+    IDT_add_handler(0x2E, (uint32_t) ASM_IDE_IRQ_PRIMARY);
+    IDT_add_handler(0x2F, (uint32_t) ASM_IDE_IRQ_SECONDARY);
 
     /* disable IRQs */
-    outb((uint32_t) p_ctrl_port, 2);
-    outb((uint32_t) s_ctrl_port, 2);
+    outb((uint32_t) ide_channels[IDE_PRIMARY].ctrl_port, 2);
+    outb((uint32_t) ide_channels[IDE_SECONDARY].ctrl_port, 2);
 
     /* get the drive types */
     for(drive = 0; drive < IDE_DRIVER_MAX_DRIVES; ++drive)
@@ -320,11 +408,17 @@ static void IDEDriverInit(uint32_t device)
         port = IDE_getPort(drive);
         slavebit = IDE_getSlavebit(drive);
 
-        drive_info_t[drive].type = IDE_getDriveType(port, slavebit);
+        drive_info_t[drive].type = IDE_getDriveType(port, slavebit, drive_info_t[drive].identify);
+
+        /* IDE_getDriveType() does not send IDENTIFY to ATAPI devices, they have their own command */
+        if(drive_info_t[drive].type == DRIVE_TYPE_IDE_PATAPI)
+            IDE_identify(drive, drive_info_t[drive].identify);
+
+        IDE_parseIdentify(drive);
     }
 
-    outb((uint32_t) p_ctrl_port, 0);
-    outb((uint32_t) s_ctrl_port, 0);
+    outb((uint32_t) ide_channels[IDE_PRIMARY].ctrl_port, 0);
+    outb((uint32_t) ide_channels[IDE_SECONDARY].ctrl_port, 0);
 
     /* set the flag 'INIT ran successfully' */
     ide_flags = ide_flags | IDE_FLAG_INIT_RAN;
@@ -340,10 +434,10 @@ static void IDEPrintWelcome(void)
     print( IDE_DRIVER_VERSION_STRING);
     print_value( "[IDE_DRIVER] Kernel reported PCI controller %x\n", PCI_controller);
 
-    print_value( "[IDE_DRIVER] Primary base port: %x\n", p_base_port);
-    print_value( "[IDE_DRIVER] Secondary base port: %x\n", s_base_port);
-    print_value( "[IDE_DRIVER] Primary control port: %x\n", p_ctrl_port);
-    print_value( "[IDE_DRIVER] Secondary control port: %x\n", s_ctrl_port);
+    print_value( "[IDE_DRIVER] Primary base port: %x\n", ide_channels[IDE_PRIMARY].base_port);
+    print_value( "[IDE_DRIVER] Secondary base port: %x\n", ide_channels[IDE_SECONDARY].base_port);
+    print_value( "[IDE_DRIVER] Primary control port: %x\n", ide_channels[IDE_PRIMARY].ctrl_port);
+    print_value( "[IDE_DRIVER] Secondary control port: %x\n", ide_channels[IDE_SECONDARY].ctrl_port);
 
     print( "\n");
 
@@ -356,32 +450,29 @@ static void IDE_enumerate(void)
 
     /* get the primary ports... */
     bar = pciGetBar(PCI_controller, PCI_BAR0) & 0xFFFFFFFC;
-    p_base_port = (uint16_t) (bar + 0x1F0U*(!bar)) & 0xFFFFU;
+    ide_channels[IDE_PRIMARY].base_port = (uint16_t) (bar + 0x1F0U*(!bar)) & 0xFFFFU;
 
     bar = pciGetBar(PCI_controller, PCI_BAR1) & 0xFFFFFFFC;
-    p_ctrl_port = (uint16_t) (bar + 0x3F6U*(!bar)) & 0xFFFFU;
+    ide_channels[IDE_PRIMARY].ctrl_port = (uint16_t) (bar + 0x3F6U*(!bar)) & 0xFFFFU;
 
     /* ...and the secondary */
     bar = pciGetBar(PCI_controller, PCI_BAR2) & 0xFFFFFFFC;
-    s_base_port = (uint16_t) (bar + 0x170U*(!bar)) & 0xFFFFU;
+    ide_channels[IDE_SECONDARY].base_port = (uint16_t) (bar + 0x170U*(!bar)) & 0xFFFFU;
 
     bar = pciGetBar(PCI_controller, PCI_BAR3) & 0xFFFFFFFC;
-    s_ctrl_port = (uint16_t) (bar + 0x376U*(!bar)) & 0xFFFFU;
+    ide_channels[IDE_SECONDARY].ctrl_port = (uint16_t) (bar + 0x376U*(!bar)) & 0xFFFFU;
   
-    if(pciGetReg0(PCI_controller) == 0x24CB8086)
+    if(ide_quirk && (ide_quirk->flags & IDE_QUIRK_CTRL_PORTS))
     {
-        // this controller (8086:24cb) does not seem to report its control block correctly.
-        // According to the datasheet these are 0x3f4 and 0x374 respectively
-        p_ctrl_port = 0x3f4;
-        s_ctrl_port = 0x374;
+        ide_channels[IDE_PRIMARY].ctrl_port = ide_quirk->p_ctrl_port;
+        ide_channels[IDE_SECONDARY].ctrl_port = ide_quirk->s_ctrl_port;
     }
 
 }
 
-static uint8_t IDE_getDriveType(uint16_t port, uint8_t slavebit)
+static uint8_t IDE_getDriveType(uint16_t port, uint8_t slavebit, uint16_t *identify)
 {
     uint16_t status = 0;
-    uint16_t *buffer;
     uint16_t lo, hi;
     uint8_t type = DRIVE_TYPE_IDE_PATA;
 
@@ -432,163 +523,433 @@ static uint8_t IDE_getDriveType(uint16_t port, uint8_t slavebit)
     else if(hi == 0x7F && lo == 0x7F)
         return DRIVE_TYPE_UNKNOWN;
 
-    /* right now we discard the info returned by the device, though it may be useful to not discard this in the future */
-    buffer = kmalloc(256 * sizeof(uint16_t));
-
-    insw(port, 255, buffer);
-
-    kfree(buffer);
+    insw(port, ATA_IDENT_WORDS, identify);
 
     return type;
 }
 
-static uint8_t IDE_readPIO28(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf)
+/* writes are only guaranteed to be on the medium after a flush */
+static uint8_t IDE_flush(uint8_t drive)
 {
-    uint8_t i = 0;
     uint16_t port = IDE_getPort(drive);
     uint8_t slavebit = IDE_getSlavebit(drive);
-    uint8_t *buf_ptr = (uint8_t *) buf;
 
-    while((inb(port |ATA_PORT_COMSTAT) & ATA_STAT_BUSY));
-    
     if(drive > 3)
         return EXIT_CODE_IDE_ERROR_READING_DRIVE;
     if(drive_info_t[drive].type != DRIVE_TYPE_IDE_PATA)
+        return EXIT_CODE_GLOBAL_UNSUPPORTED;
+
+    while((inb(port |ATA_PORT_COMSTAT) & ATA_STAT_BUSY));
+
+    outb(port | ATA_PORT_SELECT,  ((uint8_t)0xE0U) | ((uint8_t)(slavebit << 4U)));
+    IDE_wait();
+
+    outb(port | ATA_PORT_COMSTAT, ATA_COMMAND_CACHE_FLUSH);
+    IDE_polling(port, false);
+
+    if(inb(port | ATA_PORT_COMSTAT) & (ATA_STAT_ERR | ATA_STAT_DF))
         return EXIT_CODE_IDE_ERROR_READING_DRIVE;
 
-    outb(port | ATA_PORT_SELECT,  ((uint8_t)0xE0U) | ((uint8_t)(slavebit << 4U)) | ((((uint8_t)start >> 24U)) & 0x0F));
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
 
-    outb(port | ATA_PORT_FEATURES, 0U); /* no DMA */
-    outb(port | ATA_PORT_SCTRCNT, sctrwrite);
+/* issues the next command of the request running on a channel */
+static void IDE_startCommand(ide_channel_t *ch)
+{
+    blkdev_req_t *r = ch->req;
+    uint16_t port = ch->base_port;
+    uint8_t slavebit = IDE_getSlavebit(r->unit);
 
-    start = start & 0x0FFFFFFFU;
+    ch->irq = 0;
 
-    outb(port | ATA_PORT_LBALOW, (uint8_t) start);
-    outb(port | ATA_PORT_LBAMID, (uint8_t) (start >> 8U));
-    outb(port | ATA_PORT_LBAHI, (uint8_t) (start >> 16U));
+    if(drive_info_t[r->unit].type == DRIVE_TYPE_IDE_PATAPI)
+    {
+        ch->cmd_sectors = (ch->left > ATAPI_MAX_SECTORS_PER_COMMAND) ? ATAPI_MAX_SECTORS_PER_COMMAND : ch->left;
+        ch->cmd_left = ch->cmd_sectors * DEFAULT_ATAPI_SECTOR_SIZE;
 
-    outb(port | ATA_PORT_COMSTAT, ATA_COMMAND_READ);
+        outb(port | ATA_PORT_SELECT, ((uint8_t)0xA0U) | ((uint8_t)(slavebit << 4U)));
+        IDE_wait();
 
-    if(IDE_polling(port, false))
-        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
+        /* PIO, the drive sends as many sectors per data block as fit in the byte count */
+        outb(port | ATA_PORT_FEATURES, 0U);
+        outb(port | ATA_PORT_LBAMID, (uint8_t) (ATAPI_MAX_BYTE_COUNT & 0xFF));
+        outb(port | ATA_PORT_LBAHI, (uint8_t) (ATAPI_MAX_BYTE_COUNT >> 8U));
 
-    for(i = 0; i < sctrwrite; ++i)
+        outb(port | ATA_PORT_COMSTAT, ATAPI_COMMAND_PACKET);
+        ch->state = IDE_STATE_PACKET;
+    }
+    else
     {
-        IDE_polling(port, false);
-        while(!(inb(port | ATA_PORT_COMSTAT) & ATA_STAT_READY));
+        ch->cmd_sectors = (ch->left > IDE_MAX_SECTORS_PER_COMMAND) ? IDE_MAX_SECTORS_PER_COMMAND : ch->left;
+        ch->cmd_left = ch->cmd_sectors;
+
+        outb(port | ATA_PORT_SELECT,  ((uint8_t)0xE0U) | ((uint8_t)(slavebit << 4U)) | ((uint8_t) (ch->lba >> 24U) & 0x0F));
+        IDE_wait();
 
-        insw(port, 256, (uint16_t *) buf_ptr);
+        outb(port | ATA_PORT_FEATURES, 0U); /* no DMA */
+        outb(port | ATA_PORT_SCTRCNT, (uint8_t) ch->cmd_sectors);
 
-        buf_ptr += DEFAULT_SECTOR_SIZE;
+        outb(port | ATA_PORT_LBALOW, (uint8_t) ch->lba);
+        outb(port | ATA_PORT_LBAMID, (uint8_t) (ch->lba >> 8U));
+        outb(port | ATA_PORT_LBAHI, (uint8_t) (ch->lba >> 16U));
+
+        outb(port | ATA_PORT_COMSTAT, (r->write) ? ATA_COMMAND_WRITE : ATA_COMMAND_READ);
+        ch->state = IDE_STATE_DATA;
     }
 
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    ch->progress = timer_timestamp();
+    IDE_wait();
 }
 
-static uint8_t IDE_writePIO28(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf)
+static void IDE_finishRequest(ide_channel_t *ch, err_t err)
 {
-    uint8_t i = 0;
-    uint16_t port = IDE_getPort(drive);
-    uint8_t slavebit = IDE_getSlavebit(drive);
-    uint8_t *buf_ptr = (uint8_t *) buf;
+    ch->req->err = err;
+    ch->req = NULL;
+    ch->state = IDE_STATE_IDLE;
+}
 
-    while((inb(port |ATA_PORT_COMSTAT) & ATA_STAT_BUSY));
+/* the current command is done, continue with the rest of the request (if any) */
+static void IDE_finishCommand(ide_channel_t *ch)
+{
+    ch->lba = ch->lba + ch->cmd_sectors;
+    ch->left = ch->left - ch->cmd_sectors;
+    ch->cmd_sectors = 0;
+    ch->state = IDE_STATE_IDLE;
 
-    if(drive > 3)
-        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
-    if(drive_info_t[drive].type != DRIVE_TYPE_IDE_PATA)
-        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
+    if(!ch->left)
+        IDE_finishRequest(ch, EXIT_CODE_GLOBAL_SUCCESS);
+}
+
+static void IDE_sendPacket(ide_channel_t *ch)
+{
+    uint8_t read_command[12] = {ATAPI_COMMAND_READ,0,0,0,0,0,0,0,0,0,0,0};
+
+    read_command[2] = (uint8_t) (ch->lba >> 0x18) & 0xFF;
+    read_command[3] = (uint8_t) (ch->lba >> 0x10) & 0xFF;
+    read_command[4] = (uint8_t) (ch->lba >> 0x08) & 0xFF;
+    read_command[5] = (uint8_t) (ch->lba >> 0x00) & 0xFF;
+    read_command[6] = (uint8_t) (ch->cmd_sectors >> 0x18) & 0xFF;
+    read_command[7] = (uint8_t) (ch->cmd_sectors >> 0x10) & 0xFF;
+    read_command[8] = (uint8_t) (ch->cmd_sectors >> 0x08) & 0xFF;
+    read_command[9] = (uint8_t) (ch->cmd_sectors >> 0x00) & 0xFF;
+
+    ch->irq = 0;
+    outsw(ch->base_port, 6, (uint16_t *) &read_command);
+
+    ch->state = IDE_STATE_DATA;
+    ch->progress = timer_timestamp();
+}
+
+/* ATAPI drives raise their IRQ for every data block and once more when the command is done */
+static void IDE_stepAtapiData(ide_channel_t *ch)
+{
+    uint16_t port = ch->base_port;
 
-    outb(port | ATA_PORT_SELECT,  ((uint8_t)0xE0U) | ((uint8_t)(slavebit << 4U)) | ((((uint8_t)start >> 24U)) & 0x0F));
+    if(!ch->irq)
+        return;
+    
+    ch->irq = 0;
 
-    outb(port | ATA_PORT_FEATURES, 0U); /* no DMA */
-    outb(port | ATA_PORT_SCTRCNT, sctrwrite);
+    uint8_t status = inb(port | ATA_PORT_COMSTAT);
 
-    start = start & 0x0FFFFFFFU;
+    if(!(status & ATA_STAT_DRQ))
+    {
+        IDE_finishCommand(ch);
+        return;
+    }
+
+    /* the drive tells how much it sends in this block, an odd count is padded to a whole word */
+    uint32_t size = (uint32_t)(inb(port | ATA_PORT_LBAHI) << 8U) | inb(port | ATA_PORT_LBAMID);
+    uint32_t words = (size + 1) / 2;
+    uint32_t to_buf = (words * 2 > ch->cmd_left) ? ch->cmd_left / 2 : words;
 
-    outb(port | ATA_PORT_LBALOW, (uint8_t) start);
-    outb(port | ATA_PORT_LBAMID, (uint8_t) (start >> 8U));
-    outb(port | ATA_PORT_LBAHI, (uint8_t) (start >> 16U));
+    insw(port, to_buf, (uint16_t *) ch->buf);
+    ch->buf = ch->buf + to_buf * 2;
+    ch->cmd_left = ch->cmd_left - to_buf * 2;
 
-    outb(port | ATA_PORT_COMSTAT, ATA_COMMAND_WRITE);
+    /* never write past the request, drain whatever the drive sends beyond it */
+    for(; to_buf < words; ++to_buf)
+        inw(port);
+
+    ch->progress = timer_timestamp();
+}
+
+static void IDE_stepPataData(ide_channel_t *ch, uint8_t status)
+{
+    uint16_t port = ch->base_port;
+
+    if(!(status & ATA_STAT_DRQ))
+        return;
+
+    if(ch->req->write)
+        outsw(port, 256, (uint16_t *) ch->buf);
+    else
+        insw(port, 256, (uint16_t *) ch->buf);
+    
+    ch->buf = ch->buf + DEFAULT_SECTOR_SIZE;
+    ch->cmd_left = ch->cmd_left - 1;
+    ch->progress = timer_timestamp();
+
+    /* give the drive time to raise BSY before the status is read again */
     IDE_wait();
 
-    while(!(inb(port |ATA_PORT_COMSTAT) & 0x40));
+    if(ch->cmd_left)
+        return;
+    
+    /* written sectors only count as done once the drive has written them */
+    if(ch->req->write)
+        ch->state = IDE_STATE_FINISH;
+    else
+        IDE_finishCommand(ch);
+}
+
+/* advances the request running on a channel as far as the drive allows right now, never waits */
+static void IDE_step(ide_channel_t *ch)
+{
+    if(!ch->req)
+        return;
+
+    /* the alternate status, reading the status register would acknowledge an IRQ we may still be waiting for */
+    uint8_t status = inb(ch->ctrl_port);
+
+    /* the drive is stuck or its IRQ got lost, it is reset so that the next request starts clean */
+    if(timer_elapsed_us(ch->progress) > IDE_TIMEOUT_US)
+    {
+        IDE_software_reset(ch->ctrl_port);
+        outb(ch->ctrl_port, 0);
+
+        IDE_finishRequest(ch, EXIT_CODE_IDE_ERROR_READING_DRIVE);
+        return;
+    }
+
+    if(status & ATA_STAT_BUSY)
+        return;
+    
+    if(ch->state == IDE_STATE_IDLE)
+    {
+        IDE_startCommand(ch);
+        return;
+    }
+
+    if(status & (ATA_STAT_ERR | ATA_STAT_DF))
+    {
+        IDE_finishRequest(ch, EXIT_CODE_IDE_ERROR_READING_DRIVE);
+        return;
+    }
+
+    switch(ch->state)
+    {
+        case IDE_STATE_PACKET:
+            if(status & ATA_STAT_DRQ)
+                IDE_sendPacket(ch);
+        break;
+
+        case IDE_STATE_DATA:
+            if(drive_info_t[ch->req->unit].type == DRIVE_TYPE_IDE_PATAPI)
+                IDE_stepAtapiData(ch);
+            else
+                IDE_stepPataData(ch, status);
+        break;
+
+        case IDE_STATE_FINISH:
+            IDE_finishCommand(ch);
+        break;
+
+        default:
+            IDE_finishRequest(ch, EXIT_CODE_GLOBAL_GENERAL_FAIL);
+        break;
+    }
+}
+
+static err_t IDE_checkRequest(blkdev_req_t *r)
+{
+    if(r->unit >= IDE_DRIVER_MAX_DRIVES || drive_info_t[r->unit].type == DRIVE_TYPE_UNKNOWN)
+        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
+    if(r->write && drive_info_t[r->unit].type != DRIVE_TYPE_IDE_PATA)
+        return EXIT_CODE_GLOBAL_GENERAL_FAIL;
+    if(!r->buf)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
     
-    for(i = 0; i < sctrwrite; ++i)
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/* gives an idle channel the next request of the batch that belongs to it */
+static void IDE_nextRequest(uint8_t channel, blkdev_req_t *reqs, uint32_t n, uint32_t *next)
+{
+    ide_channel_t *ch = &ide_channels[channel];
+
+    for(; *next < n; ++(*next))
     {
-        IDE_polling(port, false);
-        while(!(inb(port | ATA_PORT_COMSTAT) & ATA_STAT_READY));
+        blkdev_req_t *r = &reqs[*next];
 
-        outsw(port, 256, (uint16_t *) buf_ptr);
+        /* requests for drives that don't exist are failed by the primary channel */
+        if(((r->unit < IDE_DRIVER_MAX_DRIVES) ? r->unit / 2 : IDE_PRIMARY) != channel)
+            continue;
         
-        buf_ptr += DEFAULT_SECTOR_SIZE;
+        r->err = IDE_checkRequest(r);
+        
+        if(r->err || !r->nlba)
+            continue;
+
+        ch->req = r;
+        ch->lba = r->lba;
+        ch->left = r->nlba;
+        ch->buf = r->buf;
+        ch->state = IDE_STATE_IDLE;
+        ch->progress = timer_timestamp();
+
+        ++(*next);
+        return;
     }
-    IDE_polling(port, false);
-    while(!(inb(port | ATA_PORT_COMSTAT) & ATA_STAT_READY));
-    outb(port | ATA_PORT_COMSTAT, ATA_COMMAND_CACHE_FLUSH);
-    IDE_polling(port, false);
+}
+
+/* executes a batch of requests, requests on different channels run at the same time.
+   On one channel the requests are executed in order. */
+static err_t ide_blk_submit(blkdev_req_t *reqs, uint32_t n)
+{
+    uint32_t next[IDE_CHANNELS] = {0, 0};
+    bool_t busy = TRUE;
+
+    while(busy)
+    {
+        busy = FALSE;
+
+        for(uint8_t c = 0; c < IDE_CHANNELS; ++c)
+        {
+            if(!ide_channels[c].req)
+                IDE_nextRequest(c, reqs, n, &next[c]);
+            
+            if(!ide_channels[c].req)
+                continue;
+
+            busy = TRUE;
+            IDE_step(&ide_channels[c]);
+        }
+
+        __asm__ __volatile__("pause");
+    }
+
+    for(uint32_t i = 0; i < n; ++i)
+        if(reqs[i].err)
+            return reqs[i].err;
 
     return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
-static uint8_t IDE_readPIO28_atapi(uint8_t drive, uint32_t start, uint8_t sctrwrite, uint16_t *buf)
+/* sends IDENTIFY (PACKET) DEVICE to a drive of known type */
+static uint8_t IDE_identify(uint8_t drive, uint16_t *buf)
 {
-    uint8_t read_command[12] = {ATAPI_COMMAND_READ,0,0,0,0,0,0,0,0,0,0};
     uint16_t port = IDE_getPort(drive);
     uint8_t slavebit = IDE_getSlavebit(drive);
-    uint8_t status;
 
     if(drive > 3)
         return EXIT_CODE_IDE_ERROR_READING_DRIVE;
-    if(drive_info_t[drive].type != DRIVE_TYPE_IDE_PATAPI)
+    if(drive_info_t[drive].type == DRIVE_TYPE_UNKNOWN)
         return EXIT_CODE_IDE_ERROR_READING_DRIVE;
 
-    IDEClearFlagBit(IDE_FLAG_IRQ);
-
-    outb(port | ATA_PORT_SELECT,  ((uint8_t)0xE0U) | ((uint8_t)(slavebit << 4U)) | ((((uint8_t)start >> 24U)) & 0x0F));
+    while((inb(port |ATA_PORT_COMSTAT) & ATA_STAT_BUSY));
 
-    outb(port | ATA_PORT_FEATURES, 0U);
-    outb(port | ATA_PORT_LBAMID, (uint8_t) (DEFAULT_ATAPI_SECTOR_SIZE & 0xFF));
-    outb(port | ATA_PORT_LBAHI, (uint8_t) (DEFAULT_ATAPI_SECTOR_SIZE >> 8U));
+    outb(port | ATA_PORT_SELECT, ((uint8_t)0xA0U) | (uint8_t)((slavebit) << 4U));
+    IDE_wait();
 
-    outb(port | ATA_PORT_COMSTAT, ATAPI_COMMAND_PACKET);
-  
-    while(inb(port | ATA_PORT_COMSTAT) & 0x80) __asm__ __volatile__("pause");
-    while(!(status = inb(port | ATA_PORT_COMSTAT) & ATA_STAT_DRQ)) 
-        __asm__ __volatile__("pause");
+    outb(port | ATA_PORT_COMSTAT, (drive_info_t[drive].type == DRIVE_TYPE_IDE_PATAPI) ? ATAPI_IDENTIFY : ATA_IDENTIFY);
 
-    /* error */
-    if(status & 0x01)
+    if(IDE_polling(port, true))
         return EXIT_CODE_IDE_ERROR_READING_DRIVE;
-    
-    read_command[2] = (uint8_t) (start >> 0x18) & 0xFF;
-    read_command[3] = (uint8_t) (start >> 0x10) & 0xFF;
-    read_command[4] = (uint8_t) (start >> 0x08) & 0xFF;
-    read_command[5] = (uint8_t) (start >> 0x00) & 0xFF;
-    read_command[9] = (uint8_t) sctrwrite;
 
-    outsw(port, 6, (uint16_t *) &read_command);
+    insw(port, ATA_IDENT_WORDS, buf);
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/* strings in the IDENTIFY data have their bytes swapped in every word and are padded with spaces */
+static void IDE_identString(const uint16_t *words, uint32_t len, char *out)
+{
+    uint32_t i;
+
+    for(i = 0; i < len; i += 2)
+    {
+        out[i] = (char) (words[i / 2] >> 8);
+        out[i + 1] = (char) (words[i / 2] & 0xFF);
+    }
+
+    out[len] = '\0';
 
-    while(!(ide_flags & IDE_FLAG_IRQ))
-            __asm__ __volatile__("pause");
-    IDEClearFlagBit(IDE_FLAG_IRQ);
+    while(len && (out[len - 1] == ' ' || out[len - 1] == '\0'))
+        out[--len] = '\0';
+}
+
+/* fills in the capability record of a drive from its IDENTIFY data */
+static void IDE_parseIdentify(uint8_t drive)
+{
+    DRIVE_INFO *info = &drive_info_t[drive];
+    const uint16_t *id = info->identify;
+    blkdev_caps_t *caps = &info->caps;
+
+    memset(caps, sizeof(blkdev_caps_t), 0);
+
+    if(info->type == DRIVE_TYPE_UNKNOWN)
+        return;
+
+    caps->max_transfer = IDE_MAX_SECTORS_PER_COMMAND;
+
+    IDE_identString(&id[ATA_IDENT_MODEL], BLKDEV_MODEL_LEN, caps->model);
+    IDE_identString(&id[ATA_IDENT_SERIAL], BLKDEV_SERIAL_LEN, caps->serial);
+
+    /* DMA supported (capabilities bit 8), word 63 and 88 list the modes */
+    if(id[ATA_IDENT_CAPABILITIES] & (1U << 8))
+    {
+        caps->flags = (uint8_t) (caps->flags | BLKDEV_CAP_DMA);
+        caps->mwdma_modes = (uint8_t) (id[ATA_IDENT_MWDMA] & 0x07);
+        caps->udma_modes = (uint8_t) (id[ATA_IDENT_UDMA] & 0x7F);
+    }
+
+    if(info->type == DRIVE_TYPE_IDE_PATAPI)
+    {
+        /* the capacity of the medium is not part of IDENTIFY PACKET DEVICE */
+        caps->sector_size = DEFAULT_ATAPI_SECTOR_SIZE;
+        caps->max_transfer = ATAPI_MAX_SECTORS_PER_COMMAND;
+        caps->flags = (uint8_t) (caps->flags | BLKDEV_CAP_REMOVABLE);
+        return;
+    }
+
+    caps->flags = (uint8_t) (caps->flags | BLKDEV_CAP_WRITE | BLKDEV_CAP_FLUSH);
+
+    /* bit 8 says the low byte holds the current multiple count */
+    if(id[ATA_IDENT_MULTIPLE_CUR] & (1U << 8))
+        caps->multi_sectors = (uint8_t) (id[ATA_IDENT_MULTIPLE_CUR] & 0xFF);
+
+    if(id[ATA_IDENT_CMDSET_EN] & (1U << 5))
+        caps->flags = (uint8_t) (caps->flags | BLKDEV_CAP_WRITE_CACHE);
     
-    uint32_t size = (uint32_t)(inb(port | ATA_PORT_LBAHI) << 8U) | inb(port | ATA_PORT_LBAMID);
-    uint32_t nwords = size / 2;
-    uint32_t counter = 0;
+    /* sector count, the LBA48 count when the drive supports it */
+    uint32_t nsectors = (uint32_t) id[ATA_IDENT_LBA28] | ((uint32_t) id[ATA_IDENT_LBA28 + 1] << 16);
 
-    while ((inb(port | ATA_PORT_COMSTAT) & (ATA_STAT_BUSY | ATA_STAT_DRQ)))
+    if(id[ATA_IDENT_CMDSET_SUP2] & (1U << 10))
     {
-        insw(port, (uint32_t)nwords, &buf[counter]);
-        counter = counter + nwords;
-     
-        while (!(ide_flags & IDE_FLAG_IRQ))
-            __asm__ __volatile__("pause");
-        IDEClearFlagBit(IDE_FLAG_IRQ);
+        caps->flags = (uint8_t) (caps->flags | BLKDEV_CAP_LBA48);
+
+        /* anything beyond 32 bits is out of reach anyway */
+        if(id[ATA_IDENT_LBA48 + 2] || id[ATA_IDENT_LBA48 + 3])
+            nsectors = MAX;
+        else
+            nsectors = (uint32_t) id[ATA_IDENT_LBA48] | ((uint32_t) id[ATA_IDENT_LBA48 + 1] << 16);
+    }
+
+    /* this driver only does LBA28 */
+    if(nsectors > ATA_LBA28_MAX_SECTORS)
+        nsectors = ATA_LBA28_MAX_SECTORS;
+
+    caps->max_lba = (nsectors) ? nsectors - 1 : 0;
+
+    /* logical sectors larger than 512 bytes (word 106: bit 14 valid, bit 12 large logical sectors) */
+    caps->sector_size = DEFAULT_SECTOR_SIZE;
+
+    if((id[ATA_IDENT_SECTOR_INFO] & 0xC000) == 0x4000 && (id[ATA_IDENT_SECTOR_INFO] & (1U << 12)))
+    {
+        uint32_t words = (uint32_t) id[ATA_IDENT_SECTOR_SIZE] | ((uint32_t) id[ATA_IDENT_SECTOR_SIZE + 1] << 16);
+        caps->sector_size = (words) ? words * 2 : DEFAULT_SECTOR_SIZE;
     }
-        
-    return EXIT_CODE_GLOBAL_SUCCESS;
 }
 
 static void IDE_reportDrives(uint8_t *drive_list)
@@ -598,3 +959,60 @@ static void IDE_reportDrives(uint8_t *drive_list)
     for(; i < IDE_DRIVER_MAX_DRIVES; ++i)
         drive_list[i] = drive_info_t[i].type;
 }
+
+/* block device operations, these split requests that are too large for a single command */
+static err_t ide_blk_read(uint8_t unit, uint32_t lba, uint32_t nlba, uint8_t *buf)
+{
+    blkdev_req_t r = {.unit = unit, .write = FALSE, .lba = lba, .nlba = nlba, .buf = buf};
+
+    return ide_blk_submit(&r, 1);
+}
+
+static err_t ide_blk_write(uint8_t unit, uint32_t lba, uint32_t nlba, const uint8_t *buf)
+{
+    blkdev_req_t r = {.unit = unit, .write = TRUE, .lba = lba, .nlba = nlba, .buf = (uint8_t *) ((uint32_t) buf)};
+
+    return ide_blk_submit(&r, 1);
+}
+
+static err_t ide_blk_flush(uint8_t unit)
+{
+    if(unit >= IDE_DRIVER_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    return IDE_flush(unit);
+}
+
+static err_t ide_blk_identify(uint8_t unit, uint16_t *buf)
+{
+    if(unit >= IDE_DRIVER_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    if(drive_info_t[unit].type == DRIVE_TYPE_UNKNOWN)
+        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
+
+    memcpy(buf, drive_info_t[unit].identify, BLKDEV_IDENTIFY_SIZE);
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+static err_t ide_blk_caps(uint8_t unit, blkdev_caps_t *caps)
+{
+    if(unit >= IDE_DRIVER_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    if(drive_info_t[unit].type == DRIVE_TYPE_UNKNOWN)
+        return EXIT_CODE_IDE_ERROR_READING_DRIVE;
+
+    *caps = drive_info_t[unit].caps;
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+static void IDE_getBlkdevOps(blkdev_ops_t *ops)
+{
+    ops->read = ide_blk_read;
+    ops->write = ide_blk_write;
+    ops->flush = ide_blk_flush;
+    ops->identify = ide_blk_identify;
+    ops->caps = ide_blk_caps;
+    ops->submit = ide_blk_submit;
+}
@@ -81,6 +81,14 @@ SOFTWARE.
 	parameter2 max relative address
 */ 
 
+#define IDE_COMMAND_GET_BLKDEV_OPS	0x14
+/*
+	fills in the block device operations (see dsk/blkdev.h) of the driver, so that the disk
+	layer can call the driver directly instead of through command packets
+
+	parameter1: pointer to a blkdev_ops_t
+*/
+
 #ifndef IDE_DRIVER_MAX_DRIVES
 #define IDE_DRIVER_MAX_DRIVES   4
 #endif
@@ -0,0 +1,332 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "aio.h"
+#include "diskio.h"
+#include "ioqueue.h"
+#include "mbr.h"
+
+#include "../include/types.h"
+#include "../include/exit_code.h"
+
+#include "../dsk/diskdefines.h"
+
+#include "../memory/paging.h"
+
+#include "../exec/prog.h"
+
+#include "../util/util.h"
+
+#include "../api/api.h"
+#include "../api/syscalls.h"
+
+typedef struct aio_syscall_t
+{
+    syscall_hdr_t hdr;
+    aio_ring_t *ring;
+    size_t ring_size;
+    uint32_t min_complete;
+} __attribute__((packed)) aio_syscall_t;
+
+typedef struct aio_ctx_t
+{
+    pid_t pid;
+    aio_ring_t *ring;
+} aio_ctx_t;
+
+// a submission that has been handled but not yet completed
+typedef struct aio_done_t
+{
+    uint32_t user_data;
+    uint32_t nlba;
+    uint8_t drive;
+    uint8_t opcode;
+    err_t result;
+} aio_done_t;
+
+aio_ctx_t aio_ctx[AIO_MAX_RINGS];
+
+static aio_ctx_t *aio_find_ctx(pid_t pid)
+{
+    for(uint32_t i = 0; i < AIO_MAX_RINGS; ++i)
+        if(aio_ctx[i].ring && aio_ctx[i].pid == pid)
+            return &aio_ctx[i];
+
+    return NULL;
+}
+
+static aio_ctx_t *aio_find_free_ctx(void)
+{
+    for(uint32_t i = 0; i < AIO_MAX_RINGS; ++i)
+    {
+        // rings of programs that have since terminated are released here
+        if(aio_ctx[i].ring && !prog_pid_exists(aio_ctx[i].pid))
+            aio_ctx[i].ring = NULL;
+
+        if(!aio_ctx[i].ring)
+            return &aio_ctx[i];
+    }
+
+    return NULL;
+}
+
+// the ring lives in program memory, so check it again on every use
+static bool_t aio_ring_valid(aio_ring_t *ring, size_t size, pid_t pid)
+{
+    if(!paging_check_owner(ring, sizeof(aio_ring_t), pid))
+        return FALSE;
+    
+    uint32_t n = ring->entries;
+
+    if(!n || n > AIO_MAX_ENTRIES || (n & (n - 1)))
+        return FALSE;
+
+    if(size < AIO_RING_SIZE(n))
+        return FALSE;
+
+    return paging_check_owner(ring, AIO_RING_SIZE(n), pid);
+}
+
+/**
+ * @brief Validates a single submission and starts it. Writes end up in the (plugged) request 
+ *        queue of the drive, reads are collected in `rd` so that they can be executed as one batch.
+ * 
+ * @param sqe Submission entry
+ * @param pid Program that submitted the entry
+ * @param d Out: drive, opcode and result of the submission
+ * @param rd Out: the read to execute, `rd->nlba` is 0 if there is nothing to read
+ * @param plugged Bitmap of drives that have been plugged for this batch
+ */
+static void aio_handle_sqe(aio_sqe_t *sqe, pid_t pid, aio_done_t *d, blkdev_req_t *rd, uint32_t *plugged)
+{
+    rd->nlba = 0;
+
+    d->user_data = sqe->user_data;
+    d->opcode = sqe->opcode;
+    d->drive = 0xFF;
+    d->nlba = 0;
+
+    char id[DISKIO_MAX_LEN_DISKID + 1];
+    memcpy(id, sqe->drive, DISKIO_MAX_LEN_DISKID);
+    id[DISKIO_MAX_LEN_DISKID] = '\0';
+
+    if(sqe->opcode != AIO_OP_READ && sqe->opcode != AIO_OP_WRITE)
+        { d->result = EXIT_CODE_GLOBAL_INVALID; return; }
+    if(!diskio_check_exists(id))
+        { d->result = EXIT_CODE_GLOBAL_OUT_OF_RANGE; return; }
+    
+    uint16_t did = drive_convert_drive_id(id);
+    uint8_t drive = (uint8_t) ((did >> DISKIO_DISK_NUMBER) & 0xFF);
+    uint8_t part = (uint8_t) ((did >> DISKIO_PART_NUMBER) & 0xFF);
+    uint8_t type = drive_type(id);
+
+    if(sqe->opcode == AIO_OP_WRITE && type == DRIVE_TYPE_IDE_PATAPI)
+        { d->result = EXIT_CODE_GLOBAL_UNSUPPORTED; return; }
+    
+    size_t size = sqe->nlba * disk_get_sector_size(drive);
+
+    if(!sqe->nlba || (size / sqe->nlba) != disk_get_sector_size(drive))
+        { d->result = EXIT_CODE_GLOBAL_OUT_OF_RANGE; return; }
+    if(!paging_check_owner(sqe->buffer, size, pid))
+        { d->result = EXIT_CODE_GLOBAL_RESERVED; return; }
+
+    uint32_t lba = sqe->lba;
+
+    if(type != DRIVE_TYPE_IDE_PATAPI && part != 0xFF)
+        lba = lba + MBR_getStartLBA(drive, part);
+    
+    d->drive = drive;
+    d->nlba = sqe->nlba;
+    d->result = EXIT_CODE_GLOBAL_SUCCESS;
+
+    if(sqe->opcode == AIO_OP_READ)
+    {
+        rd->unit = drive;
+        rd->write = FALSE;
+        rd->lba = lba;
+        rd->nlba = sqe->nlba;
+        rd->buf = (uint8_t *) sqe->buffer;
+        return;
+    }
+
+    if(!(*plugged & (1U << drive)))
+        { ioqueue_plug(drive); *plugged = *plugged | (1U << drive); }
+
+    d->result = write(drive, lba, sqe->nlba, (uint8_t *) sqe->buffer);
+}
+
+/**
+ * @brief Consumes up to AIO_MAX_BATCH submissions and posts their completions. Reads in the 
+ *        batch are executed together, so drives on different channels work at the same time. 
+ *        Writes in the batch are merged and sorted by the request queue; a write is completed 
+ *        once the queues of all drives written to have been flushed (again all at once).
+ *        Submissions in one batch are not ordered with respect to each other.
+ * 
+ * @param ring Shared ring
+ * @param pid Program that owns the ring
+ * @return uint32_t Number of submissions consumed
+ */
+static uint32_t aio_submit_batch(aio_ring_t *ring, pid_t pid)
+{
+    aio_done_t done[AIO_MAX_BATCH];
+    blkdev_req_t reads[AIO_MAX_BATCH];
+    uint32_t index[AIO_MAX_BATCH];     // done[] entry of every read
+    uint32_t nreads = 0, plugged = 0;
+    err_t flush_err[DISKIO_MAX_DRIVES];
+
+    uint32_t mask = ring->entries - 1;
+    uint32_t pending = ring->sq_tail - ring->sq_head;
+    uint32_t space = ring->entries - (ring->cq_tail - ring->cq_head);
+    uint32_t n = (pending < space) ? pending : space;
+
+    if(n > AIO_MAX_BATCH)
+        n = AIO_MAX_BATCH;
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        aio_handle_sqe(&AIO_RING_SQ(ring)[(ring->sq_head + i) & mask], pid, &done[i], &reads[nreads], &plugged);
+
+        if(reads[nreads].nlba)
+            index[nreads++] = i;
+    }
+    
+    ring->sq_head = ring->sq_head + n;
+
+    if(nreads)
+        diskio_device_submit(reads, nreads);
+    
+    for(uint32_t i = 0; i < nreads; ++i)
+    {
+        aio_done_t *d = &done[index[i]];
+        
+        d->result = reads[i].err;
+        d->nlba = (d->result) ? 0 : reads[i].nlba;
+
+        // writes of this batch that are still queued
+        ioqueue_read_overlay(reads[i].unit, reads[i].lba, reads[i].nlba, reads[i].buf);
+    }
+
+    ioqueue_unplug_drives(plugged, flush_err);
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        aio_cqe_t *cqe = &AIO_RING_CQ(ring)[ring->cq_tail & mask];
+
+        if(done[i].opcode == AIO_OP_WRITE && done[i].drive != 0xFF && flush_err[done[i].drive])
+            done[i].result = (done[i].result) ? done[i].result : flush_err[done[i].drive];
+        
+        if(done[i].result)
+            done[i].nlba = 0;
+
+        cqe->user_data = done[i].user_data;
+        cqe->nlba = done[i].nlba;
+        cqe->result = done[i].result;
+
+        ring->cq_tail = ring->cq_tail + 1;
+    }
+
+    return n;
+}
+
+/**
+ * @brief API handler for asynchronous disk I/O. A program registers a ring (SETUP), queues 
+ *        requests in it and hands them to the kernel (SUBMIT), and collects the results from 
+ *        the completion queue whenever it likes.
+ * 
+ *        NOTE: the kernel is mono-tasking, so submissions are completed before SUBMIT returns. 
+ *        A wait for completions therefore never blocks; the completions are already posted, 
+ *        unless the completion queue filled up, in which case the remaining submissions
+ *        stay queued until the program has reaped completions and submits again.
+ * 
+ * @param req Pointer to API request
+ */
+void aio_api(void *req)
+{
+    aio_syscall_t *c = (aio_syscall_t *) req;
+    pid_t pid = prog_get_current_running();
+
+    c->hdr.exit_code = EXIT_CODE_GLOBAL_SUCCESS;
+
+    switch(c->hdr.system_call)
+    {
+        case SYSCALL_DISK_AIO_SETUP:
+        {
+            if(!aio_ring_valid(c->ring, c->ring_size, pid))
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; break; }
+            
+            aio_ctx_t *ctx = aio_find_ctx(pid);
+            ctx = (ctx) ? ctx : aio_find_free_ctx();
+
+            if(!ctx)
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; break; }
+            
+            c->ring->sq_head = c->ring->sq_tail = 0;
+            c->ring->cq_head = c->ring->cq_tail = 0;
+
+            ctx->pid = pid;
+            ctx->ring = c->ring;
+            break;
+        }
+
+        case SYSCALL_DISK_AIO_SUBMIT:
+        {
+            aio_ctx_t *ctx = aio_find_ctx(pid);
+
+            if(!ctx)
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_NOT_INITIALIZED; break; }
+            if(!aio_ring_valid(ctx->ring, AIO_RING_SIZE(ctx->ring->entries), pid))
+                { ctx->ring = NULL; c->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; break; }
+            
+            aio_ring_t *ring = ctx->ring;
+
+            if((ring->sq_tail - ring->sq_head) > ring->entries || (ring->cq_tail - ring->cq_head) > ring->entries)
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; break; }
+            
+            uint32_t total = 0, n;
+
+            while((n = aio_submit_batch(ring, pid)))
+                total = total + n;
+
+            c->hdr.response = total;
+
+            if((ring->cq_tail - ring->cq_head) < c->min_complete)
+                c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+            break;
+        }
+
+        case SYSCALL_DISK_AIO_DESTROY:
+        {
+            aio_ctx_t *ctx = aio_find_ctx(pid);
+
+            if(!ctx)
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_NOT_INITIALIZED; break; }
+            
+            ctx->ring = NULL;
+            break;
+        }
+
+        default:
+            c->hdr.exit_code = EXIT_CODE_GLOBAL_NOT_IMPLEMENTED;
+        break;
+    }
+}
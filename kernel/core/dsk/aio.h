@@ -0,0 +1,74 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __AIO_H__
+#define __AIO_H__
+
+#include "../include/types.h"
+#include "diskio.h"
+
+#define AIO_MAX_RINGS           8U      // programs that can have a ring at once
+#define AIO_MAX_ENTRIES         256U    // per ring, must be a power of two
+#define AIO_MAX_BATCH           32U     // submissions handled under one plug
+
+#define AIO_OP_READ             0x01
+#define AIO_OP_WRITE            0x02
+
+// submission queue entry, filled in by the program
+typedef struct aio_sqe_t
+{
+    uint8_t opcode;
+    char drive[DISKIO_MAX_LEN_DISKID];
+    uint32_t lba;
+    uint32_t nlba;
+    void *buffer;           // owned by the program, nlba * sector size bytes
+    uint32_t user_data;     // copied to the completion
+} __attribute__((packed)) aio_sqe_t;
+
+// completion queue entry, filled in by the kernel
+typedef struct aio_cqe_t
+{
+    uint32_t user_data;
+    uint32_t nlba;          // sectors transferred
+    err_t result;
+} __attribute__((packed)) aio_cqe_t;
+
+// Shared ring, allocated by the program. The submission queue is produced by the program 
+// (sq_tail) and consumed by the kernel (sq_head), the completion queue the other way around.
+// The header is followed by `entries` submission and `entries` completion entries.
+typedef struct aio_ring_t
+{
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+} __attribute__((packed)) aio_ring_t;
+
+#define AIO_RING_SQ(r)          ((aio_sqe_t *) (((uint8_t *) (r)) + sizeof(aio_ring_t)))
+#define AIO_RING_CQ(r)          ((aio_cqe_t *) (AIO_RING_SQ(r) + (r)->entries))
+#define AIO_RING_SIZE(n)        (sizeof(aio_ring_t) + (n) * (sizeof(aio_sqe_t) + sizeof(aio_cqe_t)))
+
+void aio_api(void *req);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __BLKDEV_H__
+#define __BLKDEV_H__
+
+#include "../include/types.h"
+
+#define BLKDEV_IDENTIFY_SIZE    512 // bytes
+
+#define BLKDEV_MODEL_LEN        40  // characters
+#define BLKDEV_SERIAL_LEN       20  // characters
+
+// blkdev_caps_t.flags
+#define BLKDEV_CAP_WRITE        1U << 0
+#define BLKDEV_CAP_FLUSH        1U << 1
+#define BLKDEV_CAP_REMOVABLE    1U << 2
+#define BLKDEV_CAP_LBA48        1U << 3
+#define BLKDEV_CAP_WRITE_CACHE  1U << 4 // write cache enabled
+#define BLKDEV_CAP_DMA          1U << 5
+#define BLKDEV_CAP_MEMORY       1U << 6 // backed by memory, caching its sectors gains nothing
+
+typedef struct blkdev_caps_t
+{
+    uint32_t sector_size;       // bytes
+    uint32_t max_lba;           // last addressable sector (0 if unknown)
+    uint32_t max_transfer;      // sectors per read/write call the device handles at once
+    uint8_t multi_sectors;      // sectors per DRQ block in READ/WRITE MULTIPLE (0 if unsupported)
+    uint8_t mwdma_modes;        // supported multiword DMA modes (bit n is mode n)
+    uint8_t udma_modes;         // supported ultra DMA modes (bit n is mode n)
+    uint8_t flags;
+    char model[BLKDEV_MODEL_LEN + 1];
+    char serial[BLKDEV_SERIAL_LEN + 1];
+} blkdev_caps_t;
+
+// a request in a batch handed to blkdev_ops_t.submit
+typedef struct blkdev_req_t
+{
+    uint8_t unit;
+    bool_t write;
+    err_t err;                  // set by the driver
+    uint32_t lba;
+    uint32_t nlba;
+    uint8_t *buf;
+} blkdev_req_t;
+
+// Operations of a block device, filled in by its driver. `unit` is the drive number
+// as known to the driver. Operations a device does not support are left NULL.
+typedef struct blkdev_ops_t
+{
+    err_t (*read)(uint8_t unit, uint32_t lba, uint32_t nlba, uint8_t *buf);
+    err_t (*write)(uint8_t unit, uint32_t lba, uint32_t nlba, const uint8_t *buf);
+    err_t (*flush)(uint8_t unit);
+    err_t (*identify)(uint8_t unit, uint16_t *buf);     // BLKDEV_IDENTIFY_SIZE bytes
+    err_t (*caps)(uint8_t unit, blkdev_caps_t *caps);
+    
+    // executes a batch of requests, overlapping those the hardware can do at the same time; 
+    // returns the first error
+    err_t (*submit)(blkdev_req_t *reqs, uint32_t n);
+} blkdev_ops_t;
+
+#endif
@@ -24,6 +24,8 @@ SOFTWARE.
 #include "bootdisk.h"
 #include "diskio.h"
 #include "diskdefines.h"
+#include "mbr.h"
+#include "ramdisk.h"
 
 #include "../boot/loader.h"
 #include "../memory/memory.h"
@@ -43,6 +45,10 @@ char *bootdisk(void)
 
     char *id = NULL;
 
+    // when there is a RAM disk, it was loaded to run the system from
+    if(ramdisk_present() && (id = bootdisk_ramdisk_drive_number()))
+        return id;
+
     if(type < HARDDISK) // Floppy
         return NULL; // not implemented
     else if(type >= HARDDISK && type != CD_DRIVE) // hard disk
@@ -97,3 +103,30 @@ char *bootdisk_cddrive_drive_number(void)
 
     return id;
 }
+
+char *bootdisk_ramdisk_drive_number(void)
+{
+    // the first partition with a file system on it
+    uint8_t part = 0;
+
+    for(; part < MBR_MAX_PARTITIONS; ++part)
+    {
+        uint8_t fs = mbr_get_type(RAMDISK_DRIVE, part);
+
+        if(fs && fs != 0xFF)
+            break;
+    }
+
+    if(part >= MBR_MAX_PARTITIONS)
+        return NULL;
+
+    char *id = kmalloc(DRIVE_ID_BUFFER_SIZE);
+    drive_convert_to_drive_id(RAMDISK_DRIVE, id);
+
+    // add the partition number to the drive id
+    id[strlen(id)] = 'P';
+    char *p = intstr(part);
+    memcpy(&id[strlen(id)], p, strlen(p));
+
+    return id;
+}
@@ -29,5 +29,6 @@ SOFTWARE.
 char *bootdisk(void);
 char *bootdisk_harddisk_drive_number(const uint8_t type, const uint8_t part);
 char *bootdisk_cddrive_drive_number(void);
+char *bootdisk_ramdisk_drive_number(void);
 
 #endif
@@ -24,6 +24,7 @@ SOFTWARE.
 #include "cd.h"
 #include "diskdefines.h"
 #include "diskio.h"
+#include "readahead.h"
 
 #include "../hardware/driver.h"
 
@@ -32,8 +33,77 @@ SOFTWARE.
 #include "../drv/FS_TYPES.H"
 
 #include "../include/types.h"
+#include "../include/exit_code.h"
 
 #include "../memory/memory.h"
+#include "../memory/paging.h"
+
+#include "../exec/task.h"
+
+#include "../util/util.h"
+
+// Cache for the sectors of CD drives. The medium can't be written, so entries are
+// never invalidated; only the small reads of the ISO driver (directories, path tables)
+// are cached.
+typedef struct cd_cache_entry_t
+{
+    uint8_t drive;
+    bool_t valid;
+    uint32_t lba;
+    uint32_t last_used;
+    uint8_t *data;
+} cd_cache_entry_t;
+
+cd_cache_entry_t cd_cache[CD_CACHE_SETS][CD_CACHE_WAYS];
+uint32_t cd_cache_clock = 0;
+
+static void cd_cache_init(void)
+{
+    uint8_t *buffer = evalloc(CD_CACHE_SETS * CD_CACHE_WAYS * ATAPI_DEFAULT_SECTOR_SIZE, PID_KERNEL);
+
+    // without a cache reads simply go to the drive
+    if(!buffer)
+        return;
+    
+    for(uint32_t set = 0; set < CD_CACHE_SETS; ++set)
+        for(uint32_t way = 0; way < CD_CACHE_WAYS; ++way)
+        {
+            cd_cache[set][way].valid = FALSE;
+            cd_cache[set][way].data = buffer;
+            buffer = buffer + ATAPI_DEFAULT_SECTOR_SIZE;
+        }
+}
+
+static cd_cache_entry_t *cd_cache_find(uint8_t drive, uint32_t lba)
+{
+    cd_cache_entry_t *set = cd_cache[lba % CD_CACHE_SETS];
+
+    for(uint32_t way = 0; way < CD_CACHE_WAYS; ++way)
+        if(set[way].valid && set[way].drive == drive && set[way].lba == lba)
+            return &set[way];
+    
+    return NULL;
+}
+
+static void cd_cache_insert(uint8_t drive, uint32_t lba, const uint8_t *data)
+{
+    cd_cache_entry_t *set = cd_cache[lba % CD_CACHE_SETS];
+    cd_cache_entry_t *victim = &set[0];
+
+    for(uint32_t way = 0; way < CD_CACHE_WAYS; ++way)
+    {
+        if(!set[way].valid)
+            { victim = &set[way]; break; }
+        if(set[way].last_used < victim->last_used)
+            victim = &set[way];
+    }
+
+    victim->drive = drive;
+    victim->lba = lba;
+    victim->valid = TRUE;
+    victim->last_used = ++cd_cache_clock;
+    memcpy(victim->data, (void *) data, ATAPI_DEFAULT_SECTOR_SIZE);
+}
 
 
 // initializes CD drives (currently only the filesystem driver)
@@ -45,6 +115,8 @@ void cd_init(void)
     if(!cd_check_exists(drives))
     { kfree(drives); return; }
 
+    cd_cache_init();
+
     // search for/register the driver
     driver_addInternalDriver((FS_TYPE_ISO | DRIVER_TYPE_FS));
     uint32_t *drv = kmalloc(DRIVER_COMMAND_PACKET_LEN * sizeof(uint32_t));
@@ -77,4 +149,47 @@ uint8_t cd_check_exists(uint8_t *drives)
     }
     
     return FALSE;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Reads sectors from a CD drive, from the sector cache if all of them are in there
+ * 
+ * @param drive drive number
+ * @param lba sector number
+ * @param nlba amount of sectors to read
+ * @param buf output buffer for content
+ * @return uint8_t exit code (any error by driver)
+ */
+uint8_t cd_cache_read(uint8_t drive, uint32_t lba, uint32_t nlba, uint8_t *buf)
+{
+    uint32_t i;
+
+    if(!cd_cache[0][0].data)
+        return readahead_read(drive, lba, nlba, buf);
+
+    for(i = 0; i < nlba; ++i)
+    {
+        cd_cache_entry_t *e = cd_cache_find(drive, lba + i);
+
+        if(!e)
+            break;
+        
+        e->last_used = ++cd_cache_clock;
+        memcpy(buf + i * ATAPI_DEFAULT_SECTOR_SIZE, e->data, ATAPI_DEFAULT_SECTOR_SIZE);
+    }
+
+    if(i == nlba)
+        return EXIT_CODE_GLOBAL_SUCCESS;
+    
+    // a single miss means a read of the whole range, in one command
+    uint8_t err = readahead_read(drive, lba, nlba, buf);
+
+    if(err || nlba > CD_CACHE_MAX_FILL)
+        return err;
+    
+    for(i = 0; i < nlba; ++i)
+        if(!cd_cache_find(drive, lba + i))
+            cd_cache_insert(drive, lba + i, buf + i * ATAPI_DEFAULT_SECTOR_SIZE);
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
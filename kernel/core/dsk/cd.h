@@ -24,7 +24,12 @@ SOFTWARE.
 #ifndef __CD_H__
 #define __CD_H__
 
+#define CD_CACHE_SETS       16U
+#define CD_CACHE_WAYS       4U
+#define CD_CACHE_MAX_FILL   8U  // sectors, larger reads (file contents) are not cached
+
 void cd_init(void);
 unsigned char cd_check_exists(unsigned char *drives);
+unsigned char cd_cache_read(unsigned char drive, unsigned int lba, unsigned int nlba, unsigned char *buf);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+/*
+MIT license
+Copyright (c) 2019-2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "dcache.h"
+
+#include "../include/types.h"
+
+#include "../util/util.h"
+
+// Cache of path components that have been looked up by the file system drivers. An entry is
+// keyed by (drive, partition, parent directory, name), where the parent directory is whatever
+// the driver uses to identify it (first cluster, LBA). The driver stores the directory entry it
+// found as data, entries without data are negative (the name does not exist in the directory).
+// Drivers invalidate entries when they change a directory.
+typedef struct dcache_entry_t
+{
+    uint8_t drive;
+    uint8_t part;
+    bool_t valid;
+    bool_t negative;
+    uint32_t parent;
+    uint32_t last_used;
+    char name[DCACHE_NAME_LEN + 1];
+    uint32_t size;  // of data
+    uint8_t data[DCACHE_DATA_SIZE];
+} dcache_entry_t;
+
+dcache_entry_t dcache[DCACHE_SETS][DCACHE_WAYS];
+uint32_t dcache_clock = 0;
+
+static uint32_t dcache_hash(uint8_t drive, uint8_t part, uint32_t parent, const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U ^ ((uint32_t) drive << 8 | part);
+    hash = (hash ^ parent) * 16777619U;
+
+    for(uint32_t i = 0; name[i]; ++i)
+        hash = (hash ^ (uint8_t) name[i]) * 16777619U;
+
+    return hash % DCACHE_SETS;
+}
+
+static dcache_entry_t *dcache_find(uint8_t drive, uint8_t part, uint32_t parent, const char *name)
+{
+    dcache_entry_t *set = dcache[dcache_hash(drive, part, parent, name)];
+
+    for(uint32_t way = 0; way < DCACHE_WAYS; ++way)
+        if(set[way].valid && set[way].parent == parent && set[way].drive == drive && set[way].part == part &&
+            !strcmp(set[way].name, name))
+            return &set[way];
+
+    return NULL;
+}
+
+/**
+ * @brief Looks up a name in a directory
+ * 
+ * @param drive drive number
+ * @param part partition number
+ * @param parent the directory (as identified by the driver)
+ * @param name name within the directory
+ * @param data output for the cached directory entry (only on DCACHE_HIT)
+ * @return uint8_t DCACHE_HIT, DCACHE_NEGATIVE or DCACHE_MISS
+ */
+uint8_t dcache_lookup(uint8_t drive, uint8_t part, uint32_t parent, const char *name, void *data)
+{
+    if(strlen(name) > DCACHE_NAME_LEN)
+        return DCACHE_MISS;
+
+    dcache_entry_t *entry = dcache_find(drive, part, parent, name);
+
+    if(!entry)
+        return DCACHE_MISS;
+
+    entry->last_used = ++dcache_clock;
+
+    if(entry->negative)
+        return DCACHE_NEGATIVE;
+    
+    memcpy(data, &entry->data[0], entry->size);
+    return DCACHE_HIT;
+}
+
+/**
+ * @brief Caches the result of a lookup
+ * 
+ * @param drive drive number
+ * @param part partition number
+ * @param parent the directory (as identified by the driver)
+ * @param name name within the directory
+ * @param data directory entry that was found, NULL if the name does not exist
+ * @param size size of data (at most DCACHE_DATA_SIZE)
+ */
+void dcache_insert(uint8_t drive, uint8_t part, uint32_t parent, const char *name, const void *data, uint32_t size)
+{
+    uint32_t len = strlen(name);
+
+    if(len > DCACHE_NAME_LEN || size > DCACHE_DATA_SIZE)
+        return;
+
+    dcache_entry_t *set = dcache[dcache_hash(drive, part, parent, name)];
+    dcache_entry_t *victim = dcache_find(drive, part, parent, name);
+
+    for(uint32_t way = 0; way < DCACHE_WAYS && !victim; ++way)
+        if(!set[way].valid)
+            victim = &set[way];
+    
+    if(!victim)
+    {
+        victim = &set[0];
+
+        for(uint32_t way = 1; way < DCACHE_WAYS; ++way)
+            if(set[way].last_used < victim->last_used)
+                victim = &set[way];
+    }
+
+    victim->drive = drive;
+    victim->part = part;
+    victim->parent = parent;
+    victim->valid = TRUE;
+    victim->negative = (data) ? FALSE : TRUE;
+    victim->last_used = ++dcache_clock;
+    victim->size = (data) ? size : 0;
+    memcpy(&victim->name[0], name, len + 1);
+
+    if(data)
+        memcpy(&victim->data[0], data, size);
+}
+
+/**
+ * @brief Forgets what is known about a name in a directory, for when it is created, changed or removed
+ * 
+ * @param drive drive number
+ * @param part partition number
+ * @param parent the directory (as identified by the driver)
+ * @param name name within the directory
+ */
+void dcache_invalidate(uint8_t drive, uint8_t part, uint32_t parent, const char *name)
+{
+    dcache_entry_t *entry = dcache_find(drive, part, parent, name);
+
+    if(entry)
+        entry->valid = FALSE;
+}
+
+/**
+ * @brief Forgets everything about a partition
+ * 
+ * @param drive drive number
+ * @param part partition number
+ */
+void dcache_invalidate_part(uint8_t drive, uint8_t part)
+{
+    for(uint32_t set = 0; set < DCACHE_SETS; ++set)
+        for(uint32_t way = 0; way < DCACHE_WAYS; ++way)
+            if(dcache[set][way].drive == drive && dcache[set][way].part == part)
+                dcache[set][way].valid = FALSE;
+}
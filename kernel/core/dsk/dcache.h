@@ -0,0 +1,42 @@
+/*
+MIT license
+Copyright (c) 2019-2021 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __DCACHE_H__
+#define __DCACHE_H__
+
+#define DCACHE_SETS         64U
+#define DCACHE_WAYS         4U
+#define DCACHE_NAME_LEN     31U // longer names are not cached
+#define DCACHE_DATA_SIZE    40U // bytes, fits the directory entry of every file system driver
+
+// results of dcache_lookup()
+#define DCACHE_MISS         0
+#define DCACHE_HIT          1
+#define DCACHE_NEGATIVE     2   // known not to exist
+
+unsigned char dcache_lookup(unsigned char drive, unsigned char part, unsigned int parent, const char *name, void *data);
+void dcache_insert(unsigned char drive, unsigned char part, unsigned int parent, const char *name, const void *data, unsigned int size);
+void dcache_invalidate(unsigned char drive, unsigned char part, unsigned int parent, const char *name);
+void dcache_invalidate_part(unsigned char drive, unsigned char part);
+
+#endif
@@ -26,9 +26,14 @@ SOFTWARE.
 
 #define DRIVE_TYPE_IDE_PATA    0x00
 #define DRIVE_TYPE_IDE_PATAPI  0x01
+#define DRIVE_TYPE_RAMDISK     0x02
 #define DRIVE_TYPE_UNKNOWN     0xFF
 
 #define IDE_DRIVER_MAX_DRIVES   4
-#define MAX_DRIVES    IDE_DRIVER_MAX_DRIVES
+#define RAMDISK_DRIVE           IDE_DRIVER_MAX_DRIVES // drive number of the RAM disk, after the IDE drives
+#define MAX_DRIVES    (IDE_DRIVER_MAX_DRIVES + 1)
+
+// drives that are partitioned with an MBR (i.e. hard disk like drives)
+#define DRIVE_TYPE_HAS_MBR(t)  ((t) == DRIVE_TYPE_IDE_PATA || (t) == DRIVE_TYPE_RAMDISK)
 
 #endif
@@ -25,6 +25,13 @@ SOFTWARE.
 
 #include "mbr.h"
 #include "bootdisk.h"
+#include "cd.h"
+#include "readahead.h"
+#include "ioqueue.h"
+#include "aio.h"
+#include "ramdisk.h"
+#include "iostat.h"
+#include "blkdev.h"
 
 #include "../include/types.h"
 #include "../dsk/diskdefines.h"
@@ -32,6 +39,7 @@ SOFTWARE.
 
 #include "../hardware/driver.h"
 #include "../hardware/pci.h"
+#include "../hardware/timer.h"
 
 #include "../memory/memory.h"
 #include "../memory/paging.h"
@@ -79,6 +87,11 @@ typedef struct{
 
 DISKINFO disk_info_t[DISKIO_MAX_DRIVES];
 
+// operations of the driver that handles each drive, resolved once by diskio_init()
+blkdev_ops_t disk_ops[DISKIO_MAX_DRIVES];
+// capabilities of each drive, as reported by its driver during diskio_init()
+blkdev_caps_t disk_caps[DISKIO_MAX_DRIVES];
+
 /**
  * @brief API handler for disk I/O such as drive lists, absolute disk writes/reads and partition info
  * 
@@ -98,7 +111,7 @@ void diskio_api(void *req)
             for(uint8_t i = 0; i < DISKIO_MAX_DRIVES; ++i)
             {
                 if(disks[i] == DRIVE_TYPE_UNKNOWN)
-                    break;
+                    continue;
 
                 dsk[i].disk_size = disk_get_max_addr(i) * disk_get_sector_size(i);
 
@@ -140,24 +153,47 @@ void diskio_api(void *req)
         {
             disk_syscall_t *c = (disk_syscall_t *) req;
 
+            // the sector size below is looked up by drive number, the drive has to be there
+            if(!diskio_check_exists(c->drive))
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE; break; }
+
             uint16_t id = drive_convert_drive_id((const char *) c->drive);
             uint8_t drive =  (uint8_t) ((id >> 8) & 0xFF);
             uint8_t part = (uint8_t) (id & 0xFF);
 
-            uint8_t *b = evalloc(c->nlba * DEFAULT_SECTOR_SIZE, prog_get_current_running());
+            size_t size = c->nlba * disk_get_sector_size(drive);
+            uint8_t *b;
+
+            // the size of the read has to fit in 32 bits, or the checks below are done on less than is read
+            if(!c->nlba || (size / c->nlba) != disk_get_sector_size(drive))
+                { c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE; break; }
+
+            // read straight into the buffer of the caller if it has given us one
+            if(c->buffer)
+            {
+                if(c->buffer_size < size)
+                    { c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE; break; }
+                if(!paging_check_owner(c->buffer, size, prog_get_current_running()))
+                    { c->hdr.exit_code = EXIT_CODE_GLOBAL_RESERVED; break; }
+                
+                b = (uint8_t *) c->buffer;
+            }
+            else
+                b = evalloc(size, prog_get_current_running());
             
             if(!b)
                 { c->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; break; }
             
             uint32_t lba = c->lba;
 
-            if((drive_type(c->drive) == DRIVE_TYPE_IDE_PATAPI) && part != 0xFF)
+            // like SYSCALL_DISK_ABS_WRITE, so a sector read and written back lands where it came from
+            if((drive_type(c->drive) != DRIVE_TYPE_IDE_PATAPI) && part != 0xFF)
                 lba = c->lba + MBR_getStartLBA(drive, part);
 
             c->hdr.exit_code = read(drive, lba, c->nlba, b);
 
             c->hdr.response_ptr = b;
-            c->hdr.response_size = c->nlba * DEFAULT_SECTOR_SIZE;
+            c->hdr.response_size = size;
             
             break;
         }
@@ -198,6 +234,24 @@ void diskio_api(void *req)
             hdr->exit_code = EXIT_CODE_GLOBAL_SUCCESS;
         break;
 
+        case SYSCALL_DISK_AIO_SETUP:
+        case SYSCALL_DISK_AIO_SUBMIT:
+        case SYSCALL_DISK_AIO_DESTROY:
+            aio_api(req);
+        break;
+
+        case SYSCALL_DISK_STATS:
+            hdr->response_ptr = iostat_get_all(prog_get_current_running());
+            hdr->response_size = DISKIO_MAX_DRIVES * sizeof(iostat_t);
+
+            if(!hdr->response_ptr)
+                hdr->exit_code = EXIT_CODE_GLOBAL_OUT_OF_MEMORY;
+        break;
+
+        case SYSCALL_DISK_STATS_RESET:
+            iostat_reset();
+        break;
+
         default:
             hdr->exit_code = EXIT_CODE_GLOBAL_NOT_IMPLEMENTED;
         break;
@@ -226,13 +280,38 @@ void diskio_init(void)
     drv[1] = (uint32_t) (drives);
     driver_exec_int(pciGetInfo(IDE_ctrl) | DRIVER_TYPE_PCI, drv); 
 
+    // get the block device operations of the driver, so that I/O does not need command packets
+    blkdev_ops_t ide_ops;
+    memset(&ide_ops, sizeof(blkdev_ops_t), 0);
+
+    drv[0] = IDE_COMMAND_GET_BLKDEV_OPS;
+    drv[1] = (uint32_t) (&ide_ops);
+    driver_exec_int(pciGetInfo(IDE_ctrl) | DRIVER_TYPE_PCI, drv);
+
+    // the RAM disk (a boot module) comes after the IDE drives
+    blkdev_ops_t rd_ops;
+    drives[RAMDISK_DRIVE] = (ramdisk_init()) ? DRIVE_TYPE_UNKNOWN : DRIVE_TYPE_RAMDISK;
+    ramdisk_get_blkdev_ops(&rd_ops);
+
     for(i = 0; i < DISKIO_MAX_DRIVES; ++i)
     {
         // disks are returned in order with their type being stored at the 
         // index of the drive number (see IDE_commands.h for more info)
         disk_info_t[i].disktype = (uint8_t) drives[i];
         disk_info_t[i].diskID = i; 
-        disk_info_t[i].controller_info = (uint16_t) pciGetInfo(IDE_ctrl);
+        disk_info_t[i].controller_info = (i < IDE_DRIVER_MAX_DRIVES) ? (uint16_t) pciGetInfo(IDE_ctrl) : 0;
+
+        if(disk_info_t[i].disktype == DRIVE_TYPE_RAMDISK)
+            disk_ops[i] = rd_ops;
+        else if(disk_info_t[i].disktype != DRIVE_TYPE_UNKNOWN)
+            disk_ops[i] = ide_ops;
+        else
+            memset(&disk_ops[i], sizeof(blkdev_ops_t), 0);
+
+        memset(&disk_caps[i], sizeof(blkdev_caps_t), 0);
+        
+        if(disk_ops[i].caps)
+            disk_ops[i].caps(i, &disk_caps[i]);
     }
 
     kfree(drv);
@@ -259,7 +338,8 @@ bool diskio_check_exists(const char *id)
     if(disk_info_t[disk].disktype == 0xFF)
         return false;
     
-    if(disk_info_t[disk].disktype == DRIVE_TYPE_IDE_PATAPI)
+    // CD drives and whole hard disks (no partition in the id)
+    if(disk_info_t[disk].disktype == DRIVE_TYPE_IDE_PATAPI || part == 0xFF)
         return true;
     
     // if we get here it was a hard drive
@@ -281,14 +361,16 @@ uint8_t *diskio_reportDrives(void)
     uint32_t i = 0;
     uint8_t *drive_list = (uint8_t *) kmalloc(DISKIO_MAX_DRIVES*sizeof(uint32_t));
 
-    for(; i < IDE_DRIVER_MAX_DRIVES; ++i)
+    for(; i < DISKIO_MAX_DRIVES; ++i)
         drive_list[i] = disk_info_t[i].disktype;
 
     return drive_list;
 }
 
 /**
- * @brief Absolute read at LBA on drive, uses internal drivers
+ * @brief Absolute read at LBA on drive, uses internal drivers. Sequential reads
+ *        are served through the readahead windows of the drive (see readahead.c),
+ *        writes still waiting in the request queue of the drive are taken into account
  * 
  * @param drive drive number
  * @param LBA sector number
@@ -298,29 +380,54 @@ uint8_t *diskio_reportDrives(void)
  */
 uint8_t read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf)
 {
-    uint32_t *drv = kmalloc(sizeof(uint32_t) * DRIVER_COMMAND_PACKET_LEN);
-    uint8_t disk_type = disk_info_t[drive].disktype;
-    uint32_t command = (disk_type == DRIVE_TYPE_IDE_PATA || disk_type == DRIVE_TYPE_IDE_PATAPI ) ?
-            IDE_COMMAND_READ : NULL; // NULL is here for support for another driver if it's added
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
 
-    if(drive > DISKIO_MAX_DRIVES)
-        { kfree(drv); return EXIT_CODE_GLOBAL_OUT_OF_RANGE; }
+    uint8_t err;
+    uint32_t start = timer_timestamp();
 
-    drv[0] = command;
-    drv[1] = (uint32_t) (drive);
-    drv[2] = LBA;
-    drv[3] = sctrRead;
-    drv[4] = (uint32_t) (buf);
+    iostat_read_lba(drive, LBA);
 
-    driver_exec_int((uint32_t) (disk_info_t[drive].controller_info | DRIVER_TYPE_PCI), drv);
+    // CDs have a sector cache of their own, reading ahead of memory is just extra copying
+    if(disk_caps[drive].flags & BLKDEV_CAP_MEMORY)
+        err = diskio_device_read(drive, LBA, sctrRead, buf);
+    else if(disk_info_t[drive].disktype == DRIVE_TYPE_IDE_PATAPI)
+        err = cd_cache_read(drive, LBA, sctrRead, buf);
+    else
+        err = readahead_read(drive, LBA, sctrRead, buf);
 
-    kfree(drv);
+    ioqueue_read_overlay(drive, LBA, sctrRead, buf);
+
+    iostat_account(drive, IOSTAT_OP_READ, sctrRead, err, start);
+    return err;
+}
+
+/**
+ * @brief Absolute read at LBA on drive, directly from the device (bypasses readahead)
+ * 
+ * @param drive drive number
+ * @param LBA sector number
+ * @param sctrRead amount of sectors to read
+ * @param buf output buffer for content
+ * @return uint8_t exit code (any error by driver or EXIT_CODE_GLOBAL_OUT_OF_RANGE if drive number is too large)
+ */
+uint8_t diskio_device_read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    if(!disk_ops[drive].read)
+        return EXIT_CODE_GLOBAL_UNSUPPORTED;
 
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    uint32_t start = timer_timestamp();
+    uint8_t err = disk_ops[drive].read(drive, LBA, sctrRead, buf);
+
+    iostat_account(drive, IOSTAT_OP_DEV_READ, sctrRead, err, start);
+    return err;
 }
 
 /**
- * @brief Absolute write at LBA on drive, uses internal drivers
+ * @brief Absolute write at LBA on drive, uses internal drivers. While the request queue
+ *        of the drive is plugged (see ioqueue.c) the write is queued instead
  * 
  * @param drive drive number
  * @param LBA sector number
@@ -330,21 +437,125 @@ uint8_t read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsig
  */
 uint8_t write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf)
 {
-    uint32_t *drv = kmalloc(sizeof(uint32_t) * DRIVER_COMMAND_PACKET_LEN);
-    uint32_t command = (disk_info_t[drive].disktype == DRIVE_TYPE_IDE_PATA) ?
-            IDE_COMMAND_WRITE : NULL; 
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
 
-    drv[0] = command;
-    drv[1] = (uint32_t) (drive);
-    drv[2] = LBA;
-    drv[3] = sctrWrite;
-    drv[4] = (uint32_t) (buf);
+    uint8_t err;
+    uint32_t start = timer_timestamp();
 
-    driver_exec_int((uint32_t) (disk_info_t[drive].controller_info | DRIVER_TYPE_PCI), drv);
+    if(ioqueue_is_plugged(drive))
+        err = ioqueue_write(drive, LBA, sctrWrite, buf);
+    else
+    {
+        // whatever was read ahead of these sectors is stale now
+        readahead_invalidate(drive, LBA, sctrWrite);
 
-    kfree(drv);
+        err = diskio_device_write(drive, LBA, sctrWrite, buf);
+        err = (err) ? err : diskio_device_flush(drive);
+    }
 
-    return EXIT_CODE_GLOBAL_SUCCESS;
+    iostat_account(drive, IOSTAT_OP_WRITE, sctrWrite, err, start);
+    return err;
+}
+
+/**
+ * @brief Absolute write at LBA on drive, directly to the device (bypasses the request queue).
+ *        Does not flush the write cache of the drive, see diskio_device_flush()
+ * 
+ * @param drive drive number
+ * @param LBA sector number
+ * @param sctrRead amount of sectors to write
+ * @param buf output buffer for content
+ * @return uint8_t exit code (any error by driver)
+ */
+uint8_t diskio_device_write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    if(!disk_ops[drive].write)
+        return EXIT_CODE_GLOBAL_UNSUPPORTED;
+
+    uint32_t start = timer_timestamp();
+    uint8_t err = disk_ops[drive].write(drive, LBA, sctrWrite, buf);
+
+    iostat_account(drive, IOSTAT_OP_DEV_WRITE, sctrWrite, err, start);
+    return err;
+}
+
+/**
+ * @brief Executes a batch of device reads/writes (bypasses readahead and the request queue).
+ *        Requests for drives on different channels/devices are executed at the same time
+ *        when the driver supports it.
+ * 
+ * @param reqs requests, `unit` is the drive number; `err` is set for every request
+ * @param n number of requests
+ * @return uint8_t first error of any request
+ */
+uint8_t diskio_device_submit(blkdev_req_t *reqs, uint32_t n)
+{
+    err_t (*submit)(blkdev_req_t *reqs, uint32_t n) = NULL;
+    bool_t one_driver = TRUE;
+
+    for(uint32_t i = 0; i < n && one_driver; ++i)
+    {
+        uint8_t drive = reqs[i].unit;
+
+        if(drive >= DISKIO_MAX_DRIVES || !disk_ops[drive].submit)
+            one_driver = FALSE;
+        else if(submit && submit != disk_ops[drive].submit)
+            one_driver = FALSE;
+        else
+            submit = disk_ops[drive].submit;
+    }
+
+    // everything is handled by the same driver, it can schedule the batch itself
+    if(one_driver && submit)
+    {
+        uint32_t start = timer_timestamp();
+        uint8_t err = submit(reqs, n);
+
+        // the latency of each request is that of the batch
+        for(uint32_t i = 0; i < n; ++i)
+            iostat_account(reqs[i].unit, (reqs[i].write) ? IOSTAT_OP_DEV_WRITE : IOSTAT_OP_DEV_READ, 
+                           reqs[i].nlba, reqs[i].err, start);
+
+        return err;
+    }
+
+    uint8_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        blkdev_req_t *r = &reqs[i];
+
+        r->err = (r->write) ? diskio_device_write(r->unit, r->lba, r->nlba, r->buf) :
+                              diskio_device_read(r->unit, r->lba, r->nlba, r->buf);
+        err = (err) ? err : r->err;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Makes sure everything written to the drive so far is on the medium
+ * 
+ * @param drive drive number
+ * @return uint8_t exit code (any error by driver)
+ */
+uint8_t diskio_device_flush(unsigned char drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    
+    // drives without a write cache have nothing to flush
+    if(!disk_ops[drive].flush)
+        return EXIT_CODE_GLOBAL_SUCCESS;
+
+    uint32_t start = timer_timestamp();
+    uint8_t err = disk_ops[drive].flush(drive);
+
+    iostat_account(drive, IOSTAT_OP_DEV_FLUSH, 0, err, start);
+    return err;
 }
 
 /**
@@ -355,20 +566,25 @@ uint8_t write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, uns
  */
 size_t disk_get_max_addr(uint8_t drive)
 {
+    if(drive >= DISKIO_MAX_DRIVES)
+        return 0;
 
-    uint32_t *drv = kmalloc(sizeof(uint32_t) * DRIVER_COMMAND_PACKET_LEN);
-    uint32_t command = (disk_info_t[drive].disktype == DRIVE_TYPE_IDE_PATA) ?
-            IDE_COMMAND_GET_MAX_ADDRESS : NULL;
-
-    drv[0] = command;
-    drv[1] = (uint32_t) (drive);
+    return disk_caps[drive].max_lba;
+}
 
-    driver_exec_int((uint32_t) (disk_info_t[drive].controller_info | DRIVER_TYPE_PCI), drv);
-    
-    size_t max_addr = drv[2];
-    kfree(drv);
+/**
+ * @brief Returns the capabilities of a drive (sector size, max. address, transfer modes, model, etc.),
+ *        as cached during diskio_init()
+ * 
+ * @param drive drive number
+ * @return const blkdev_caps_t* capabilities, or NULL if there is no such drive
+ */
+const blkdev_caps_t *diskio_get_caps(uint8_t drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES || disk_info_t[drive].disktype == DRIVE_TYPE_UNKNOWN)
+        return NULL;
 
-    return max_addr;
+    return &disk_caps[drive];
 }
 
 /**
@@ -379,6 +595,9 @@ size_t disk_get_max_addr(uint8_t drive)
  */
 size_t disk_get_sector_size(uint8_t drive)
 {
+    if(drive < DISKIO_MAX_DRIVES && disk_caps[drive].sector_size)
+        return disk_caps[drive].sector_size;
+
     return (disk_info_t[drive].disktype == DRIVE_TYPE_IDE_PATAPI) ? ATAPI_DEFAULT_SECTOR_SIZE : DEFAULT_SECTOR_SIZE;
 }
 
@@ -469,6 +688,8 @@ uint8_t drive_type(const char *_id)
         type = DRIVE_TYPE_IDE_PATA;
     else if(!strcmp_until(&id[0], DISKIO_DISKID_CD, 2)) // is cd?
         type = DRIVE_TYPE_IDE_PATAPI;
+    else if(!strcmp_until(&id[0], DISKIO_DISKID_RD, 2)) // is ram disk?
+        type = DRIVE_TYPE_RAMDISK;
     else
         return (uint8_t) MAX;
     
@@ -545,6 +766,8 @@ const char *drive_type_to_chars(uint8_t type)
         return (const char *) DISKIO_DISKID_HD;
     else if (type == DRIVE_TYPE_IDE_PATAPI)
         return (const char *) DISKIO_DISKID_CD;
+    else if (type == DRIVE_TYPE_RAMDISK)
+        return (const char *) DISKIO_DISKID_RD;
     
     return (const char *) " ";
 }
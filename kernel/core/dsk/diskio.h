@@ -25,8 +25,9 @@ SOFTWARE.
 #define __DISKIO_H__
 
 #include "../include/types.h"
+#include "blkdev.h"
 
-#define DISKIO_MAX_DRIVES       4 /* max. 4 IDE drives */
+#define DISKIO_MAX_DRIVES       5 /* max. 4 IDE drives and the RAM disk */
 
 #define DEFAULT_SECTOR_SIZE        512
 #define ATAPI_DEFAULT_SECTOR_SIZE  2048
@@ -35,6 +36,7 @@ SOFTWARE.
 
 #define DISKIO_DISKID_HD    "HD"    // HDD
 #define DISKIO_DISKID_CD    "CD"    // CD/DVD drive
+#define DISKIO_DISKID_RD    "RD"    // RAM disk
 #define DISKIO_DISKID_P     'P'    // partition
 
 // defines for drive_convert_drive_id()
@@ -50,10 +52,15 @@ bool diskio_check_exists(const char *id);
 unsigned char *diskio_reportDrives(void);
 unsigned char read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf);
 unsigned char write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf);
+unsigned char diskio_device_read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf);
+unsigned char diskio_device_write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf);
+unsigned char diskio_device_flush(unsigned char drive);
+unsigned char diskio_device_submit(blkdev_req_t *reqs, unsigned int n);
 
 unsigned int disk_get_sector_size(unsigned char drive);
 
 unsigned int disk_get_max_addr(unsigned char drive);
+const blkdev_caps_t *diskio_get_caps(unsigned char drive);
 void drive_convert_to_drive_id(unsigned char drive, char *out_id);
 unsigned char drive_to_type_index(unsigned char drive, unsigned char type);
 const char *drive_type_to_chars(unsigned char type);
@@ -28,8 +28,11 @@ SOFTWARE.
 #include "mbr.h"
 
 #include "../memory/memory.h"
+#include "../memory/paging.h"
 #include "../util/util.h"
 
+#include "../exec/prog.h"
+
 #include "../api/api.h"
 #include "../api/syscalls.h"
 
@@ -51,11 +54,287 @@ typedef struct fs_t
     uint8_t attrib;
 } __attribute__((packed)) fs_t;
 
+// request for the syscalls on open files
+typedef struct fs_file_t
+{
+    syscall_hdr_t hdr;
+    char *path;         // SYSCALL_FS_OPEN/SYSCALL_FS_OPENDIR
+    uint32_t handle;
+    file_t *buffer;
+    size_t size;        // in entries for SYSCALL_FS_READDIR
+    uint32_t offset;    // FS_OFFSET_CURRENT or a file offset, signed for SYSCALL_FS_SEEK
+    uint8_t whence;     // SYSCALL_FS_SEEK
+    uint8_t flags;      // FS_DIR_* for SYSCALL_FS_OPENDIR
+} __attribute__((packed)) fs_file_t;
+
+typedef struct fs_open_file_t
+{
+    pid_t pid;
+    bool_t used;
+    bool_t dir;
+    uint32_t driver_type;
+    uint32_t position;  // for FS_OFFSET_CURRENT
+    fs_handle_t h;
+} fs_open_file_t;
+
+fs_open_file_t open_files[FS_MAX_OPEN_FILES];
+
+static fs_open_file_t *fs_get_open_file(uint32_t handle, pid_t pid)
+{
+    if(handle >= FS_MAX_OPEN_FILES || !open_files[handle].used || open_files[handle].pid != pid)
+        return NULL;
+    
+    return &open_files[handle];
+}
+
+static uint32_t fs_find_free_open_file(void)
+{
+    for(uint32_t i = 0; i < FS_MAX_OPEN_FILES; ++i)
+    {
+        // files of programs that have since terminated are closed here
+        if(open_files[i].used && !prog_pid_exists(open_files[i].pid))
+            open_files[i].used = FALSE;
+        
+        if(!open_files[i].used)
+            return i;
+    }
+
+    return MAX;
+}
+
+/* TRUE if a program still has the file or directory at path open. Its handles point at the entry and
+   the chain of the file, so the file may not be deleted or rewritten as a whole under them. Directories
+   with files in them can't be deleted at all, so the files of a directory keep it as well */
+static bool_t fs_file_in_use(char *path)
+{
+    fs_handle_t h;
+    uint32_t drv[5];
+
+    drv[0] = FS_COMMAND_OPEN;
+    drv[1] = (uint32_t) path;
+    drv[2] = (uint32_t) &h;
+    drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+    driver_exec_int(DRIVER_TYPE_FS | FS_TYPE_FAT32, &drv[0]);
+
+    // a directory, its handles are told apart by the first cluster
+    bool_t dir = (drv[4] == EXIT_CODE_GLOBAL_INVALID);
+
+    if(dir)
+    {
+        drv[0] = FS_COMMAND_OPENDIR;
+        drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+        driver_exec_int(DRIVER_TYPE_FS | FS_TYPE_FAT32, &drv[0]);
+    }
+
+    // files that do not exist are left to the driver
+    if(drv[4])
+        return FALSE;
+
+    for(uint32_t i = 0; i < FS_MAX_OPEN_FILES; ++i)
+    {
+        fs_open_file_t *f = &open_files[i];
+
+        if(!f->used || f->dir != dir || f->driver_type != FS_TYPE_FAT32 || !prog_pid_exists(f->pid))
+            continue;
+        if(f->h.disk != h.disk || f->h.part != h.part)
+            continue;
+
+        if((dir) ? f->h.start == h.start : f->h.dir_part_cluster == h.dir_part_cluster && f->h.dir_index == h.dir_index)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void fs_open(fs_file_t *req, pid_t pid, bool_t dir)
+{
+    if(!fs_check_path(req->path))
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; return; }
+    
+    uint8_t disk_type = drive_type(req->path);
+
+    if(disk_type == (uint8_t) MAX || !diskio_check_exists(req->path))
+        { req->hdr.exit_code = EXIT_CODE_FS_UNSUPPORTED_DRIVE; return; }
+    
+    uint32_t handle = fs_find_free_open_file();
+
+    if(handle == MAX)
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_MEMORY; return; }
+    
+    fs_open_file_t *f = &open_files[handle];
+    uint32_t drv[5];
+
+    f->driver_type = (disk_type == DRIVE_TYPE_IDE_PATAPI) ? FS_TYPE_ISO : FS_TYPE_FAT32;
+    f->position = 0;
+
+    drv[0] = (dir) ? FS_COMMAND_OPENDIR : FS_COMMAND_OPEN;
+    drv[1] = (uint32_t) req->path;
+    drv[2] = (uint32_t) &f->h;
+    drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+    driver_exec_int(DRIVER_TYPE_FS | f->driver_type, &drv[0]);
+
+    req->hdr.exit_code = (err_t) drv[4];
+
+    if(req->hdr.exit_code)
+        return;
+    
+    f->pid = pid;
+    f->used = TRUE;
+    f->dir = dir;
+    f->h.flags = (dir) ? req->flags : 0;
+
+    req->hdr.response = handle;
+    req->hdr.response_size = f->h.size;
+}
+
+static void fs_read_write_at(fs_file_t *req, pid_t pid, bool_t wr)
+{
+    fs_open_file_t *f = fs_get_open_file(req->handle, pid);
+
+    if(!f || f->dir)
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; return; }
+    if(!paging_check_owner(req->buffer, req->size, pid))
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_RESERVED; return; }
+    if(wr && f->driver_type == FS_TYPE_ISO)
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_UNSUPPORTED; return; }
+
+    uint32_t drv[5];
+    f->h.offset = (req->offset == FS_OFFSET_CURRENT) ? f->position : req->offset;
+
+    drv[0] = (wr) ? FS_COMMAND_WRITE_AT : FS_COMMAND_READ_AT;
+    drv[1] = (uint32_t) &f->h;
+    drv[2] = (uint32_t) req->buffer;
+    drv[3] = (uint32_t) req->size;
+    drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+    driver_exec_int(DRIVER_TYPE_FS | f->driver_type, &drv[0]);
+
+    req->hdr.exit_code = (err_t) drv[4];
+    req->hdr.response = drv[3];
+
+    // only reads and writes at the current position move it
+    if(req->offset == FS_OFFSET_CURRENT)
+        f->position = f->position + drv[3];
+}
+
+static void fs_seek(fs_file_t *req, pid_t pid)
+{
+    fs_open_file_t *f = fs_get_open_file(req->handle, pid);
+
+    if(!f || f->dir)
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; return; }
+    
+    uint32_t base, drv[5];
+
+    // another handle may have changed the size, a read of nothing has the driver look it up again
+    if(req->whence == FS_SEEK_END)
+    {
+        f->h.offset = 0;
+
+        drv[0] = FS_COMMAND_READ_AT;
+        drv[1] = (uint32_t) &f->h;
+        drv[2] = (uint32_t) NULL;
+        drv[3] = 0;
+        drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+        driver_exec_int(DRIVER_TYPE_FS | f->driver_type, &drv[0]);
+
+        if(drv[4])
+            { req->hdr.exit_code = (err_t) drv[4]; return; }
+    }
+
+    switch(req->whence)
+    {
+        case FS_SEEK_SET: base = 0; break;
+        case FS_SEEK_CUR: base = f->position; break;
+        case FS_SEEK_END: base = f->h.size; break;
+        default: req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; return;
+    }
+
+    int32_t delta = (req->whence == FS_SEEK_SET) ? 0 : (int32_t) req->offset;
+    base = (req->whence == FS_SEEK_SET) ? req->offset : base;
+
+    if(delta < 0 && (uint32_t) -delta > base)
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE; return; }
+
+    f->position = base + (uint32_t) delta;
+    req->hdr.response = f->position;
+}
+
+// reads the next req->size entries of an open directory
+static void fs_readdir(fs_file_t *req, pid_t pid)
+{
+    fs_open_file_t *f = fs_get_open_file(req->handle, pid);
+
+    if(!f || !f->dir || req->size > MAX / sizeof(fs_dir_contents_t))
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; return; }
+    if(!paging_check_owner(req->buffer, req->size * sizeof(fs_dir_contents_t), pid))
+        { req->hdr.exit_code = EXIT_CODE_GLOBAL_RESERVED; return; }
+    
+    uint32_t drv[5];
+
+    drv[0] = FS_COMMAND_READDIR;
+    drv[1] = (uint32_t) &f->h;
+    drv[2] = (uint32_t) req->buffer;
+    drv[3] = (uint32_t) req->size;
+    drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+    driver_exec_int(DRIVER_TYPE_FS | f->driver_type, &drv[0]);
+
+    req->hdr.exit_code = (err_t) drv[4];
+    req->hdr.response = drv[3];
+}
+
+// syscalls on open files, handles are only valid for the program that opened the file
+static void fs_file_api(fs_file_t *req)
+{
+    pid_t pid = prog_get_current_running();
+    req->hdr.exit_code = EXIT_CODE_GLOBAL_SUCCESS;
+
+    switch(req->hdr.system_call)
+    {
+        case SYSCALL_FS_OPEN:
+            fs_open(req, pid, FALSE);
+        break;
+
+        case SYSCALL_FS_OPENDIR:
+            fs_open(req, pid, TRUE);
+        break;
+
+        case SYSCALL_FS_READDIR:
+            fs_readdir(req, pid);
+        break;
+
+        case SYSCALL_FS_READ_AT:
+            fs_read_write_at(req, pid, FALSE);
+        break;
+
+        case SYSCALL_FS_WRITE_AT:
+            fs_read_write_at(req, pid, TRUE);
+        break;
+
+        case SYSCALL_FS_SEEK:
+            fs_seek(req, pid);
+        break;
+
+        case SYSCALL_FS_CLOSE:
+        {
+            fs_open_file_t *f = fs_get_open_file(req->handle, pid);
+
+            if(!f)
+                { req->hdr.exit_code = EXIT_CODE_GLOBAL_INVALID; break; }
+
+            f->used = FALSE;
+            break;
+        }
+    }
+}
+
 void fs_api(void *req)
 {
     fs_t *fs = (fs_t *) req;
     uint32_t drv[5];
 
+    if(fs->hdr.system_call >= SYSCALL_FS_OPEN && fs->hdr.system_call <= SYSCALL_FS_READDIR)
+        { fs_file_api((fs_file_t *) req); return; }
+
     uint8_t disk_type = drive_type(fs->path);
 
     if(disk_type == (uint8_t) MAX || !diskio_check_exists(fs->path))
@@ -68,7 +347,7 @@ void fs_api(void *req)
             if(disk_type == DRIVE_TYPE_IDE_PATAPI)
                 { fs->hdr.response = FS_TYPE_ISO; break; }
             
-            if(disk_type != DRIVE_TYPE_IDE_PATA)
+            if(!DRIVE_TYPE_HAS_MBR(disk_type))
             { fs->hdr.exit_code = EXIT_CODE_GLOBAL_UNSUPPORTED; break;}
             
             // if we get here the device is a known type of hard disk
@@ -108,6 +387,9 @@ void fs_api(void *req)
             if(fs->f == NULL)
             {fs->hdr.exit_code = EXIT_CODE_GLOBAL_OUT_OF_RANGE; break;}
 
+            if(fs_file_in_use(fs->path))
+                { fs->hdr.exit_code = EXIT_CODE_FS_FILE_IN_USE; break; }
+
             drv[0] = FS_COMMAND_WRITE;
             drv[1] = (uint32_t) fs->path;
             drv[2] = (uint32_t) fs->f;
@@ -130,6 +412,9 @@ void fs_api(void *req)
             if(disk_type == DRIVE_TYPE_IDE_PATAPI)
             { fs->hdr.exit_code = EXIT_CODE_GLOBAL_UNSUPPORTED; break; }
 
+            if(fs_file_in_use(fs->path))
+                { fs->hdr.exit_code = EXIT_CODE_FS_FILE_IN_USE; break; }
+
             drv[0] = FS_COMMAND_DELETE;
             drv[1] = (uint32_t) fs->path;
             driver_exec_int(DRIVER_TYPE_FS | driver_type, &drv[0]);
@@ -28,6 +28,14 @@ SOFTWARE.
 #include "../drv/FS_TYPES.H"
 
 #define FS_MAX_PATH_LEN     255
+#define FS_MAX_OPEN_FILES   32      // by all programs together
+
+#define FS_OFFSET_CURRENT   0xFFFFFFFF  // read/write at the current position (and move it)
+
+// SYSCALL_FS_SEEK
+#define FS_SEEK_SET         0
+#define FS_SEEK_CUR         1
+#define FS_SEEK_END         2
 
 void fs_api(void *req);
 uint8_t fs_check_path(char* p);
@@ -0,0 +1,397 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ioqueue.h"
+#include "diskio.h"
+#include "readahead.h"
+
+#include "../include/types.h"
+#include "../include/exit_code.h"
+
+#include "../memory/paging.h"
+
+#include "../hardware/timer.h"
+
+#include "../exec/task.h"
+
+#include "../util/util.h"
+
+// A queued write. Requests in the queue of a drive never overlap; a write that
+// overlaps with or borders on a queued request is merged into it.
+typedef struct ioqueue_req_t
+{
+    uint32_t lba;
+    uint32_t nlba;
+    uint8_t *data;
+} ioqueue_req_t;
+
+typedef struct ioqueue_t
+{
+    ioqueue_req_t req[IOQUEUE_MAX_REQUESTS];
+    uint32_t n;             // requests queued
+    uint32_t plugged;       // nesting depth of ioqueue_plug()
+    uint32_t head;          // lba following the last dispatched request
+    uint32_t oldest;        // systick at which the oldest request was queued
+} ioqueue_t;
+
+ioqueue_t ioqueues[DISKIO_MAX_DRIVES];
+
+// requests of all drives being flushed, in the form the drivers take them
+blkdev_req_t ioqueue_batch[DISKIO_MAX_DRIVES * IOQUEUE_MAX_REQUESTS];
+
+/**
+ * @brief Starts batching writes to a drive. Until the matching ioqueue_unplug(), 
+ *        writes to this drive are queued, merged and sorted instead of being issued
+ *        one by one. Calls may be nested.
+ * 
+ * @param drive drive number
+ */
+void ioqueue_plug(uint8_t drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return;
+
+    ioqueues[drive].plugged++;
+}
+
+/**
+ * @brief Ends a batch started with ioqueue_plug(). The outermost call dispatches
+ *        everything still queued.
+ * 
+ * @param drive drive number
+ * @return err_t first error reported by the driver while dispatching
+ */
+err_t ioqueue_unplug(uint8_t drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES || !ioqueues[drive].plugged)
+        return EXIT_CODE_GLOBAL_SUCCESS;
+
+    if(--ioqueues[drive].plugged)
+        return EXIT_CODE_GLOBAL_SUCCESS;
+    
+    return ioqueue_flush(drive);
+}
+
+/**
+ * @brief ioqueue_unplug() for a set of drives. The drives whose outermost batch ends
+ *        are flushed together (see ioqueue_flush_drives()).
+ * 
+ * @param drives bitmap of drive numbers
+ * @param errs optional, receives the first error of every drive in the set
+ * @return err_t first error reported by the driver while dispatching
+ */
+err_t ioqueue_unplug_drives(uint32_t drives, err_t *errs)
+{
+    uint32_t flush = 0;
+
+    for(uint8_t d = 0; d < DISKIO_MAX_DRIVES; ++d)
+    {
+        if(!(drives & (1U << d)) || !ioqueues[d].plugged)
+            continue;
+        
+        if(!--ioqueues[d].plugged)
+            flush = flush | (1U << d);
+    }
+
+    return ioqueue_flush_drives(flush, errs);
+}
+
+bool_t ioqueue_is_plugged(uint8_t drive)
+{
+    return (drive < DISKIO_MAX_DRIVES) && ioqueues[drive].plugged;
+}
+
+static void ioqueue_remove(ioqueue_t *q, uint32_t i)
+{
+    q->n--;
+    q->req[i] = q->req[q->n];
+    memset(&q->req[q->n], sizeof(ioqueue_req_t), 0);
+}
+
+/**
+ * @brief Sorts the queue of a drive in the order it is dispatched in: ascending
+ *        from the last dispatched lba upwards, then wrapping around to the lowest
+ *        lba (one-way elevator)
+ */
+static void ioqueue_sort(ioqueue_t *q)
+{
+    for(uint32_t i = 1; i < q->n; ++i)
+    {
+        ioqueue_req_t r = q->req[i];
+        bool_t r_ahead = r.lba >= q->head;
+        uint32_t j = i;
+
+        for(; j > 0; --j)
+        {
+            ioqueue_req_t *p = &q->req[j - 1];
+            bool_t p_ahead = p->lba >= q->head;
+
+            // requests ahead of the head go first, within a group sort on lba
+            if(p_ahead == r_ahead && p->lba <= r.lba)
+                break;
+            if(p_ahead && !r_ahead)
+                break;
+            
+            q->req[j] = *p;
+        }
+
+        q->req[j] = r;
+    }
+}
+
+/**
+ * @brief Dispatches all requests queued for a drive to the device
+ * 
+ * @param drive drive number
+ * @return err_t first error reported by the driver
+ */
+err_t ioqueue_flush(uint8_t drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    return ioqueue_flush_drives(1U << drive, NULL);
+}
+
+/**
+ * @brief Dispatches all requests queued for a set of drives as one batch, so that
+ *        drives on different channels are written at the same time
+ * 
+ * @param drives bitmap of drive numbers
+ * @param errs optional, receives the first error of every drive in the set
+ * @return err_t first error reported by the driver
+ */
+err_t ioqueue_flush_drives(uint32_t drives, err_t *errs)
+{
+    uint32_t n = 0;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    for(uint8_t d = 0; d < DISKIO_MAX_DRIVES; ++d)
+    {
+        if(errs)
+            errs[d] = EXIT_CODE_GLOBAL_SUCCESS;
+
+        if(!(drives & (1U << d)))
+            continue;
+        
+        ioqueue_t *q = &ioqueues[d];
+        ioqueue_sort(q);
+
+        for(uint32_t i = 0; i < q->n; ++i, ++n)
+        {
+            ioqueue_batch[n].unit = d;
+            ioqueue_batch[n].write = TRUE;
+            ioqueue_batch[n].lba = q->req[i].lba;
+            ioqueue_batch[n].nlba = q->req[i].nlba;
+            ioqueue_batch[n].buf = q->req[i].data;
+        }
+    }
+
+    if(n)
+        diskio_device_submit(ioqueue_batch, n);
+
+    n = 0;
+
+    for(uint8_t d = 0; d < DISKIO_MAX_DRIVES; ++d)
+    {
+        if(!(drives & (1U << d)))
+            continue;
+
+        ioqueue_t *q = &ioqueues[d];
+        err_t e = EXIT_CODE_GLOBAL_SUCCESS;
+        
+        for(uint32_t i = 0; i < q->n; ++i, ++n)
+        {
+            ioqueue_req_t *r = &q->req[i];
+            e = (e) ? e : ioqueue_batch[n].err;
+
+            // windows read while the request was queued contain the old contents
+            readahead_invalidate(d, r->lba, r->nlba);
+
+            q->head = r->lba + r->nlba;
+            vfree(r->data);
+        }
+
+        // one cache flush for the whole batch
+        if(q->n)
+        {
+            err_t f = diskio_device_flush(d);
+            e = (e) ? e : f;
+        }
+
+        memset(&q->req[0], sizeof(ioqueue_req_t) * IOQUEUE_MAX_REQUESTS, 0);
+        q->n = 0;
+
+        if(errs)
+            errs[d] = e;
+        err = (err) ? err : e;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Writes straight to the device, for writes the queue can't take. Everything
+ *        queued is dispatched first, so older data never lands on top of this write;
+ *        like write() without a plug, the write cache of the drive is flushed after
+ * 
+ * @return err_t first error reported by the driver
+ */
+static err_t ioqueue_write_direct(uint8_t drive, uint32_t lba, uint32_t nlba, const uint8_t *buf)
+{
+    // whatever was read ahead of these sectors is stale now
+    readahead_invalidate(drive, lba, nlba);
+
+    err_t err = ioqueue_flush(drive);
+    err = (err) ? err : diskio_device_write(drive, lba, nlba, (uint8_t *) buf);
+    err = (err) ? err : diskio_device_flush(drive);
+
+    return err;
+}
+
+/**
+ * @brief Queues a write to a drive. The data is copied, so the caller may reuse
+ *        its buffer right away. Writes that overlap with or border on queued requests
+ *        are merged into a single request (newer data wins).
+ * 
+ * @param drive drive number
+ * @param lba sector number
+ * @param nlba amount of sectors to write
+ * @param buf data to write
+ * @return err_t exit code (any error by driver when the queue had to be flushed first)
+ */
+err_t ioqueue_write(uint8_t drive, uint32_t lba, uint32_t nlba, const uint8_t *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    ioqueue_t *q = &ioqueues[drive];
+    uint32_t sector_size = disk_get_sector_size(drive);
+    uint32_t max_nlba = IOQUEUE_MAX_REQUEST_SIZE / sector_size;
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    // deadline for the oldest request
+    if(q->n && (timer_getCurrentTick() - q->oldest) > IOQUEUE_MAX_AGE)
+        err = ioqueue_flush(drive);
+
+    if(nlba > max_nlba)
+    {
+        err_t e = ioqueue_write_direct(drive, lba, nlba, buf);
+        return (err) ? err : e;
+    }
+
+    // the request we are building, starts as just the new data
+    ioqueue_req_t cur = {lba, nlba, evalloc(nlba * sector_size, PID_KERNEL)};
+
+    if(!cur.data)
+    {
+        err_t e = ioqueue_write_direct(drive, lba, nlba, buf);
+        return (err) ? err : e;
+    }
+
+    memcpy(cur.data, buf, nlba * sector_size);
+
+    uint32_t i = 0;
+    while(i < q->n)
+    {
+        ioqueue_req_t *r = &q->req[i];
+
+        // neither overlapping nor adjacent
+        if(r->lba > (cur.lba + cur.nlba) || (r->lba + r->nlba) < cur.lba)
+            { i++; continue; }
+        
+        uint32_t start = (r->lba < cur.lba) ? r->lba : cur.lba;
+        uint32_t end = ((r->lba + r->nlba) > (cur.lba + cur.nlba)) ? r->lba + r->nlba : cur.lba + cur.nlba;
+        uint8_t *data = (end - start <= max_nlba) ? evalloc((end - start) * sector_size, PID_KERNEL) : NULL;
+
+        // too large to merge (or out of memory): get the queue out of the way first
+        if(!data)
+        {
+            err_t e = ioqueue_flush(drive);
+            err = (err) ? err : e;
+            break;
+        }
+
+        // queued requests never overlap each other, so the only overlap r can have
+        // is with the newest data in cur, which goes on top
+        memcpy(&data[(r->lba - start) * sector_size], r->data, r->nlba * sector_size);
+        memcpy(&data[(cur.lba - start) * sector_size], cur.data, cur.nlba * sector_size);
+
+        vfree(cur.data);
+        vfree(r->data);
+        ioqueue_remove(q, i);
+
+        cur.lba = start;
+        cur.nlba = end - start;
+        cur.data = data;
+
+        // the grown request may now touch requests we have already passed
+        i = 0;
+    }
+
+    if(q->n >= IOQUEUE_MAX_REQUESTS)
+    {
+        err_t e = ioqueue_flush(drive);
+        err = (err) ? err : e;
+    }
+
+    if(!q->n)
+        q->oldest = timer_getCurrentTick();
+    
+    q->req[q->n++] = cur;
+
+    readahead_invalidate(drive, cur.lba, cur.nlba);
+
+    return err;
+}
+
+/**
+ * @brief Copies the data of queued writes over a buffer that was just read from
+ *        the device, so that reads see writes that have not been dispatched yet
+ * 
+ * @param drive drive number
+ * @param lba first sector in buf
+ * @param nlba amount of sectors in buf
+ * @param buf data read from the device
+ */
+void ioqueue_read_overlay(uint8_t drive, uint32_t lba, uint32_t nlba, uint8_t *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return;
+
+    ioqueue_t *q = &ioqueues[drive];
+    uint32_t sector_size = disk_get_sector_size(drive);
+
+    for(uint32_t i = 0; i < q->n; ++i)
+    {
+        ioqueue_req_t *r = &q->req[i];
+
+        if(r->lba >= (lba + nlba) || (r->lba + r->nlba) <= lba)
+            continue;
+        
+        uint32_t start = (r->lba > lba) ? r->lba : lba;
+        uint32_t end = ((r->lba + r->nlba) < (lba + nlba)) ? r->lba + r->nlba : lba + nlba;
+
+        memcpy(&buf[(start - lba) * sector_size], &r->data[(start - r->lba) * sector_size], (end - start) * sector_size);
+    }
+}
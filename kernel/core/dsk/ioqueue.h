@@ -0,0 +1,43 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __IOQUEUE_H__
+#define __IOQUEUE_H__
+
+#include "../include/types.h"
+
+#define IOQUEUE_MAX_REQUESTS        16U         // per drive
+#define IOQUEUE_MAX_REQUEST_SIZE    0x10000U    // bytes (64 KiB), largest merged request
+#define IOQUEUE_MAX_AGE             100U        // ms, deadline of the oldest queued request
+
+void ioqueue_plug(uint8_t drive);
+err_t ioqueue_unplug(uint8_t drive);
+err_t ioqueue_unplug_drives(uint32_t drives, err_t *errs);
+bool_t ioqueue_is_plugged(uint8_t drive);
+
+err_t ioqueue_write(uint8_t drive, uint32_t lba, uint32_t nlba, const uint8_t *buf);
+void ioqueue_read_overlay(uint8_t drive, uint32_t lba, uint32_t nlba, uint8_t *buf);
+err_t ioqueue_flush(uint8_t drive);
+err_t ioqueue_flush_drives(uint32_t drives, err_t *errs);
+
+#endif
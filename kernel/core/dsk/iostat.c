@@ -0,0 +1,132 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "iostat.h"
+#include "diskio.h"
+#include "diskdefines.h"
+
+#include "../include/types.h"
+
+#include "../hardware/timer.h"
+
+#include "../memory/paging.h"
+
+#include "../util/util.h"
+
+iostat_t iostats[DISKIO_MAX_DRIVES];
+
+// first sector (+ 1, 0 is empty) of recent read() requests, indexed by lba % IOSTAT_RECENT_READS
+uint32_t iostat_recent[DISKIO_MAX_DRIVES][IOSTAT_RECENT_READS];
+
+static uint8_t iostat_bucket(uint32_t us)
+{
+    uint8_t b = 0;
+
+    while(us && b < (IOSTAT_HIST_BUCKETS - 1))
+        { us = us >> 1; b++; }
+
+    return b;
+}
+
+/**
+ * @brief Accounts a finished request
+ * 
+ * @param drive drive number
+ * @param op IOSTAT_OP_*
+ * @param nlba number of sectors of the request
+ * @param err exit code of the request
+ * @param start timer_timestamp() from before the request was started
+ */
+void iostat_account(uint8_t drive, uint8_t op, uint32_t nlba, err_t err, uint32_t start)
+{
+    uint32_t us = timer_elapsed_us(start);
+
+    if(drive >= DISKIO_MAX_DRIVES || op >= IOSTAT_OPS)
+        return;
+
+    iostat_op_t *s = &iostats[drive].op[op];
+
+    s->ops++;
+    s->total_us = s->total_us + us;
+    s->max_us = (us > s->max_us) ? us : s->max_us;
+    s->hist[iostat_bucket(us)]++;
+
+    if(err)
+        { s->errors++; return; }
+    
+    s->sectors = s->sectors + nlba;
+    s->bytes = s->bytes + nlba * disk_get_sector_size(drive);
+}
+
+/**
+ * @brief Remembers the first sector of a read() request, counting it as re-read 
+ *        if it was read recently (e.g. the FAT driver reading the same FAT sector again)
+ * 
+ * @param drive drive number
+ * @param lba first sector
+ */
+void iostat_read_lba(uint8_t drive, uint32_t lba)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return;
+
+    uint32_t *recent = &iostat_recent[drive][lba % IOSTAT_RECENT_READS];
+
+    if(*recent == lba + 1)
+        iostats[drive].rereads++;
+    
+    *recent = lba + 1;
+}
+
+/**
+ * @brief Copies the statistics of all drives
+ * 
+ * @param pid owner of the copy
+ * @return iostat_t* DISKIO_MAX_DRIVES entries, indexed by drive number (NULL when out of memory)
+ */
+iostat_t *iostat_get_all(pid_t pid)
+{
+    iostat_t *all = evalloc(sizeof(iostats), pid);
+
+    if(!all)
+        return NULL;
+
+    memcpy(all, iostats, sizeof(iostats));
+
+    // diskio_get_caps() tells whether the drive exists
+    for(uint8_t i = 0; i < DISKIO_MAX_DRIVES; ++i)
+        if(diskio_get_caps(i))
+            drive_convert_to_drive_id(i, &all[i].name[0]);
+
+    return all;
+}
+
+/**
+ * @brief Clears the statistics of all drives
+ * 
+ */
+void iostat_reset(void)
+{
+    memset(iostats, sizeof(iostats), 0);
+    memset(iostat_recent, sizeof(iostat_recent), 0);
+}
@@ -0,0 +1,64 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __IOSTAT_H__
+#define __IOSTAT_H__
+
+#include "../include/types.h"
+#include "diskio.h"
+
+// iostat_t.op[]
+#define IOSTAT_OP_READ          0 // read() requests, including those served by readahead or caches
+#define IOSTAT_OP_WRITE         1 // write() requests, including those that were queued
+#define IOSTAT_OP_DEV_READ      2 // reads by the device
+#define IOSTAT_OP_DEV_WRITE     3 // writes by the device
+#define IOSTAT_OP_DEV_FLUSH     4 // write cache flushes by the device
+#define IOSTAT_OPS              5
+
+#define IOSTAT_HIST_BUCKETS     24 // log2(us), the last bucket holds everything from ~8 s
+#define IOSTAT_RECENT_READS     64 // per drive, for counting re-reads
+
+typedef struct iostat_op_t
+{
+    uint32_t ops;
+    uint32_t sectors;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t total_us;
+    uint32_t max_us;
+    uint32_t hist[IOSTAT_HIST_BUCKETS]; // hist[0]: < 1 us, hist[n]: [2^(n-1), 2^n) us
+} __attribute__((packed)) iostat_op_t;
+
+typedef struct iostat_t
+{
+    char name[DISKIO_MAX_LEN_DISKID]; // empty if there is no such drive
+    iostat_op_t op[IOSTAT_OPS];
+    uint32_t rereads; // read() requests starting at a sector that was read recently
+} __attribute__((packed)) iostat_t;
+
+void iostat_account(uint8_t drive, uint8_t op, uint32_t nlba, err_t err, uint32_t start);
+void iostat_read_lba(uint8_t drive, uint32_t lba);
+iostat_t *iostat_get_all(pid_t pid);
+void iostat_reset(void);
+
+#endif
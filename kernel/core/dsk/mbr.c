@@ -44,8 +44,6 @@ SOFTWARE.
 #define MBR_PARTENTRY_START 0x1BE
 #define MBR_PARTENTRY_SIZE  16
 
-#define MBR_MAX_PARTITIONS  4 // per disk
-
 typedef struct /* only the mbr info that's interesting to us */
 {
   uint8_t active;
@@ -67,33 +65,32 @@ uint8_t nDisks;
 static void MBR_printAll(void);
 #endif
 
-static uint8_t MBR_getIDEDrives(uint8_t *drives);
+static uint8_t MBR_getDrives(uint8_t *drives);
 
-/* enumerates the MBRs of all present (only IDE for now) harddisks in the system */
+/* enumerates the MBRs of all present harddisks (IDE and the RAM disk) in the system,
+    DISKS is indexed by drive number */
 void MBR_enumerate(void)
 {
     uint32_t *mbr_entry;
-    uint8_t *mbr, disks;
-    uint8_t i, j, error;
+    uint8_t *mbr;
+    uint8_t i, j, error = 0;
 
     memset(&DISKS[0], sizeof(MBR) * MAX_DRIVES, 0xFF);
 
     uint8_t *drives = diskio_reportDrives();
-    nDisks = disks = MBR_getIDEDrives(drives);
+    nDisks = MBR_getDrives(drives);
 
     if(nDisks < 1)
-        return;
+        { kfree(drives); return; }
 
     mbr = (uint8_t *) kmalloc(DEFAULT_SECTOR_SIZE);
 
-    /* this is IDE only, if floppy's are introduced this should be moved
-        to a seperate function */
-    for(i = 0; i < disks; ++i)
+    for(i = 0; i < MAX_DRIVES; ++i)
     {
-        if(drives[i] != DRIVE_TYPE_IDE_PATA)
+        if(DISKS[i].disk != i)
             continue;
         
-        error = read(DISKS[i].disk, 0U, 1U, mbr);
+        error = read(i, 0U, 1U, mbr);
         
         if(error)
             break;
@@ -155,6 +152,10 @@ uint32_t mbr_get_sector_count(uint8_t disk, uint8_t partition)
 
 uint8_t mbr_get_type(uint8_t disk, uint8_t partition)
 {
+    // a whole disk (0xFF) is not a partition
+    if(partition >= MBR_MAX_PARTITIONS)
+        return 0xFF;
+
     return DISKS[disk].mbr_entry_t[partition].type;
 }
 
@@ -162,14 +163,22 @@ uint8_t mbr_get_type(uint8_t disk, uint8_t partition)
 static void MBR_printAll(void)
 {
     uint8_t i, j;
-    for(i = 0; i < nDisks; ++i)
+    char id[DISKIO_MAX_LEN_DISKID];
+
+    for(i = 0; i < MAX_DRIVES; ++i)
     {
+    if(DISKS[i].disk != i)
+        continue;
+    
+    drive_convert_to_drive_id(i, id);
+
     for(j = 0; j < 4; ++j)
     {
         if(!DISKS[i].mbr_entry_t[j].start_LBA)
         continue;
 
-        print_value("[PARTITIONS] HD%i", DISKS[i].disk);
+        print("[PARTITIONS] ");
+        print(id);
         print_value("p%i: ", j);
         print_value("lba %i, ", DISKS[i].mbr_entry_t[j].start_LBA);
         print_value("active: %x, ", DISKS[i].mbr_entry_t[j].active);
@@ -183,12 +192,12 @@ static void MBR_printAll(void)
 #endif
 
 
-static uint8_t MBR_getIDEDrives(uint8_t *drives)
+static uint8_t MBR_getDrives(uint8_t *drives)
 {
     uint8_t i = 0, disks = 0;
-    for(; i < IDE_DRIVER_MAX_DRIVES; ++i)
+    for(; i < MAX_DRIVES; ++i)
     {
-        if(drives[i] == DRIVE_TYPE_IDE_PATA) DISKS[disks++].disk = i;
+        if(DRIVE_TYPE_HAS_MBR(drives[i])) { DISKS[i].disk = i; disks++; }
     }
 
     return disks;
@@ -24,6 +24,8 @@ SOFTWARE.
 #ifndef MBR_H
 #define MBR_H
 
+#define MBR_MAX_PARTITIONS  4 // per disk
+
 void MBR_enumerate(void);
 void mbr_initialize_fs_drivers(void);
 unsigned int MBR_getStartLBA(unsigned char disk, unsigned char partition);
@@ -0,0 +1,146 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ramdisk.h"
+#include "diskdefines.h"
+
+#include "../include/types.h"
+#include "../include/exit_code.h"
+
+#include "../boot/loader.h"
+
+#include "../memory/paging.h"
+
+#include "../exec/task.h"
+
+#include "../util/util.h"
+
+#ifndef NO_DEBUG_INFO
+#include "../screen/screen_basic.h"
+#endif
+
+// The RAM disk is the first boot module (e.g. `module /ramdisk.img` in grub.cfg), a raw
+// disk image with an MBR. The loader has moved it to the top of memory, we only take
+// ownership of those pages so that nothing else gets them.
+uint8_t *rd_image = NULL;
+uint32_t rd_sectors = 0;
+
+/**
+ * @brief Takes ownership of the boot module and makes it available as RAM disk (RD0)
+ * 
+ * @return err_t EXIT_CODE_GLOBAL_NOT_INITIALIZED if there is no boot module, 
+ *               EXIT_CODE_GLOBAL_RESERVED if its memory is already in use
+ */
+err_t ramdisk_init(void)
+{
+    LOADER_INFO info = loader_get_infoStruct();
+
+    if(info.module_size < RAMDISK_SECTOR_SIZE)
+        return EXIT_CODE_GLOBAL_NOT_INITIALIZED;
+
+    if(!paging_claim((void *) info.module_start, info.module_size, PID_KERNEL))
+        return EXIT_CODE_GLOBAL_RESERVED;
+
+    rd_image = (uint8_t *) info.module_start;
+    rd_sectors = info.module_size / RAMDISK_SECTOR_SIZE;
+
+#ifndef NO_DEBUG_INFO
+    print_value("[RAMDISK] RD0: %i sectors\n\n", rd_sectors);
+#endif
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/**
+ * @brief Returns whether there is a RAM disk
+ * 
+ * @return bool_t TRUE when ramdisk_init() found an image
+ */
+bool_t ramdisk_present(void)
+{
+    return (rd_image != NULL);
+}
+
+static err_t ramdisk_check(uint8_t unit, uint32_t lba, uint32_t nlba)
+{
+    if(unit != RAMDISK_DRIVE || !rd_image)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    
+    if(lba >= rd_sectors || nlba > (rd_sectors - lba))
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+static err_t ramdisk_read(uint8_t unit, uint32_t lba, uint32_t nlba, uint8_t *buf)
+{
+    err_t err = ramdisk_check(unit, lba, nlba);
+
+    if(err)
+        return err;
+
+    memcpy(buf, &rd_image[lba * RAMDISK_SECTOR_SIZE], nlba * RAMDISK_SECTOR_SIZE);
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+static err_t ramdisk_write(uint8_t unit, uint32_t lba, uint32_t nlba, const uint8_t *buf)
+{
+    err_t err = ramdisk_check(unit, lba, nlba);
+
+    if(err)
+        return err;
+
+    memcpy(&rd_image[lba * RAMDISK_SECTOR_SIZE], buf, nlba * RAMDISK_SECTOR_SIZE);
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+static err_t ramdisk_caps(uint8_t unit, blkdev_caps_t *caps)
+{
+    if(unit != RAMDISK_DRIVE || !rd_image)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+    
+    memset(caps, sizeof(blkdev_caps_t), 0);
+
+    caps->sector_size = RAMDISK_SECTOR_SIZE;
+    caps->max_lba = rd_sectors - 1;
+    caps->max_transfer = rd_sectors;
+    caps->flags = (uint8_t) (BLKDEV_CAP_WRITE | BLKDEV_CAP_MEMORY);
+    memcpy(caps->model, RAMDISK_MODEL, sizeof(RAMDISK_MODEL));
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/**
+ * @brief Fills in the block device operations of the RAM disk. There is nothing to flush and
+ *        nothing to overlap, so flush and submit are left NULL.
+ * 
+ * @param ops output: operations
+ */
+void ramdisk_get_blkdev_ops(blkdev_ops_t *ops)
+{
+    memset(ops, sizeof(blkdev_ops_t), 0);
+
+    ops->read = ramdisk_read;
+    ops->write = ramdisk_write;
+    ops->caps = ramdisk_caps;
+}
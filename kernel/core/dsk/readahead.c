@@ -0,0 +1,199 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "readahead.h"
+#include "diskio.h"
+#include "diskdefines.h"
+
+#include "../include/types.h"
+#include "../include/exit_code.h"
+
+#include "../memory/paging.h"
+
+#include "../exec/task.h"
+
+#include "../util/util.h"
+
+// A stream is one sequential reader on a drive (e.g. the FAT driver reading
+// the clusters of a file while it also reads directory clusters elsewhere).
+// Each stream owns a window buffer holding the sectors read ahead of it.
+typedef struct readahead_stream_t
+{
+    uint8_t *buffer;        // window contents (READAHEAD_MAX_WINDOW_SIZE bytes)
+    uint32_t start;         // first lba held in buffer
+    uint32_t count;         // number of valid sectors in buffer
+    uint32_t next_lba;      // lba we expect the next sequential read to start at
+    uint32_t window;        // current window size, in sectors
+    uint32_t last_used;     // for replacing the least recently used stream
+} readahead_stream_t;
+
+readahead_stream_t ra_streams[DISKIO_MAX_DRIVES][READAHEAD_STREAMS];
+uint32_t ra_clock = 0;
+
+static uint32_t readahead_max_window(uint8_t drive)
+{
+    return READAHEAD_MAX_WINDOW_SIZE / disk_get_sector_size(drive);
+}
+
+// MAX if the size of the drive is unknown (e.g. CD drives)
+static uint32_t readahead_last_lba(uint8_t drive)
+{
+    uint32_t max_lba = disk_get_max_addr(drive);
+    return (max_lba) ? max_lba : MAX;
+}
+
+static readahead_stream_t *readahead_find_stream(uint8_t drive, uint32_t lba, uint32_t nlba)
+{
+    readahead_stream_t *s = &ra_streams[drive][0];
+
+    // a read that lies within a window or continues where a stream left off
+    // belongs to that stream
+    for(uint32_t i = 0; i < READAHEAD_STREAMS; ++i)
+    {
+        if(!s[i].window)
+            continue;
+
+        if(s[i].count && lba >= s[i].start && (lba + nlba) <= (s[i].start + s[i].count))
+            return &s[i];
+
+        if(lba == s[i].next_lba)
+            return &s[i];
+    }
+
+    return NULL;
+}
+
+static readahead_stream_t *readahead_new_stream(uint8_t drive, uint32_t lba, uint32_t nlba)
+{
+    readahead_stream_t *s = &ra_streams[drive][0];
+    readahead_stream_t *victim = &s[0];
+
+    for(uint32_t i = 1; i < READAHEAD_STREAMS; ++i)
+        if(s[i].last_used < victim->last_used)
+            victim = &s[i];
+
+    // keep the buffer, the contents are no longer of any use though
+    victim->count = 0;
+    victim->next_lba = lba + nlba;
+    victim->window = READAHEAD_MIN_WINDOW;
+    victim->last_used = ra_clock;
+
+    return victim;
+}
+
+/**
+ * @brief Reads sectors through the readahead windows of a drive. A read that continues
+ *        where a previous read of the same stream ended is considered sequential and
+ *        fills the window past the requested sectors, so the following reads of that
+ *        stream are served from memory. The window doubles on every refill, up to
+ *        READAHEAD_MAX_WINDOW_SIZE bytes. Random reads go to the device directly.
+ *
+ * @param drive drive number
+ * @param lba sector number
+ * @param nlba amount of sectors to read
+ * @param buf output buffer for content
+ * @return uint8_t exit code (any error by driver)
+ */
+uint8_t readahead_read(uint8_t drive, uint32_t lba, uint32_t nlba, uint8_t *buf)
+{
+    ra_clock++;
+
+    uint32_t sector_size = disk_get_sector_size(drive);
+    readahead_stream_t *s = readahead_find_stream(drive, lba, nlba);
+
+    if(!s)
+    {
+        readahead_new_stream(drive, lba, nlba);
+        return diskio_device_read(drive, lba, nlba, buf);
+    }
+
+    s->last_used = ra_clock;
+
+    // hit: the window already holds everything we need
+    if(s->count && lba >= s->start && (lba + nlba) <= (s->start + s->count))
+    {
+        memcpy(buf, &s->buffer[(lba - s->start) * sector_size], nlba * sector_size);
+        s->next_lba = lba + nlba;
+        return EXIT_CODE_GLOBAL_SUCCESS;
+    }
+
+    // sequential miss: grow the window and refill it
+    uint32_t max_window = readahead_max_window(drive);
+    s->window = s->window * 2;
+    s->window = (s->window > max_window) ? max_window : s->window;
+    s->next_lba = lba + nlba;
+
+    // large reads gain nothing from the window
+    if(nlba >= s->window)
+        { s->count = 0; return diskio_device_read(drive, lba, nlba, buf); }
+
+    if(!s->buffer)
+        s->buffer = evalloc(READAHEAD_MAX_WINDOW_SIZE, PID_KERNEL);
+    
+    if(!s->buffer)
+        { s->count = 0; return diskio_device_read(drive, lba, nlba, buf); }
+
+    uint32_t window = s->window;
+    uint32_t last_lba = readahead_last_lba(drive);
+
+    // do not read past the end of the drive
+    if(last_lba != MAX && (lba + window - 1) > last_lba)
+        window = (last_lba >= lba) ? last_lba - lba + 1 : 0;
+
+    if(window <= nlba)
+        { s->count = 0; return diskio_device_read(drive, lba, nlba, buf); }
+
+    // the readahead part of a refill is allowed to fail (e.g., end of medium),
+    // in that case just read what was requested
+    if(diskio_device_read(drive, lba, window, s->buffer))
+        { s->count = 0; return diskio_device_read(drive, lba, nlba, buf); }
+
+    s->start = lba;
+    s->count = window;
+
+    memcpy(buf, s->buffer, nlba * sector_size);
+
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
+
+/**
+ * @brief Drops every readahead window of a drive that overlaps with the range
+ *        of sectors given (e.g., because they were written to)
+ * 
+ * @param drive drive number
+ * @param lba first sector of the range
+ * @param nlba amount of sectors in the range
+ */
+void readahead_invalidate(uint8_t drive, uint32_t lba, uint32_t nlba)
+{
+    readahead_stream_t *s = &ra_streams[drive][0];
+
+    for(uint32_t i = 0; i < READAHEAD_STREAMS; ++i)
+    {
+        if(!s[i].count)
+            continue;
+        
+        if(lba < (s[i].start + s[i].count) && (lba + nlba) > s[i].start)
+            s[i].count = 0;
+    }
+}
@@ -0,0 +1,36 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef __READAHEAD_H__
+#define __READAHEAD_H__
+
+#include "../include/types.h"
+
+#define READAHEAD_MIN_WINDOW        8U          // sectors
+#define READAHEAD_MAX_WINDOW_SIZE   0x10000U    // bytes (64 KiB)
+#define READAHEAD_STREAMS           2U          // per drive
+
+uint8_t readahead_read(uint8_t drive, uint32_t lba, uint32_t nlba, uint8_t *buf);
+void readahead_invalidate(uint8_t drive, uint32_t lba, uint32_t nlba);
+
+#endif
@@ -25,7 +25,21 @@ SOFTWARE.
 
 #include "../include/types.h"
 
-uint32_t ticks = 0;
+#include "../io/io.h"
+
+#define TIMER_PIT_CLOCK         1193182U    // Hz
+#define TIMER_PIT_RELOAD        1193U       // as programmed by PITInit() for 1000 Hz
+#define TIMER_PIT_CHANNEL0      0x40
+#define TIMER_PIT_COMMAND       0x43
+
+#define TIMER_CALIBRATE_TICKS   25U         // ms
+
+#define CPUID_FEATURE_TSC       (1U << 4)   // edx of leaf 1
+
+extern const uint8_t CPUID_AVAILABLE;
+
+volatile uint32_t ticks = 0;
+uint32_t tsc_per_us = 0; // 0 if there is no (calibrated) time stamp counter
 
 uint32_t timer_getCurrentTick(void)
 {
@@ -36,4 +50,170 @@ void timer_incTicks(void)
 {
     if(++ticks == MAX) 
         ticks = 0;
-}
\ No newline at end of file
+}
+
+// only the low half is used, delays never come close to 2^32 cycles
+static uint32_t timer_rdtsc(void)
+{
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+    
+    return lo;
+}
+
+static bool_t timer_has_tsc(void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    if(!CPUID_AVAILABLE)
+        return FALSE;
+    
+    __asm__ __volatile__("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+
+    return (edx & CPUID_FEATURE_TSC) ? TRUE : FALSE;
+}
+
+static uint16_t timer_pit_read(void)
+{
+    outb(TIMER_PIT_COMMAND, 0x00); // latch channel 0
+    
+    uint16_t lo = inb(TIMER_PIT_CHANNEL0);
+    uint16_t hi = inb(TIMER_PIT_CHANNEL0);
+
+    return (uint16_t) ((hi << 8) | lo);
+}
+
+static void timer_tsc_wait(uint32_t cycles)
+{
+    uint32_t start = timer_rdtsc();
+
+    while((timer_rdtsc() - start) < cycles)
+        __asm__ __volatile__("pause");
+}
+
+// fallback for cpus without a time stamp counter, busy-waits on the counter of the PIT
+static void timer_pit_wait(uint32_t clocks)
+{
+    uint16_t prev = timer_pit_read();
+    uint32_t elapsed = 0;
+
+    while(elapsed < clocks)
+    {
+        uint16_t cur = timer_pit_read();
+
+        // mode 3 counts down by two every clock, from the reload value to zero
+        uint32_t delta = (cur <= prev) ? (uint32_t) (prev - cur) : (uint32_t) (prev + TIMER_PIT_RELOAD - cur);
+        elapsed = elapsed + delta / 2;
+
+        prev = cur;
+    }
+}
+
+/**
+ * @brief Measures the frequency of the time stamp counter against the PIT, so that 
+ *        ndelay() and udelay() do not need to poll the PIT. Interrupts must be enabled.
+ * 
+ */
+void timer_calibrate(void)
+{
+    if(!timer_has_tsc())
+        return;
+
+    // start right at a tick
+    uint32_t t = ticks;
+    while(ticks == t)
+        __asm__ __volatile__("pause");
+    
+    t = ticks;
+    uint32_t start = timer_rdtsc();
+
+    while((ticks - t) < TIMER_CALIBRATE_TICKS)
+        __asm__ __volatile__("pause");
+    
+    uint32_t cycles = timer_rdtsc() - start;
+
+    // round up, waiting slightly too long is fine, too short is not
+    tsc_per_us = cycles / (TIMER_CALIBRATE_TICKS * 1000U) + 1;
+}
+
+/**
+ * @brief Busy-waits for at least `us` microseconds
+ * 
+ * @param us microseconds
+ */
+void udelay(uint32_t us)
+{
+    while(us)
+    {
+        uint32_t n = (us > 1000U) ? 1000U : us;
+
+        if(tsc_per_us)
+            timer_tsc_wait(n * tsc_per_us);
+        else
+            timer_pit_wait((n * (TIMER_PIT_CLOCK / 1000U)) / 1000U + 1);
+
+        us = us - n;
+    }
+}
+
+/**
+ * @brief Busy-waits for at least `ns` nanoseconds (granularity is one cycle of the 
+ *        time stamp counter, or about 840 ns without one)
+ * 
+ * @param ns nanoseconds
+ */
+void ndelay(uint32_t ns)
+{
+    udelay(ns / 1000U);
+
+    ns = ns % 1000U;
+
+    if(!ns)
+        return;
+    
+    if(tsc_per_us)
+        timer_tsc_wait((ns * tsc_per_us + 999U) / 1000U);
+    else
+        timer_pit_wait(1);
+}
+
+/**
+ * @brief Returns a timestamp to measure intervals with, see timer_elapsed_us(). It is taken
+ *        from the whole time stamp counter, so slow requests (a CD spinning up) are measured 
+ *        correctly; intervals only wrap around after about 71 minutes
+ * 
+ * @return uint32_t microseconds since boot
+ */
+uint32_t timer_timestamp(void)
+{
+    return timer_get_us();
+}
+
+/**
+ * @brief Returns the time that has passed since a timestamp
+ * 
+ * @param start timestamp returned by timer_timestamp()
+ * @return uint32_t microseconds
+ */
+uint32_t timer_elapsed_us(uint32_t start)
+{
+    return timer_get_us() - start;
+}
+
+/**
+ * @brief Returns a microsecond clock, for programs that time things (wraps around after about 71 minutes)
+ * 
+ * @return uint32_t microseconds since boot
+ */
+uint32_t timer_get_us(void)
+{
+    if(!tsc_per_us)
+        return ticks * 1000U;
+
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+
+    unsigned long long cycles = ((unsigned long long) hi << 32) | lo;
+
+    return (uint32_t) (cycles / tsc_per_us);
+}
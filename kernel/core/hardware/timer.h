@@ -27,6 +27,14 @@ SOFTWARE.
 unsigned int timer_getCurrentTick(void);
 void timer_incTicks(void);
 
+void timer_calibrate(void);
+void ndelay(unsigned int ns);
+void udelay(unsigned int us);
+
+unsigned int timer_timestamp(void);
+unsigned int timer_elapsed_us(unsigned int start);
+unsigned int timer_get_us(void);
+
 extern void PITInit(void);
 
 #endif
\ No newline at end of file
@@ -148,6 +148,10 @@ void kernel_api_handler(void *req)
             hdr->response_ptr = (void *) timer_getCurrentTick();
         break;
         
+        case SYSCALL_GET_MICROSECONDS:
+            hdr->response_ptr = (void *) timer_get_us();
+        break;
+
         case SYSCALL_SLEEP:
         {
             sleep_request_t *r = (sleep_request_t *) req;
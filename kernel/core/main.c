@@ -42,6 +42,7 @@ SOFTWARE.
 #include "hardware/pci.h"
 #include "hardware/pic.h"
 #include "hardware/driver.h"
+#include "hardware/timer.h"
 
 #include "dbg/dbg.h"
 
@@ -95,6 +96,7 @@ void init_env(void)
 
     IDT_setup();
     CPU_init();
+    timer_calibrate();
 
     exit_code = memory_init();
     
@@ -205,6 +205,54 @@ void vfree(void *ptr)
         shadow_t[page_id + i].pid = PID_RESV;
 }
 
+// checks that every page in [ptr, ptr + size) is allocated to pid
+bool_t paging_check_owner(const void *ptr, size_t size, const pid_t pid)
+{
+    uint32_t start = (uint32_t) ptr;
+
+    if(!ptr || !size || (start + size) < start)
+        return FALSE;
+
+    uint32_t first = start / PAGING_PAGE_SIZE;
+    uint32_t last = (start + size - 1) / PAGING_PAGE_SIZE;
+
+    if(last >= shadow_len)
+        return FALSE;
+
+    for(uint32_t i = first; i <= last; ++i)
+        if(shadow_t[i].pid != pid)
+            return FALSE;
+
+    return TRUE;
+}
+
+// allocates the pages of a fixed memory region (e.g. a boot module) to pid,
+// fails if any of them is already in use
+bool_t paging_claim(void *ptr, size_t size, const pid_t pid)
+{
+    uint32_t start = (uint32_t) ptr;
+
+    if(!ptr || !size || (start + size) < start)
+        return FALSE;
+
+    uint32_t first = start / PAGING_PAGE_SIZE;
+    uint32_t last = (start + size - 1) / PAGING_PAGE_SIZE;
+
+    if(last >= shadow_len || (last - first + 1) > 0xFFFF /* npages */)
+        return FALSE;
+
+    for(uint32_t i = first; i <= last; ++i)
+        if(shadow_t[i].pid != PID_RESV)
+            return FALSE;
+
+    for(uint32_t i = first; i <= last; ++i)
+        shadow_t[i].pid = pid;
+    
+    shadow_t[first].npages = (uint16_t) (last - first + 1);
+
+    return TRUE;
+}
+
 // release all resources belonging to program with this pid
 void paging_rel_resources(const pid_t pid)
 {
@@ -49,6 +49,8 @@ uint32_t paging_get_max_pages(void);
 void *evalloc(size_t size, pid_t pid);
 void vfree(void *ptr);
 void paging_rel_resources(const pid_t pid);
+bool_t paging_check_owner(const void *ptr, size_t size, const pid_t pid);
+bool_t paging_claim(void *ptr, size_t size, const pid_t pid);
 
 extern void ASM_CPU_PAGING_ENABLE(unsigned int *table);
 extern void ASM_CPU_INVLPG(void *paddr);
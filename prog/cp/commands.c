@@ -42,6 +42,7 @@ SOFTWARE.
 
 #define DIR_DIRTXT_INDENT   18
 #define DIR_FILESIZE_INDENT 26
+#define DIR_READ_ENTRIES    16  // directory entries read at once
 
 #define HELP_TXT_INDENT     20
 
@@ -303,60 +304,76 @@ err_t command_dir(void)
     getcwd(path, &len);
 
     err_t err = 0;
-    fs_dir_contents_t *dir = fs_dir_get_contents(path, &len, &err);
+    uint32_t handle = fs_opendir(path, 0, &err);
 
     vfree(path);
 
     if(err)
         return err;
 
+    // the directory is read a few entries at a time, so that the first ones are
+    // shown right away (and huge directories do not need a huge buffer)
+    fs_dir_contents_t *dir = valloc(DIR_READ_ENTRIES * sizeof(fs_dir_contents_t));
+
+    if(!dir)
+        { fs_close(handle); return EXIT_CODE_GLOBAL_OUT_OF_MEMORY; }
+
     uint16_t scr_width = screen_get_width();
     uint16_t scr_height = screen_get_height();
 
     uint8_t x = 0, y = 0;
     size_t total_size = 0;
+    uint32_t n_items = 0;
+    bool_t quit = FALSE;
     char s[24];
     
-    for(uint32_t i = 0; i < len; ++i)
+    while(!quit && (len = fs_readdir(handle, dir, DIR_READ_ENTRIES, &err)) && !err)
     {
-        screen_print(" ");
-
-        screen_get_cursor_pos(screen_get_width(), &x, &y);
-        screen_print(dir[i].name);       
-        
-        screen_set_cursor_pos(DIR_DIRTXT_INDENT, y);
-        if((dir[i].attrib & FAT_FILE_ATTRIB_DIR) == FAT_FILE_ATTRIB_DIR)
-            screen_print("<DIR>");
-        else 
+        for(uint32_t i = 0; i < len; ++i)
         {
-            screen_set_cursor_pos(DIR_FILESIZE_INDENT, y);
+            screen_print(" ");
+
+            screen_get_cursor_pos(screen_get_width(), &x, &y);
+            screen_print(dir[i].name);       
             
-            total_size += dir[i].file_size;
-            str_add_val(s, "%i b", dir[i].file_size);
-            screen_print(s);
-        }
+            screen_set_cursor_pos(DIR_DIRTXT_INDENT, y);
+            if((dir[i].attrib & FAT_FILE_ATTRIB_DIR) == FAT_FILE_ATTRIB_DIR)
+                screen_print("<DIR>");
+            else 
+            {
+                screen_set_cursor_pos(DIR_FILESIZE_INDENT, y);
+                
+                total_size += dir[i].file_size;
+                str_add_val(s, "%i b", dir[i].file_size);
+                screen_print(s);
+            }
 
-        screen_print("\n");
+            screen_print("\n");
+            n_items++;
 
-        if(len < (scr_height - 1u))
-            continue;
+            if(n_items < (scr_height - 1u))
+                continue;
 
-        more_t next_action = command_more(scr_width, scr_height);
-        
-        if(next_action == QUIT)
-            break;
-        else if(next_action == ALL_OK)
-            continue;
-                
-        screen_clear();
-        screen_print("\n");
-    }  
+            more_t next_action = command_more(scr_width, scr_height);
+            
+            if(next_action == QUIT)
+                { quit = TRUE; break; }
+            else if(next_action == ALL_OK)
+                continue;
+                    
+            screen_clear();
+            screen_print("\n");
+        }
+    }
+
+    fs_close(handle);
+    vfree(dir);
 
     screen_print("\n");
 
     screen_get_cursor_pos(screen_get_width(), &x, &y);
     screen_set_cursor_pos(DIR_DIRTXT_INDENT, y);
-    str_add_val(s, "%i items\n", len);
+    str_add_val(s, "%i items\n", n_items);
     screen_print(s);
 
     screen_get_cursor_pos(screen_get_width(), &x, &y);
@@ -365,8 +382,6 @@ err_t command_dir(void)
     screen_print(s);
     screen_print("bytes total\n");
 
-    vfree(dir);  
-
     return err; 
 }
 
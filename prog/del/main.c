@@ -60,7 +60,7 @@ err_t main(uint32_t argc, char **argv)
         screen_print("Usage: del.elf filename [-f]\n\n"
                      "\t -f (optional) - force delete\n"
                      "\t filename - path to file or directory to delete\n\t\t(starting at current working directory)\n\n"
-                     "\nNote: contents of directory are not automatically deleted\n"); 
+                     "\nNote: contents of directory are not automatically deleted, a directory has to be empty\n"); 
         return EXIT_CODE_GLOBAL_INVALID; 
     }
 
@@ -94,7 +94,11 @@ err_t main(uint32_t argc, char **argv)
 
     err = fs_delete_file(cwd);
 
-    if(err)
+    if(err == EXIT_CODE_FS_DIR_NOT_EMPTY)
+        screen_print("directory not empty.\n");
+    else if(err == EXIT_CODE_FS_FILE_IN_USE)
+        screen_print("file is in use.\n");
+    else if(err)
         screen_print("failed to delete file.\n");
 
     vfree(cwd);
@@ -0,0 +1,484 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "types.h"
+#include "exit_code.h"
+#include "screen.h"
+#include "kernel.h"
+#include "disk.h"
+#include "fs.h"
+#include "memory.h"
+#include "util.h"
+
+// raw disk tests
+#define SEQ_CHUNK_SECTORS       64      // per request (32 KiB on a hard disk)
+#define SEQ_TOTAL_SECTORS       16384   // 8 MiB on a hard disk, random requests stay within this region as well
+#define RAND_SECTORS            8       // per request (4 KiB on a hard disk)
+#define RAND_REQUESTS           256
+#define RAND_SEED               0x2BADB002
+
+// file system tests
+#define BENCH_DIR               "/DBENCH"
+#define SMALL_FILE_SIZE         4096    // bytes
+#define SMALL_FILES             256
+#define LARGE_FILE_SIZE         0x100000 // 1 MiB
+#define LOOKUP_REPEAT           16
+#define LOOKUP_DEPTH            4
+
+#define MAX_RESULTS             24
+#define NAME_LEN                24
+#define COL_WIDTH               10
+#define LINE_SIZE               64
+
+typedef struct result_t
+{
+    char name[NAME_LEN];
+    uint32_t ops;
+    uint32_t bytes;
+    uint32_t us;
+    bool_t skipped;
+} result_t;
+
+result_t results[MAX_RESULTS];
+uint32_t n_results = 0;
+
+uint32_t rand_state = RAND_SEED;
+
+// same sequence every run, so that runs can be compared
+static uint32_t bench_rand(void)
+{
+    rand_state = rand_state * 1103515245U + 12345U;
+    return rand_state >> 8;
+}
+
+static result_t *new_result(const char *format, uint32_t value)
+{
+    if(n_results >= MAX_RESULTS)
+        return NULL;
+
+    result_t *r = &results[n_results++];
+    memset(r, sizeof(result_t), 0);
+    str_add_val(r->name, format, value);
+
+    return r;
+}
+
+// builds `base` + `name` + `n` (decimal) in out
+static void make_path(char *out, const char *base, const char *name, uint32_t n)
+{
+    size_t len = strlen(base);
+    memcpy(out, base, len);
+    memcpy(&out[len], name, strlen(name));
+    len = len + strlen(name);
+
+    char *s = intstr(n);
+    memcpy(&out[len], s, strlen(s) + 1);
+}
+
+/* ---- raw disk ---- */
+
+// the sector size of a whole drive (e.g. CD0), 0 if there is no such drive
+static size_t drive_sector_size(const char *drive)
+{
+    size_t size, sector_size = 0;
+    disk_info_t *list = disk_get_drive_list(&size);
+    uint32_t nth = strdigit_to_int(drive[2]);
+
+    if(!list)
+        return 0;
+
+    // the list only holds the type of each drive (HD, CD, RD): HD1 is the second HD in it
+    for(uint32_t i = 0; i < (size / sizeof(disk_info_t)) && !sector_size; ++i)
+    {
+        if((list[i].name[0] & ~0x20) != (drive[0] & ~0x20) || (list[i].name[1] & ~0x20) != (drive[1] & ~0x20))
+            continue;
+        
+        if(!nth--)
+            sector_size = list[i].sector_size;
+    }
+
+    vfree(list);
+    return sector_size;
+}
+
+static void bench_seq(char *drive, size_t sector_size, uint8_t *bfr, uint32_t *span)
+{
+    result_t *rd = new_result("%s", (uint32_t) "seq read");
+    result_t *wr = new_result("%s", (uint32_t) "seq write");
+    size_t size = SEQ_CHUNK_SECTORS * sector_size;
+    uint32_t lba;
+
+    for(lba = 0; lba < SEQ_TOTAL_SECTORS; lba += SEQ_CHUNK_SECTORS)
+    {
+        uint32_t start = kernel_get_microseconds();
+        
+        // the drive is smaller than the region, stop at its end
+        if(disk_absolute_read_into(drive, lba, SEQ_CHUNK_SECTORS, bfr, size))
+            break;
+        
+        rd->us += kernel_get_microseconds() - start;
+        rd->ops++;
+        rd->bytes += size;
+    }
+
+    *span = lba;
+
+    // writes put back what is already there, so nothing gets lost
+    for(lba = 0; lba < *span; lba += SEQ_CHUNK_SECTORS)
+    {
+        if(disk_absolute_read_into(drive, lba, SEQ_CHUNK_SECTORS, bfr, size))
+            break;
+
+        uint32_t start = kernel_get_microseconds();
+
+        if(disk_absolute_write(drive, lba, bfr, size))
+            { wr->skipped = TRUE; break; }
+
+        wr->us += kernel_get_microseconds() - start;
+        wr->ops++;
+        wr->bytes += size;
+    }
+}
+
+static void bench_rand_io(char *drive, size_t sector_size, uint8_t *bfr, uint32_t span)
+{
+    result_t *rd = new_result("%s", (uint32_t) "rand read");
+    result_t *wr = new_result("%s", (uint32_t) "rand write");
+    size_t size = RAND_SECTORS * sector_size;
+
+    if(span < RAND_SECTORS)
+        { rd->skipped = wr->skipped = TRUE; return; }
+
+    uint32_t lbas = span / RAND_SECTORS;
+
+    for(uint32_t i = 0; i < RAND_REQUESTS; ++i)
+    {
+        uint32_t lba = (bench_rand() % lbas) * RAND_SECTORS;
+        uint32_t start = kernel_get_microseconds();
+
+        if(disk_absolute_read_into(drive, lba, RAND_SECTORS, bfr, size))
+            { rd->skipped = TRUE; break; }
+
+        rd->us += kernel_get_microseconds() - start;
+        rd->ops++;
+        rd->bytes += size;
+
+        if(wr->skipped)
+            continue;
+
+        start = kernel_get_microseconds();
+
+        if(disk_absolute_write(drive, lba, bfr, size))
+            { wr->skipped = TRUE; continue; }
+        
+        wr->us += kernel_get_microseconds() - start;
+        wr->ops++;
+        wr->bytes += size;
+    }
+}
+
+/* ---- file system ---- */
+
+static void bench_lookup(result_t *r, char *path)
+{
+    err_t err;
+
+    for(uint32_t i = 0; i < LOOKUP_REPEAT; ++i)
+    {
+        uint32_t start = kernel_get_microseconds();
+        fs_file_info_t *info = fs_file_get_info(path, &err);
+        
+        if(err)
+            { r->skipped = TRUE; return; }
+
+        r->us += kernel_get_microseconds() - start;
+        r->ops++;
+
+        vfree(info);
+    }
+}
+
+static void bench_files(const char *base, uint8_t *bfr, char *path)
+{
+    result_t *create = new_result("%s", (uint32_t) "file create");
+    result_t *read = new_result("%s", (uint32_t) "file read");
+    result_t *rewrite = new_result("%s", (uint32_t) "file rewrite");
+    result_t *del = new_result("%s", (uint32_t) "file delete");
+    uint32_t next_lookup = 16;
+    err_t err;
+
+    for(uint32_t i = 0; i < SMALL_FILES; ++i)
+    {
+        make_path(path, base, "/F", i);
+
+        uint32_t start = kernel_get_microseconds();
+        
+        if(fs_write_file(path, bfr, SMALL_FILE_SIZE, FAT_FILE_ATTRIB_FILE))
+            { create->skipped = TRUE; return; }
+
+        create->us += kernel_get_microseconds() - start;
+        create->ops++;
+        create->bytes += SMALL_FILE_SIZE;
+
+        // lookup of the last entry of a directory with 16, 64 and 256 entries (+ '.' and '..')
+        if(i + 1 != next_lookup)
+            continue;
+        
+        bench_lookup(new_result("lookup in %i", next_lookup), path);
+        next_lookup = next_lookup * 4;
+    }
+
+    for(uint32_t i = 0; i < SMALL_FILES; ++i)
+    {
+        size_t size;
+        make_path(path, base, "/F", i);
+
+        uint32_t start = kernel_get_microseconds();
+        file_t *f = fs_read_file(path, &size, &err);
+
+        if(err)
+            { read->skipped = TRUE; break; }
+
+        read->us += kernel_get_microseconds() - start;
+        read->ops++;
+        read->bytes += size;
+
+        vfree(f);
+    }
+
+    for(uint32_t i = 0; i < SMALL_FILES; ++i)
+    {
+        make_path(path, base, "/F", i);
+
+        uint32_t start = kernel_get_microseconds();
+
+        if(fs_write_file(path, bfr, SMALL_FILE_SIZE, FAT_FILE_ATTRIB_FILE))
+            { rewrite->skipped = TRUE; break; }
+
+        rewrite->us += kernel_get_microseconds() - start;
+        rewrite->ops++;
+        rewrite->bytes += SMALL_FILE_SIZE;
+    }
+
+    for(uint32_t i = 0; i < SMALL_FILES; ++i)
+    {
+        make_path(path, base, "/F", i);
+
+        uint32_t start = kernel_get_microseconds();
+
+        if(fs_delete_file(path))
+            { del->skipped = TRUE; break; }
+
+        del->us += kernel_get_microseconds() - start;
+        del->ops++;
+    }
+}
+
+static void bench_large_file(const char *base, char *path)
+{
+    result_t *wr = new_result("%s", (uint32_t) "1M write");
+    result_t *rd = new_result("%s", (uint32_t) "1M read");
+    uint8_t *f = valloc(LARGE_FILE_SIZE);
+    size_t size;
+    err_t err;
+
+    if(!f)
+        { wr->skipped = rd->skipped = TRUE; return; }
+
+    for(uint32_t i = 0; i < LARGE_FILE_SIZE; ++i)
+        f[i] = (uint8_t) i;
+    
+    make_path(path, base, "/LARGE", 0);
+
+    uint32_t start = kernel_get_microseconds();
+    
+    if(fs_write_file(path, f, LARGE_FILE_SIZE, FAT_FILE_ATTRIB_FILE))
+        { wr->skipped = rd->skipped = TRUE; vfree(f); return; }
+
+    wr->us = kernel_get_microseconds() - start;
+    wr->ops = 1;
+    wr->bytes = LARGE_FILE_SIZE;
+
+    vfree(f);
+
+    start = kernel_get_microseconds();
+    f = fs_read_file(path, &size, &err);
+    
+    if(err)
+        rd->skipped = TRUE;
+    else
+    {
+        rd->us = kernel_get_microseconds() - start;
+        rd->ops = 1;
+        rd->bytes = size;
+        vfree(f);
+    }
+
+    fs_delete_file(path);
+}
+
+static void bench_depth(const char *base, char *path)
+{
+    // base/L1/L2/L3/L4, ends[d] is where level d ends
+    size_t ends[LOOKUP_DEPTH + 1];
+    
+    ends[0] = strlen(base);
+    memcpy(path, base, ends[0] + 1);
+
+    for(uint32_t d = 1; d <= LOOKUP_DEPTH; ++d)
+    {
+        make_path(&path[ends[d - 1]], "", "/L", d);
+        ends[d] = strlen(path);
+    }
+
+    if(fs_mkdir(path))
+    {
+        new_result("%s", (uint32_t) "lookup depth")->skipped = TRUE;
+        return;
+    }
+
+    // from the deepest level up, removing every level when done with it
+    for(uint32_t d = LOOKUP_DEPTH; d > 0; --d)
+    {
+        path[ends[d]] = '\0';
+
+        // + 1: the benchmark directory itself
+        bench_lookup(new_result("lookup depth %i", d + 1), path);
+        fs_delete_file(path);
+    }
+}
+
+/* ---- summary ---- */
+
+// prints value (using format) left aligned in a column of `width` characters
+static void print_col(const char *format, uint32_t value, size_t width)
+{
+    char s[LINE_SIZE];
+    memset(s, LINE_SIZE, 0);
+
+    str_add_val(s, format, value);
+
+    for(size_t i = strlen(s); i < width && i < (LINE_SIZE - 1); ++i)
+        s[i] = ' ';
+    
+    screen_print(s);
+}
+
+// n per second, without overflowing for large n
+static uint32_t per_second(uint32_t n, uint32_t us)
+{
+    uint32_t ms = (us + 500U) / 1000U;
+
+    if(n < (MAX / 1000000U) && us)
+        return (n * 1000000U) / us;
+
+    return (ms) ? (n / ms) * 1000U : 0;
+}
+
+static void print_results(void)
+{
+    print_col("%s", (uint32_t) "test", NAME_LEN - 8);
+    print_col("%s", (uint32_t) "ops", COL_WIDTH - 2);
+    print_col("%s", (uint32_t) "KiB", COL_WIDTH - 2);
+    print_col("%s", (uint32_t) "ms", COL_WIDTH);
+    print_col("%s", (uint32_t) "ops/s", COL_WIDTH);
+    print_col("%s", (uint32_t) "KiB/s", COL_WIDTH);
+    print_col("%s\n", (uint32_t) "avg us", 0);
+
+    for(uint32_t i = 0; i < n_results; ++i)
+    {
+        result_t *r = &results[i];
+
+        print_col("%s", (uint32_t) r->name, NAME_LEN - 8);
+
+        if(r->skipped || !r->ops)
+            { screen_print("skipped (failed or unsupported)\n"); continue; }
+        
+        print_col("%i", r->ops, COL_WIDTH - 2);
+        print_col("%i", r->bytes / 1024U, COL_WIDTH - 2);
+        print_col("%i", r->us / 1000U, COL_WIDTH);
+        print_col("%i", per_second(r->ops, r->us), COL_WIDTH);
+        print_col("%i", per_second(r->bytes / 1024U, r->us), COL_WIDTH);
+        print_col("%i\n", r->us / r->ops, 0);
+    }
+}
+
+err_t main(uint32_t argc, char **argv)
+{
+    // the raw tests take a whole drive: they read and write back sectors from its start
+    if(argc < 2 || strlen(argv[1]) != 3)
+    { 
+        screen_print("Usage: diskbench.elf [drive, e.g. HD0] [partition for the file system tests, e.g. HD0P0]\n"
+                     "Raw writes put back the data that is already on the drive.\n"); 
+        return EXIT_CODE_GLOBAL_INVALID; 
+    }
+
+    size_t sector_size = drive_sector_size(argv[1]);
+
+    if(!sector_size)
+        { screen_print("no such drive.\n"); return EXIT_CODE_GLOBAL_INVALID; }
+
+    // the small files of the file system tests come from this buffer as well
+    size_t bfr_size = SEQ_CHUNK_SECTORS * sector_size;
+    uint8_t *bfr = valloc((bfr_size > SMALL_FILE_SIZE) ? bfr_size : SMALL_FILE_SIZE);
+    char *path = valloc(FS_MAX_PATH_LEN + 1);
+    char *base = valloc(FS_MAX_PATH_LEN + 1);
+    
+    if(!bfr || !path || !base)
+        { screen_print("out of memory.\n"); return EXIT_CODE_GLOBAL_OUT_OF_MEMORY; }
+
+    uint32_t span = 0;
+
+    screen_print("Raw disk...\n");
+    bench_seq(argv[1], sector_size, bfr, &span);
+    bench_rand_io(argv[1], sector_size, bfr, span);
+
+    if(argc > 2 && (strlen(argv[2]) + sizeof(BENCH_DIR) + 16) < FS_MAX_PATH_LEN)
+    {
+        screen_print("File system...\n");
+
+        size_t len = strlen(argv[2]);
+        memcpy(base, argv[2], len);
+        memcpy(&base[len], BENCH_DIR, sizeof(BENCH_DIR));
+
+        // the small files are 4 KiB of whatever is in the buffer
+        if(!fs_mkdir(base))
+        {
+            bench_files(base, bfr, path);
+            bench_large_file(base, path);
+            bench_depth(base, path);
+            fs_delete_file(base);
+        }
+        else
+            screen_print("failed to create the benchmark directory.\n");
+    }
+
+    screen_print("\n");
+    print_results();
+
+    vfree(base);
+    vfree(path);
+    vfree(bfr);
+    
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+MIT license
+Copyright (c) 2023 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "types.h"
+#include "exit_code.h"
+#include "screen.h"
+#include "disk.h"
+#include "memory.h"
+#include "util.h"
+
+#define COL_WIDTH       10
+#define LINE_SIZE       64
+
+static const char *op_names[DISK_STATS_OPS] = {
+    "read", "write", "dev read", "dev write", "dev flush"
+};
+
+// prints value (using format) left aligned in a column of `width` characters
+static void print_col(const char *format, uint32_t value, size_t width)
+{
+    char s[LINE_SIZE];
+    memset(s, LINE_SIZE, 0);
+
+    str_add_val(s, format, value);
+
+    for(size_t i = strlen(s); i < width && i < (LINE_SIZE - 1); ++i)
+        s[i] = ' ';
+    
+    screen_print(s);
+}
+
+static void print_histogram(disk_stats_op_t *op)
+{
+    for(uint32_t b = 0; b < DISK_STATS_HIST_BUCKETS; ++b)
+    {
+        if(!op->hist[b])
+            continue;
+        
+        screen_print("    ");
+        print_col("< %i us", 1U << b, COL_WIDTH + 2);
+        print_col("%i\n", op->hist[b], 0);
+    }
+}
+
+static void print_drive(disk_stats_t *d, bool_t histograms)
+{
+    screen_print(d->name);
+    screen_print("\n  ");
+
+    print_col("%s", (uint32_t) "", COL_WIDTH);
+    print_col("%s", (uint32_t) "ops", COL_WIDTH);
+    print_col("%s", (uint32_t) "sectors", COL_WIDTH);
+    print_col("%s", (uint32_t) "KiB", COL_WIDTH);
+    print_col("%s", (uint32_t) "errors", COL_WIDTH);
+    print_col("%s", (uint32_t) "avg us", COL_WIDTH);
+    print_col("%s", (uint32_t) "max us", 0);
+    screen_print("\n");
+
+    for(uint32_t i = 0; i < DISK_STATS_OPS; ++i)
+    {
+        disk_stats_op_t *op = &d->op[i];
+
+        if(!op->ops)
+            continue;
+        
+        screen_print("  ");
+        print_col("%s", (uint32_t) op_names[i], COL_WIDTH);
+        print_col("%i", op->ops, COL_WIDTH);
+        print_col("%i", op->sectors, COL_WIDTH);
+        print_col("%i", op->bytes / 1024U, COL_WIDTH);
+        print_col("%i", op->errors, COL_WIDTH);
+        print_col("%i", op->total_us / op->ops, COL_WIDTH);
+        print_col("%i\n", op->max_us, 0);
+
+        if(histograms)
+            print_histogram(op);
+    }
+
+    print_col("  re-reads: %i\n\n", d->rereads, 0);
+}
+
+err_t main(uint32_t argc, char **argv)
+{
+    bool_t histograms = FALSE;
+
+    if(argc > 1 && !strcmp(argv[1], "-r"))
+        { disk_reset_stats(); return EXIT_CODE_GLOBAL_SUCCESS; }
+    else if(argc > 1 && !strcmp(argv[1], "-h"))
+        histograms = TRUE;
+    else if(argc > 1)
+        { screen_print("Usage: iostat.elf [-h (show latency histograms) | -r (reset statistics)]\n"); return EXIT_CODE_GLOBAL_INVALID; }
+
+    size_t size;
+    disk_stats_t *stats = disk_get_stats(&size);
+
+    if(!stats)
+        { screen_print("failed to get disk statistics.\n"); return EXIT_CODE_GLOBAL_GENERAL_FAIL; }
+
+    for(uint32_t i = 0; i < (size / sizeof(disk_stats_t)); ++i)
+        if(stats[i].name[0])
+            print_drive(&stats[i], histograms);
+
+    vfree(stats);
+    return EXIT_CODE_GLOBAL_SUCCESS;
+}
@@ -44,19 +44,111 @@ typedef struct partition_info_t
     uint8_t type;
 } __attribute__((packed)) partition_info_t;
 
+// asynchronous I/O
+#define DISK_AIO_MAX_ENTRIES    256 // per ring, must be a power of two
+
+#define DISK_AIO_OP_READ        0x01
+#define DISK_AIO_OP_WRITE       0x02
+
+typedef struct aio_sqe_t
+{
+    uint8_t opcode;
+    char drive[DISK_ID_MAX_SIZE];
+    uint32_t lba;
+    uint32_t nlba;
+    void *buffer;
+    uint32_t user_data;
+} __attribute__((packed)) aio_sqe_t;
+
+typedef struct aio_cqe_t
+{
+    uint32_t user_data;
+    uint32_t nlba;
+    err_t result;
+} __attribute__((packed)) aio_cqe_t;
+
+// followed by `entries` submission entries and `entries` completion entries
+typedef struct aio_ring_t
+{
+    volatile uint32_t sq_head;
+    volatile uint32_t sq_tail;
+    volatile uint32_t cq_head;
+    volatile uint32_t cq_tail;
+    uint32_t entries;
+} __attribute__((packed)) aio_ring_t;
+
+#define DISK_AIO_RING_SQ(r)     ((aio_sqe_t *) (((uint8_t *) (r)) + sizeof(aio_ring_t)))
+#define DISK_AIO_RING_CQ(r)     ((aio_cqe_t *) (DISK_AIO_RING_SQ(r) + (r)->entries))
+#define DISK_AIO_RING_SIZE(n)   (sizeof(aio_ring_t) + (n) * (sizeof(aio_sqe_t) + sizeof(aio_cqe_t)))
+
+// I/O statistics
+#define DISK_STATS_OP_READ          0 // requests, including those served by readahead or caches
+#define DISK_STATS_OP_WRITE         1 // requests, including those that were queued
+#define DISK_STATS_OP_DEV_READ      2 // reads by the device
+#define DISK_STATS_OP_DEV_WRITE     3 // writes by the device
+#define DISK_STATS_OP_DEV_FLUSH     4 // write cache flushes by the device
+#define DISK_STATS_OPS              5
+
+#define DISK_STATS_HIST_BUCKETS     24
+
+typedef struct disk_stats_op_t
+{
+    uint32_t ops;
+    uint32_t sectors;
+    uint32_t bytes;
+    uint32_t errors;
+    uint32_t total_us;
+    uint32_t max_us;
+    uint32_t hist[DISK_STATS_HIST_BUCKETS]; // hist[0]: < 1 us, hist[n]: [2^(n-1), 2^n) us
+} __attribute__((packed)) disk_stats_op_t;
+
+typedef struct disk_stats_t
+{
+    char name[DISK_ID_MAX_SIZE]; // empty if there is no such drive
+    disk_stats_op_t op[DISK_STATS_OPS];
+    uint32_t rereads; // read requests starting at a sector that was read recently
+} __attribute__((packed)) disk_stats_t;
+
 // returns information on detected disks by the system and the total size of the list in *size
 disk_info_t *disk_get_drive_list(size_t *size);
 
 // returns information about a partition of a disk (e.g. HD0P0)
 partition_info_t *disk_get_partition_info(char *_id);
 
-// returns the buffer of SECTOR_SIZE * _sctrs read at _lba (or NULL if fail)
+// returns the buffer of SECTOR_SIZE * _sctrs read at _lba (or NULL if fail); for a partition (e.g. HD0P0)
+// _lba is relative to its start, like it is for disk_absolute_write()
 void *disk_absolute_read(char *_drive, uint32_t _lba, uint32_t _sctrs);
 
+// reads _sctrs sectors at _lba into _bfr, which must be owned by the program and hold at least _sctrs sectors
+err_t disk_absolute_read_into(char *_drive, uint32_t _lba, uint32_t _sctrs, void *_bfr, size_t _bfr_size);
+
 // writes (_bfr_size / SECTOR_SIZE + (_bfr_size % SECTOR_SIZE != 0)) sectors from _bfr, starting at _lba 
 err_t disk_absolute_write(char *_drive, uint32_t _lba, void *_bfr, size_t _bfr_size);
 
 // returns the bootdisk (e.g., HD0P0 or CD0)
 char *disk_get_bootdisk(void);
 
+// allocates and registers a ring of _entries (power of two) submission/completion entries (or NULL if fail)
+aio_ring_t *disk_aio_setup(uint32_t _entries);
+
+// returns the next free submission entry of the ring (or NULL if the submission queue is full)
+aio_sqe_t *disk_aio_get_sqe(aio_ring_t *_ring);
+
+// hands all queued submissions to the kernel, *_submitted (may be NULL) is set to the number consumed;
+// fails if fewer than _min_complete completions are available afterwards
+err_t disk_aio_submit(uint32_t _min_complete, uint32_t *_submitted);
+
+// returns the oldest completion of the ring (or NULL if there is none), call disk_aio_seen() when done with it
+aio_cqe_t *disk_aio_peek_cqe(aio_ring_t *_ring);
+void disk_aio_seen(aio_ring_t *_ring);
+
+// unregisters and frees the ring
+err_t disk_aio_destroy(aio_ring_t *_ring);
+
+// returns the I/O statistics of every drive, indexed by drive number (*size is the total size of the list)
+disk_stats_t *disk_get_stats(size_t *size);
+
+// clears the I/O statistics of all drives
+void disk_reset_stats(void);
+
 #endif // __DISK_H__
\ No newline at end of file
@@ -32,6 +32,14 @@ SOFTWARE.
 
 #define FS_MAX_PATH_LEN         255
 
+#define FS_OFFSET_CURRENT       0xFFFFFFFF  // read/write at the current position (and move it)
+
+#define FS_SEEK_SET             0
+#define FS_SEEK_CUR             1
+#define FS_SEEK_END             2
+
+#define FS_DIR_NAMES_ONLY       (1 << 0)    // fs_readdir() fills in only the names
+
 #define FS_TYPE_FAT12   0x01
 #define FS_TYPE_FAT16   0x04
 #define FS_TYPE_FAT32   0x0B
@@ -48,6 +56,8 @@ SOFTWARE.
 #define EXIT_CODE_FS_FILE_READ_ONLY        0x12
 #define EXIT_CODE_FS_FILE_EXISTS           0x13
 #define EXIT_CODE_FS_NO_SPACE              0x14
+#define EXIT_CODE_FS_FILE_IN_USE           0x15
+#define EXIT_CODE_FS_DIR_NOT_EMPTY         0x16
 
 // FAT time and date offsets
 #define FAT_SECOND_OFFSET		0
@@ -84,10 +94,11 @@ uint8_t fs_get_filesystem(char *_drive);
 // returns the file located at _path, returning the file size in _o_size
 file_t *fs_read_file(char *_path, size_t *_o_size, err_t *err);
 
-// writes file to _path
+// writes file to _path, an existing file that is open (fs_open) is not replaced
 err_t fs_write_file(char *_path, file_t *_file, size_t _size, uint8_t _attrib);
 
-// removes file at _path
+// removes file at _path, unless it is open (EXIT_CODE_FS_FILE_IN_USE). Directories
+// have to be empty (EXIT_CODE_FS_DIR_NOT_EMPTY)
 err_t fs_delete_file(char *_path);
 
 // renames file at _path to _new_name
@@ -106,4 +117,31 @@ fs_file_info_t *fs_file_get_info(char *_path, err_t *_err);
 // any error in *_err and the number of entries in the struct in *_n_entries.
 fs_dir_contents_t *fs_dir_get_contents(char *_path, uint32_t *_n_entries, err_t *_err);
 
+// opens the file at _path, returns a handle for the functions below
+// and the size of the file in *_o_size. Directories can't be opened.
+uint32_t fs_open(char *_path, size_t *_o_size, err_t *_err);
+
+// reads up to _size bytes at _offset (or FS_OFFSET_CURRENT) into _buffer,
+// returns the number of bytes read (reads stop at the end of the file)
+size_t fs_read_at(uint32_t _handle, void *_buffer, size_t _size, uint32_t _offset, err_t *_err);
+
+// writes _size bytes from _buffer at _offset (or FS_OFFSET_CURRENT), writing
+// at the end of the file appends to it. Returns the number of bytes written
+size_t fs_write_at(uint32_t _handle, void *_buffer, size_t _size, uint32_t _offset, err_t *_err);
+
+// moves the current position of the file, relative to _whence (FS_SEEK_*),
+// returns the new position
+uint32_t fs_seek(uint32_t _handle, int32_t _offset, uint8_t _whence, err_t *_err);
+
+// opens the directory at _path for fs_readdir(), _flags are FS_DIR_* options.
+// The handle is closed with fs_close()
+uint32_t fs_opendir(char *_path, uint8_t _flags, err_t *_err);
+
+// reads the next (at most) _n entries of the directory into _entries, returns the
+// number of entries read, 0 at the end of the directory
+uint32_t fs_readdir(uint32_t _handle, fs_dir_contents_t *_entries, uint32_t _n, err_t *_err);
+
+// closes the file or directory
+err_t fs_close(uint32_t _handle);
+
 #endif // __FS_H__
@@ -57,6 +57,9 @@ err_t kernel_remove_interrupt_handler(function_t _handler, uint8_t _int);
 // returns the number of systicks passed
 uint32_t kernel_get_systicks(void);
 
+// returns a microsecond clock (wraps around after about 71 minutes), for timing things
+uint32_t kernel_get_microseconds(void);
+
 // delays until _ms milliseconds have passed
 void kernel_sleep(uint32_t _ms);
 
@@ -22,6 +22,7 @@ SOFTWARE.
 */
 
 #include "../include/disk.h"
+#include "../include/memory.h"
 
 typedef struct disk_syscall_t
 {
@@ -33,6 +34,14 @@ typedef struct disk_syscall_t
     void *buffer;
 } __attribute__((packed)) disk_syscall_t;
 
+typedef struct aio_syscall_t
+{
+    syscall_hdr_t hdr;
+    aio_ring_t *ring;
+    size_t ring_size;
+    uint32_t min_complete;
+} __attribute__((packed)) aio_syscall_t;
+
 
 disk_info_t *disk_get_drive_list(size_t *size)
 {
@@ -69,6 +78,22 @@ void *disk_absolute_read(char *_drive, uint32_t _lba, uint32_t _sctrs)
 
     return req.hdr.response_ptr;
 }
+
+err_t disk_absolute_read_into(char *_drive, uint32_t _lba, uint32_t _sctrs, void *_bfr, size_t _bfr_size)
+{
+    disk_syscall_t req = {
+        .hdr.system_call = SYSCALL_DISK_ABS_READ,
+        .drive = _drive,
+        .lba = _lba,
+        .nlba = _sctrs,
+        .buffer = _bfr,
+        .buffer_size = _bfr_size
+    };
+
+    PERFORM_SYSCALL(&req);
+
+    return req.hdr.exit_code;
+}
  
 err_t disk_absolute_write(char *_drive, uint32_t _lba, void *_bfr, size_t _bfr_size)
 {
@@ -92,3 +117,98 @@ char *disk_get_bootdisk(void)
 
     return (char *) hdr.response_ptr;
 }
+
+aio_ring_t *disk_aio_setup(uint32_t _entries)
+{
+    if(!_entries || _entries > DISK_AIO_MAX_ENTRIES || (_entries & (_entries - 1)))
+        return NULL;
+
+    aio_ring_t *ring = valloc(DISK_AIO_RING_SIZE(_entries));
+
+    if(!ring)
+        return NULL;
+    
+    ring->entries = _entries;
+
+    aio_syscall_t req = {
+        .hdr.system_call = SYSCALL_DISK_AIO_SETUP,
+        .ring = ring,
+        .ring_size = DISK_AIO_RING_SIZE(_entries)
+    };
+
+    PERFORM_SYSCALL(&req);
+
+    if(req.hdr.exit_code)
+        { vfree(ring); return NULL; }
+
+    return ring;
+}
+
+aio_sqe_t *disk_aio_get_sqe(aio_ring_t *_ring)
+{
+    if((_ring->sq_tail - _ring->sq_head) >= _ring->entries)
+        return NULL;
+    
+    aio_sqe_t *sqe = &DISK_AIO_RING_SQ(_ring)[_ring->sq_tail & (_ring->entries - 1)];
+    _ring->sq_tail = _ring->sq_tail + 1;
+
+    return sqe;
+}
+
+err_t disk_aio_submit(uint32_t _min_complete, uint32_t *_submitted)
+{
+    aio_syscall_t req = {
+        .hdr.system_call = SYSCALL_DISK_AIO_SUBMIT,
+        .min_complete = _min_complete
+    };
+
+    PERFORM_SYSCALL(&req);
+
+    if(_submitted)
+        *(_submitted) = req.hdr.response;
+
+    return req.hdr.exit_code;
+}
+
+aio_cqe_t *disk_aio_peek_cqe(aio_ring_t *_ring)
+{
+    if(_ring->cq_head == _ring->cq_tail)
+        return NULL;
+    
+    return &DISK_AIO_RING_CQ(_ring)[_ring->cq_head & (_ring->entries - 1)];
+}
+
+void disk_aio_seen(aio_ring_t *_ring)
+{
+    _ring->cq_head = _ring->cq_head + 1;
+}
+
+err_t disk_aio_destroy(aio_ring_t *_ring)
+{
+    aio_syscall_t req = {
+        .hdr.system_call = SYSCALL_DISK_AIO_DESTROY,
+        .ring = _ring
+    };
+
+    PERFORM_SYSCALL(&req);
+
+    vfree(_ring);
+
+    return req.hdr.exit_code;
+}
+
+disk_stats_t *disk_get_stats(size_t *size)
+{
+    syscall_hdr_t hdr = {.system_call = SYSCALL_DISK_STATS};
+    PERFORM_SYSCALL(&hdr);
+
+    *(size) = hdr.response_size;
+
+    return (disk_stats_t *) hdr.response_ptr;
+}
+
+void disk_reset_stats(void)
+{
+    syscall_hdr_t hdr = {.system_call = SYSCALL_DISK_STATS_RESET};
+    PERFORM_SYSCALL(&hdr);
+}
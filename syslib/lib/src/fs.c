@@ -33,6 +33,18 @@ typedef struct fs_t
     uint8_t attrib;
 } __attribute__((packed)) fs_t;
 
+typedef struct fs_file_t
+{
+    syscall_hdr_t hdr;
+    char *path;
+    uint32_t handle;
+    void *buffer;
+    size_t size;
+    uint32_t offset;
+    uint8_t whence;
+    uint8_t flags;
+} __attribute__((packed)) fs_file_t;
+
 uint8_t fs_get_filesystem(char *_drive)
 {
     fs_t req = {
@@ -130,3 +142,98 @@ fs_dir_contents_t *fs_dir_get_contents(char *_path, uint32_t *_n_entries, err_t
     *_n_entries = req.hdr.response_size / sizeof(fs_dir_contents_t);
     return req.hdr.response_ptr;
 }
+
+uint32_t fs_open(char *_path, size_t *_o_size, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_OPEN,
+        .path = _path,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    *_o_size = req.hdr.response_size;
+    return req.hdr.response;
+}
+
+size_t fs_read_at(uint32_t _handle, void *_buffer, size_t _size, uint32_t _offset, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_READ_AT,
+        .handle = _handle,
+        .buffer = _buffer,
+        .size = _size,
+        .offset = _offset,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    return req.hdr.response;
+}
+
+size_t fs_write_at(uint32_t _handle, void *_buffer, size_t _size, uint32_t _offset, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_WRITE_AT,
+        .handle = _handle,
+        .buffer = _buffer,
+        .size = _size,
+        .offset = _offset,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    return req.hdr.response;
+}
+
+uint32_t fs_seek(uint32_t _handle, int32_t _offset, uint8_t _whence, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_SEEK,
+        .handle = _handle,
+        .offset = (uint32_t) _offset,
+        .whence = _whence,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    return req.hdr.response;
+}
+
+err_t fs_close(uint32_t _handle)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_CLOSE,
+        .handle = _handle,
+    };
+    PERFORM_SYSCALL(&req);
+
+    return req.hdr.exit_code;
+}
+
+uint32_t fs_opendir(char *_path, uint8_t _flags, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_OPENDIR,
+        .path = _path,
+        .flags = _flags,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    return req.hdr.response;
+}
+
+uint32_t fs_readdir(uint32_t _handle, fs_dir_contents_t *_entries, uint32_t _n, err_t *_err)
+{
+    fs_file_t req = {
+        .hdr.system_call = SYSCALL_FS_READDIR,
+        .handle = _handle,
+        .buffer = _entries,
+        .size = _n,
+    };
+    PERFORM_SYSCALL(&req);
+
+    *_err = req.hdr.exit_code;
+    return req.hdr.response;
+}
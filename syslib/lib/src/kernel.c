@@ -100,6 +100,15 @@ uint32_t kernel_get_systicks(void)
     return (uint32_t) hdr.response_ptr;
 }
 
+uint32_t kernel_get_microseconds(void)
+{
+    syscall_hdr_t hdr = {.system_call = SYSCALL_GET_MICROSECONDS};
+    PERFORM_SYSCALL(&hdr);
+
+    // in this case, the pointer is not a pointer but a value
+    return (uint32_t) hdr.response_ptr;
+}
+
 void kernel_sleep(uint32_t _ms)
 {
     sleep_request_t req = {
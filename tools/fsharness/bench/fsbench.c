@@ -0,0 +1,270 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Microbenchmarks of the FAT32 and ISO9660 drivers. For every operation the device I/O it
+// caused (calls and sectors, as the image file saw them) and the time it took are reported.
+// The I/O counts are the numbers that matter, the time is that of the host and only useful
+// to compare runs on the same machine.
+//
+//  fsbench <FAT32 image> [ISO image]
+//
+// The images are expected to hold the tree scripts/mkimages.sh generates (BIG.BIN, LARGEDIR,
+// DEEP/...). The FAT32 image is modified, use a copy.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/host.h"
+#include "../include/fsh.h"
+
+#define BENCH_CHUNK         4096        // bytes per fsh_read_at()/fsh_write_at()
+#define BENCH_WRITE_SIZE    0x100000    // bytes (1 MiB)
+#define BENCH_LOOKUPS       100
+#define BENCH_SMALL_FILES   100
+#define BENCH_READDIR_N     16          // entries per fsh_readdir(), what `dir` in the shell uses
+
+static int fat_drive = -1;
+static int iso_drive = -1;
+
+static unsigned char *buffer;
+
+static struct timespec start;
+
+static void bench_begin(void)
+{
+    host_iostat_reset();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+static void bench_end(const char *name, int drive, unsigned char err)
+{
+    struct timespec end;
+    host_iostat_t s;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    host_iostat_get((unsigned char) drive, &s);
+
+    long us = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000L;
+
+    printf("%-34s %8u %10u %8u %10u %8u %10ld%s\n", name, s.reads, s.read_sectors, s.writes, s.write_sectors,
+           s.flushes, us, (err) ? "  (failed)" : "");
+}
+
+static void bench_read_file(const char *name, int drive, const char *path)
+{
+    unsigned int size;
+    unsigned char err;
+
+    bench_begin();
+    void *b = fsh_read_file(path, &size, &err);
+    bench_end(name, drive, err);
+
+    fsh_free(b);
+}
+
+static void bench_read_at(const char *name, int drive, const char *path, int backwards)
+{
+    unsigned int size, n = 0;
+    unsigned char err;
+
+    fsh_handle_t *h = fsh_open(path, &size, &err);
+
+    bench_begin();
+
+    if(!h)
+        { bench_end(name, drive, err); return; }
+
+    for(unsigned int off = 0; off < size && !err; off += BENCH_CHUNK, ++n)
+    {
+        // backwards: from the end to the start, the worst case for walking a cluster chain
+        unsigned int at = (backwards) ? ((size - 1 - off) / BENCH_CHUNK) * BENCH_CHUNK : off;
+        fsh_read_at(h, at, buffer, BENCH_CHUNK, &err);
+    }
+
+    bench_end(name, drive, err);
+    fsh_close(h);
+}
+
+static void bench_lookups(const char *name, int drive, const char *path)
+{
+    unsigned int size;
+    unsigned char attrib, err = 0;
+
+    bench_begin();
+
+    for(unsigned int i = 0; i < BENCH_LOOKUPS && !err; ++i)
+        err = fsh_file_info(path, &size, &attrib);
+
+    bench_end(name, drive, err);
+}
+
+static void bench_dir_contents(const char *name, int drive, const char *path)
+{
+    unsigned int n;
+    unsigned char err;
+
+    bench_begin();
+    fsh_dirent_t *d = fsh_dir_contents(path, &n, &err);
+    bench_end(name, drive, err);
+
+    fsh_free(d);
+}
+
+static void bench_readdir(const char *name, int drive, const char *path, unsigned char flags)
+{
+    fsh_dirent_t entries[BENCH_READDIR_N];
+    unsigned char err;
+
+    bench_begin();
+
+    fsh_handle_t *h = fsh_opendir(path, flags, &err);
+
+    while(h && fsh_readdir(h, &entries[0], BENCH_READDIR_N, &err) && !err)
+        ;
+
+    bench_end(name, drive, err);
+    fsh_close(h);
+}
+
+static void bench_write(const char *name, const char *path, unsigned int size)
+{
+    bench_begin();
+    unsigned char err = fsh_write_file(path, buffer, size, 0);
+    bench_end(name, fat_drive, err);
+}
+
+static void bench_append(const char *name, const char *path, unsigned int n)
+{
+    unsigned int size;
+    unsigned char err;
+
+    fsh_handle_t *h = fsh_open(path, &size, &err);
+
+    bench_begin();
+
+    for(unsigned int i = 0; h && i < n && !err; ++i)
+        size += fsh_write_at(h, size, buffer, BENCH_CHUNK, &err);
+
+    bench_end(name, fat_drive, err);
+    fsh_close(h);
+}
+
+static void bench_small_files(const char *name)
+{
+    char path[64];
+    unsigned char err = 0;
+
+    bench_begin();
+
+    for(unsigned int i = 0; i < BENCH_SMALL_FILES && !err; ++i)
+    {
+        snprintf(path, sizeof(path), "HD0P0/SMALL/S%04u.TXT", i);
+        err = fsh_write_file(path, buffer, 100, 0);
+    }
+
+    bench_end(name, fat_drive, err);
+}
+
+static void bench_fat(void)
+{
+    unsigned char err;
+
+    bench_lookups("lookup DEEP/A/B/C/FILE.TXT x100", fat_drive, "HD0P0/DEEP/A/B/C/FILE.TXT");
+    bench_read_file("read BIG.BIN", fat_drive, "HD0P0/BIG.BIN");
+    bench_read_at("read_at BIG.BIN, 4K, forwards", fat_drive, "HD0P0/BIG.BIN", 0);
+    bench_read_at("read_at BIG.BIN, 4K, backwards", fat_drive, "HD0P0/BIG.BIN", 1);
+    bench_dir_contents("dir contents LARGEDIR", fat_drive, "HD0P0/LARGEDIR");
+    bench_readdir("readdir LARGEDIR", fat_drive, "HD0P0/LARGEDIR", 0);
+    bench_readdir("readdir LARGEDIR, names only", fat_drive, "HD0P0/LARGEDIR", FSH_DIR_NAMES_ONLY);
+
+    bench_write("write new 1M", "HD0P0/BENCH.BIN", BENCH_WRITE_SIZE);
+    bench_write("overwrite 1M, same size", "HD0P0/BENCH.BIN", BENCH_WRITE_SIZE);
+    bench_write("overwrite 1M with 2M", "HD0P0/BENCH.BIN", BENCH_WRITE_SIZE * 2);
+    bench_write("overwrite 2M with 4K", "HD0P0/BENCH.BIN", BENCH_CHUNK);
+    bench_append("append 4K x256", "HD0P0/BENCH.BIN", 256);
+
+    bench_begin();
+    err = fsh_delete("HD0P0/BENCH.BIN");
+    bench_end("delete 1M", fat_drive, err);
+
+    bench_begin();
+    err = fsh_mkdir("HD0P0/SMALL");
+    bench_end("mkdir", fat_drive, err);
+
+    bench_small_files("write 100 small files");
+
+    bench_begin();
+    err = fsh_rename("HD0P0/SMALL/S0050.TXT", "RENAMED.TXT");
+    bench_end("rename", fat_drive, err);
+}
+
+static void bench_iso(void)
+{
+    bench_lookups("lookup DEEP/A/B/C/FILE.TXT x100", iso_drive, "CD0/DEEP/A/B/C/FILE.TXT");
+    bench_read_file("read BIG.BIN", iso_drive, "CD0/BIG.BIN");
+    bench_read_at("read_at BIG.BIN, 4K, forwards", iso_drive, "CD0/BIG.BIN", 0);
+    bench_dir_contents("dir contents LARGEDIR", iso_drive, "CD0/LARGEDIR");
+    bench_readdir("readdir LARGEDIR", iso_drive, "CD0/LARGEDIR", 0);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: fsbench <FAT32 image> [ISO image]\n");
+        return 2;
+    }
+
+    fat_drive = host_attach(argv[1], HOST_DRIVE_HD, 1);
+    iso_drive = (argc == 3) ? host_attach(argv[2], HOST_DRIVE_CD, 0) : -1;
+
+    if(fat_drive < 0 || (argc == 3 && iso_drive < 0))
+        return 2;
+
+    buffer = malloc(BENCH_WRITE_SIZE * 2);
+
+    for(unsigned int i = 0; i < BENCH_WRITE_SIZE * 2; ++i)
+        buffer[i] = (unsigned char) i;
+
+    fsh_mount();
+
+    printf("%-34s %8s %10s %8s %10s %8s %10s\n", "operation", "reads", "sectors", "writes", "sectors", "flushes", "us");
+
+    printf("FAT32 (%s)\n", argv[1]);
+    bench_fat();
+
+    if(iso_drive >= 0)
+    {
+        printf("ISO9660 (%s)\n", argv[2]);
+        bench_iso();
+    }
+
+    host_detach_all();
+    free(buffer);
+
+    return 0;
+}
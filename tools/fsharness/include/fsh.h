@@ -0,0 +1,78 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// The file system drivers as the tests and benchmarks see them. Every call goes through the
+// driver command interface (FS_COMMAND_*), the same way kernel/core/dsk/fs.c uses the drivers.
+// Paths are kernel paths, e.g. "HD0P0/DIR/FILE.TXT" or "CD0/DIR/FILE.TXT".
+
+#ifndef __FSH_H__
+#define __FSH_H__
+
+#define FSH_MAX_NAME_LEN    255     // ISO_MAX_FILENAME_LEN
+
+// same values as FAT_FILE_ATTRIB_* (FS_TYPES.H)
+#define FSH_ATTRIB_READONLY 0x01
+#define FSH_ATTRIB_DIR      0x10
+
+#define FSH_DIR_NAMES_ONLY  (1 << 0)    // FS_DIR_NAMES_ONLY
+
+#define FSH_ERR_NO_SPACE    0x14        // EXIT_CODE_FS_NO_SPACE
+
+typedef struct fsh_handle_t fsh_handle_t;
+
+typedef struct fsh_dirent_t
+{
+    char name[FSH_MAX_NAME_LEN + 1];
+    unsigned char attrib;
+    unsigned int size;
+} fsh_dirent_t;
+
+// reads the MBRs of the attached hard disk images and initializes the drivers for them
+// and for the attached CD images
+void fsh_mount(void);
+
+// the exit code of the driver is returned in *err (or returned directly), see
+// kernel/core/include/exit_code.h and kernel/core/drv/FS/fs_exitcode.h
+void *fsh_read_file(const char *path, unsigned int *size, unsigned char *err);
+unsigned char fsh_write_file(const char *path, const void *buf, unsigned int size, unsigned char attrib);
+unsigned char fsh_rename(const char *path, const char *new_name);
+unsigned char fsh_delete(const char *path);
+unsigned char fsh_mkdir(const char *path);
+unsigned char fsh_file_info(const char *path, unsigned int *size, unsigned char *attrib);
+
+// the whole directory at once (FS_COMMAND_GET_DIR_CONTENTS), *n is the number of entries
+fsh_dirent_t *fsh_dir_contents(const char *path, unsigned int *n, unsigned char *err);
+
+fsh_handle_t *fsh_open(const char *path, unsigned int *size, unsigned char *err);
+unsigned int fsh_read_at(fsh_handle_t *h, unsigned int offset, void *buf, unsigned int size, unsigned char *err);
+unsigned int fsh_write_at(fsh_handle_t *h, unsigned int offset, const void *buf, unsigned int size, unsigned char *err);
+
+fsh_handle_t *fsh_opendir(const char *path, unsigned char flags, unsigned char *err);
+unsigned int fsh_readdir(fsh_handle_t *h, fsh_dirent_t *out, unsigned int n, unsigned char *err);
+
+void fsh_close(fsh_handle_t *h);
+
+// frees what fsh_read_file() and fsh_dir_contents() return
+void fsh_free(void *ptr);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// What the host (libc) side of the harness offers to the kernel shim. Only plain C types are
+// used here, this header is included by code built against the kernel headers as well as by
+// code built against libc.
+
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#define HOST_MAX_DRIVES     5       // same as DISKIO_MAX_DRIVES
+
+// drive types, the same values as in kernel/core/dsk/diskdefines.h
+#define HOST_DRIVE_HD       0x00    // DRIVE_TYPE_IDE_PATA, 512 byte sectors and an MBR
+#define HOST_DRIVE_CD       0x01    // DRIVE_TYPE_IDE_PATAPI, 2048 byte sectors
+#define HOST_DRIVE_NONE     0xFF
+
+// exit codes of host_read()/host_write(), the same values as in kernel/core/include/exit_code.h
+#define HOST_OK             0x00
+#define HOST_ERROR          0x01    // EXIT_CODE_GLOBAL_GENERAL_FAIL
+#define HOST_OUT_OF_RANGE   0x03    // EXIT_CODE_GLOBAL_OUT_OF_RANGE
+
+// I/O that reached the image file, i.e. what a real drive would have been asked to do
+typedef struct host_iostat_t
+{
+    unsigned int reads;
+    unsigned int read_sectors;
+    unsigned int writes;
+    unsigned int write_sectors;
+    unsigned int flushes;
+} host_iostat_t;
+
+// attaches an image file as the next drive of its type, returns the drive number or -1
+int host_attach(const char *path, unsigned char type, int writable);
+void host_detach_all(void);
+
+unsigned char host_drive_type(unsigned char drive);
+unsigned int host_sector_size(unsigned char drive);
+unsigned int host_sector_count(unsigned char drive);
+
+// sector I/O on the image file of a drive
+unsigned char host_read(unsigned char drive, unsigned int lba, unsigned int n, void *buf);
+unsigned char host_write(unsigned char drive, unsigned int lba, unsigned int n, const void *buf);
+unsigned char host_flush(unsigned char drive);
+
+void host_iostat_get(unsigned char drive, host_iostat_t *out);
+void host_iostat_reset(void);
+
+// memory, new allocations are filled with a pattern (like memory the kernel used before)
+void *host_alloc(unsigned int size);
+void host_free(void *ptr);
+
+unsigned int host_ms(void);
+
+void host_print(const char *s);
+void host_fail(const char *msg);
+
+#endif
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Runs the tests against the images of mkimages.sh: usage check.sh [image directory] [binary directory]
+#
+# The read tests compare what the drivers read with the views of the images. The write
+# tests run on a copy of each FAT32 image and apply the same changes to a copy of its view;
+# afterwards mtools has to see exactly that copy in the image, and fsck.fat has to be happy.
+# On the nearly full image the writes run out of space, fsck.fat then also finds the
+# clusters of a failed write that weren't given back.
+
+IMG=${1:-img}
+BIN=${2:-bin}
+. "$(dirname "$0")/images.conf"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+fail=0
+
+for spec in $FAT_IMAGES; do
+    name=${spec%%:*}
+    "$BIN/fstest" read "$IMG/$name.img" "$IMG/$name.manifest" "$IMG/$name.view" || fail=1
+done
+
+"$BIN/fstest" read "$IMG/$ISO_IMAGE.iso" "$IMG/$ISO_IMAGE.manifest" "$IMG/$ISO_IMAGE.view" || fail=1
+
+for spec in $FAT_IMAGES; do
+    set -- $(echo "$spec" | tr ':' ' ')
+    name=$1
+    img="$WORK/$name.img"
+
+    # nearly full images get the out of space tests
+    mode=write
+    [ -n "${4:-}" ] && mode=full
+
+    cp "$IMG/$name.img" "$img"
+    cp -r "$IMG/$name.view" "$WORK/expect"
+
+    "$BIN/fstest" $mode "$img" "$IMG/$name.manifest" "$WORK/expect" || fail=1
+
+    mkdir "$WORK/after"
+    mcopy -s -n -i "$img@@$((PART_START * 512))" '::*' "$WORK/after/"
+
+    if ! diff -r "$WORK/expect" "$WORK/after"; then
+        echo "FAIL: $name: the host sees something else in the image than what was written"
+        fail=1
+    fi
+
+    dd if="$img" of="$WORK/part.img" bs=512 skip="$PART_START" status=none
+
+    if ! fsck.fat -n "$WORK/part.img" > "$WORK/fsck.log" 2>&1; then
+        cat "$WORK/fsck.log"
+        echo "FAIL: $name: fsck.fat found problems after the write tests"
+        fail=1
+    fi
+
+    rm -rf "$WORK/expect" "$WORK/after" "$WORK/part.img" "$img"
+done
+
+[ $fail -eq 0 ] && echo "all tests passed"
+exit $fail
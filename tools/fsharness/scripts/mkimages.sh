@@ -0,0 +1,100 @@
+#!/bin/sh
+# Generates the test images of the harness: usage mkimages.sh [output directory]
+#
+# For each image in the output directory:
+#  <name>.img/.iso     the image
+#  <name>.view/        its contents as the host tools (mtools, xorriso) read them back
+#  <name>.manifest     every file and directory of the view, with its size
+#
+# Needs sfdisk, mkfs.fat (dosfstools), mtools and xorriso.
+
+set -e
+
+OUT=${1:-img}
+. "$(dirname "$0")/images.conf"
+
+need()
+{
+    command -v "$1" > /dev/null 2>&1 || { echo "mkimages.sh: $1 not found (install $2)" >&2; exit 1; }
+}
+
+need sfdisk fdisk
+need mkfs.fat dosfstools
+need mcopy mtools
+need xorriso xorriso
+
+# random contents of `size` bytes
+blob()
+{
+    head -c "$2" /dev/urandom > "$1"
+}
+
+# names are 8.3 and upper case, that's what the drivers handle
+make_tree()
+{
+    mkdir -p "$1/DATA" "$1/LARGEDIR" "$1/DEEP/A/B/C"
+
+    echo "Hello from the host" > "$1/HELLO.TXT"
+    : > "$1/EMPTY.TXT"
+    blob "$1/BIG.BIN" 3145728
+
+    # around sector and cluster boundaries
+    for size in 1 511 512 513 2048 4095 4096 4097 65536 100000; do
+        blob "$1/DATA/S$size.BIN" $size
+    done
+
+    # a directory spanning several clusters
+    i=0
+    while [ $i -lt 300 ]; do
+        blob "$1/LARGEDIR/F$(printf '%04d' $i).TXT" $((i * 13))
+        i=$((i + 1))
+    done
+
+    echo "deep down" > "$1/DEEP/A/B/C/FILE.TXT"
+}
+
+manifest()
+{
+    (cd "$1" && find . -mindepth 1 -printf '%y %s %P\n' | sort)
+}
+
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+make_tree "$OUT/tree"
+
+for spec in $FAT_IMAGES; do
+    set -- $(echo "$spec" | tr ':' ' ')
+    name=$1
+    sectors=$2
+    cluster=$3
+    free=${4:-}
+    img="$OUT/$name.img"
+
+    truncate -s $(( (PART_START + sectors) * 512 )) "$img"
+    echo "start=$PART_START, size=$sectors, type=b" | sfdisk -q "$img"
+
+    mkfs.fat -F 32 -s "$cluster" -n VIREOTEST --offset "$PART_START" "$img" $((sectors / 2)) > /dev/null
+    mcopy -s -i "$img@@$((PART_START * 512))" "$OUT"/tree/* ::/
+
+    # one file takes all but $free KiB of what is left
+    if [ -n "$free" ]; then
+        left=$(mdir -i "$img@@$((PART_START * 512))" :: | sed -n 's/ bytes free//p' | tr -d ' ')
+        blob "$OUT/fill" $((left - free * 1024))
+        mcopy -i "$img@@$((PART_START * 512))" "$OUT/fill" ::/FILL.BIN
+        rm "$OUT/fill"
+    fi
+
+    mkdir "$OUT/$name.view"
+    mcopy -s -n -i "$img@@$((PART_START * 512))" '::*' "$OUT/$name.view/"
+    manifest "$OUT/$name.view" > "$OUT/$name.manifest"
+done
+
+xorriso -as mkisofs -iso-level 1 -V VIREOTEST -o "$OUT/$ISO_IMAGE.iso" "$OUT/tree" 2> /dev/null
+
+mkdir "$OUT/$ISO_IMAGE.view"
+xorriso -osirrox on -indev "$OUT/$ISO_IMAGE.iso" -extract / "$OUT/$ISO_IMAGE.view" 2> /dev/null
+chmod -R u+w "$OUT/$ISO_IMAGE.view"
+manifest "$OUT/$ISO_IMAGE.view" > "$OUT/$ISO_IMAGE.manifest"
+
+rm -rf "$OUT/tree"
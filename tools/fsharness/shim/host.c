@@ -0,0 +1,226 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Drives backed by image files, memory and the console, for the kernel shim (kshim.c).
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/host.h"
+
+#define HOST_HD_SECTOR_SIZE     512
+#define HOST_CD_SECTOR_SIZE     2048
+
+typedef struct host_drive_t
+{
+    FILE *f;
+    unsigned char type;
+    int writable;
+    unsigned int sector_size;
+    unsigned int sectors;
+    host_iostat_t stat;
+} host_drive_t;
+
+static host_drive_t drives[HOST_MAX_DRIVES];
+static int n_drives = 0;
+
+static host_drive_t *host_get_drive(unsigned char drive)
+{
+    if(drive >= n_drives)
+        return NULL;
+
+    return &drives[drive];
+}
+
+int host_attach(const char *path, unsigned char type, int writable)
+{
+    if(n_drives == HOST_MAX_DRIVES)
+        return -1;
+
+    // CDs are never written to
+    writable = writable && (type == HOST_DRIVE_HD);
+
+    FILE *f = fopen(path, (writable) ? "r+b" : "rb");
+
+    if(!f)
+        { perror(path); return -1; }
+
+    host_drive_t *d = &drives[n_drives];
+
+    memset(d, 0, sizeof(host_drive_t));
+    d->f = f;
+    d->type = type;
+    d->writable = writable;
+    d->sector_size = (type == HOST_DRIVE_CD) ? HOST_CD_SECTOR_SIZE : HOST_HD_SECTOR_SIZE;
+
+    fseek(f, 0, SEEK_END);
+    d->sectors = (unsigned int) (ftell(f) / (long) d->sector_size);
+
+    return n_drives++;
+}
+
+void host_detach_all(void)
+{
+    for(int i = 0; i < n_drives; ++i)
+        fclose(drives[i].f);
+
+    n_drives = 0;
+}
+
+unsigned char host_drive_type(unsigned char drive)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    return (d) ? d->type : HOST_DRIVE_NONE;
+}
+
+unsigned int host_sector_size(unsigned char drive)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    return (d) ? d->sector_size : HOST_HD_SECTOR_SIZE;
+}
+
+unsigned int host_sector_count(unsigned char drive)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    return (d) ? d->sectors : 0;
+}
+
+static unsigned char host_seek(host_drive_t *d, unsigned int lba, unsigned int n)
+{
+    if(!n || lba >= d->sectors || n > d->sectors - lba)
+        return HOST_OUT_OF_RANGE;
+
+    if(fseek(d->f, (long) lba * (long) d->sector_size, SEEK_SET))
+        return HOST_ERROR;
+
+    return HOST_OK;
+}
+
+unsigned char host_read(unsigned char drive, unsigned int lba, unsigned int n, void *buf)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    if(!d)
+        return HOST_OUT_OF_RANGE;
+
+    d->stat.reads++;
+    d->stat.read_sectors += n;
+
+    unsigned char err = host_seek(d, lba, n);
+
+    if(err)
+        return err;
+
+    return (fread(buf, d->sector_size, n, d->f) == n) ? HOST_OK : HOST_ERROR;
+}
+
+unsigned char host_write(unsigned char drive, unsigned int lba, unsigned int n, const void *buf)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    if(!d)
+        return HOST_OUT_OF_RANGE;
+    if(!d->writable)
+        return HOST_ERROR;
+
+    d->stat.writes++;
+    d->stat.write_sectors += n;
+
+    unsigned char err = host_seek(d, lba, n);
+
+    if(err)
+        return err;
+
+    return (fwrite(buf, d->sector_size, n, d->f) == n) ? HOST_OK : HOST_ERROR;
+}
+
+unsigned char host_flush(unsigned char drive)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    if(!d)
+        return HOST_OUT_OF_RANGE;
+
+    d->stat.flushes++;
+
+    return (d->writable && fflush(d->f)) ? HOST_ERROR : HOST_OK;
+}
+
+void host_iostat_get(unsigned char drive, host_iostat_t *out)
+{
+    host_drive_t *d = host_get_drive(drive);
+
+    if(d)
+        *out = d->stat;
+    else
+        memset(out, 0, sizeof(host_iostat_t));
+}
+
+void host_iostat_reset(void)
+{
+    for(int i = 0; i < n_drives; ++i)
+        memset(&drives[i].stat, 0, sizeof(host_iostat_t));
+}
+
+void *host_alloc(unsigned int size)
+{
+    // the kernel clears memory when it is freed, so what it hands out is zeroed (and the drivers rely on it)
+    void *ptr = calloc((size) ? size : 1, 1);
+
+    if(!ptr)
+        host_fail("out of memory");
+
+    return ptr;
+}
+
+void host_free(void *ptr)
+{
+    free(ptr);
+}
+
+unsigned int host_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (unsigned int) (t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+void host_print(const char *s)
+{
+    fputs(s, stderr);
+}
+
+void host_fail(const char *msg)
+{
+    fflush(stdout);
+    fprintf(stderr, "\nfsharness: %s\n", msg);
+    abort();
+}
@@ -0,0 +1,555 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// The parts of the kernel the file system drivers call into, implemented on top of the
+// host side of the harness (host.c). This file is built like the kernel (freestanding, against
+// the kernel headers) and linked together with the drivers; see the makefile.
+//
+// Differences with the kernel that matter when reading the numbers of the benchmarks:
+//  - there is no readahead and no CD sector cache, every read() goes to the image,
+//    so the counted I/O is exactly what the drivers ask for
+//  - the request queue (dsk/ioqueue.c) is the real one, writes while it is plugged are
+//    queued and merged like on real hardware
+
+#include "../../../kernel/core/include/types.h"
+#include "../../../kernel/core/include/exit_code.h"
+
+#include "../../../kernel/core/dsk/diskio.h"
+#include "../../../kernel/core/dsk/diskdefines.h"
+#include "../../../kernel/core/dsk/mbr.h"
+#include "../../../kernel/core/dsk/ioqueue.h"
+#include "../../../kernel/core/dsk/readahead.h"
+
+#include "../../../kernel/core/memory/memory.h"
+#include "../../../kernel/core/memory/paging.h"
+
+#include "../../../kernel/core/hardware/driver.h"
+#include "../../../kernel/core/hardware/timer.h"
+
+#include "../../../kernel/core/screen/screen_basic.h"
+
+#include "../../../kernel/core/kernel/info.h"
+
+#include "../../../kernel/core/drv/COMMANDS.H"
+#include "../../../kernel/core/drv/FS_TYPES.H"
+#include "../../../kernel/core/drv/FS_commands.h"
+#include "../../../kernel/core/drv/FS/fat32.h"
+#include "../../../kernel/core/drv/FS/iso9660.h"
+
+#include "../../../kernel/core/util/util.h"
+
+#include "../../../kernel/core/dbg/dbg.h"
+
+#include "../include/host.h"
+#include "../include/fsh.h"
+
+#define SHIM_DRIVER_PACKET_LEN  5
+
+struct fsh_handle_t
+{
+    uint32_t driver;    // FS_TYPE_*
+    fs_handle_t h;
+};
+
+blkdev_caps_t shim_caps[DISKIO_MAX_DRIVES];
+
+/* --- memory --- */
+
+void *kmalloc(unsigned int size)
+{
+    return host_alloc(size);
+}
+
+void kfree(void *ptr)
+{
+    ASSERT(ptr);
+    host_free(ptr);
+}
+
+void *evalloc(size_t size, pid_t pid)
+{
+    (void) pid;
+    return host_alloc(size);
+}
+
+void vfree(void *ptr)
+{
+    if(ptr)
+        host_free(ptr);
+}
+
+// everything comes from the same allocator here, see iso_free_bfr()
+unsigned int memory_get_malloc_end(void)
+{
+    return 0;
+}
+
+/* --- screen --- */
+
+static void shim_print_uint(uint32_t val, uint32_t base)
+{
+    char b[11];
+    uint32_t i = sizeof(b) - 1;
+
+    b[i] = '\0';
+
+    do
+    {
+        uint32_t d = val % base;
+        b[--i] = (char) ((d < 10) ? ('0' + d) : ('A' + d - 10));
+        val = val / base;
+    } while(val);
+
+    host_print(&b[i]);
+}
+
+void print(const char *text)
+{
+    host_print(text);
+}
+
+// the same format the kernel's print_value() understands: %i, %x, %s and %c
+void print_value(const char *text, unsigned int val)
+{
+    char c[2] = {'\0', '\0'};
+
+    for(uint32_t i = 0; text[i]; ++i)
+    {
+        if(text[i] == '%' && text[i + 1])
+        {
+            switch(text[++i])
+            {
+                case 'i': shim_print_uint(val, 10); continue;
+                case 'x': shim_print_uint(val, 16); continue;
+                case 's': host_print((const char *) val); continue;
+                case 'c': c[0] = (char) val; host_print(c); continue;
+                default: --i; break;
+            }
+        }
+
+        c[0] = text[i];
+        host_print(c);
+    }
+}
+
+void screen_basic_set_screen_color(unsigned char color)
+{
+    (void) color;
+}
+
+// called by failing ASSERT()s, right before they hang the kernel
+void info_print_full_version(void)
+{
+    host_fail("kernel assertion failed");
+}
+
+/* --- time --- */
+
+// the kernel ticks once every millisecond
+unsigned int timer_getCurrentTick(void)
+{
+    return host_ms();
+}
+
+/* --- drives --- */
+
+static void shim_caps_init(void)
+{
+    for(uint8_t i = 0; i < DISKIO_MAX_DRIVES; ++i)
+    {
+        blkdev_caps_t *c = &shim_caps[i];
+        uint8_t type = host_drive_type(i);
+
+        memset(c, sizeof(blkdev_caps_t), 0);
+
+        if(type == HOST_DRIVE_NONE)
+            continue;
+
+        c->sector_size = host_sector_size(i);
+        c->max_lba = host_sector_count(i) - 1;
+        c->max_transfer = (type == HOST_DRIVE_CD) ? 32U : 256U;
+        c->flags = (uint8_t) (BLKDEV_CAP_FLUSH | ((type == HOST_DRIVE_CD) ? BLKDEV_CAP_REMOVABLE : BLKDEV_CAP_WRITE));
+    }
+}
+
+uint8_t *diskio_reportDrives(void)
+{
+    uint8_t *list = (uint8_t *) kmalloc(DISKIO_MAX_DRIVES * sizeof(uint32_t));
+
+    for(uint8_t i = 0; i < DISKIO_MAX_DRIVES; ++i)
+    {
+        uint8_t type = host_drive_type(i);
+        list[i] = (type == HOST_DRIVE_HD) ? DRIVE_TYPE_IDE_PATA : (type == HOST_DRIVE_CD) ? DRIVE_TYPE_IDE_PATAPI : DRIVE_TYPE_UNKNOWN;
+    }
+
+    return list;
+}
+
+const blkdev_caps_t *diskio_get_caps(uint8_t drive)
+{
+    if(drive >= DISKIO_MAX_DRIVES || host_drive_type(drive) == HOST_DRIVE_NONE)
+        return NULL;
+
+    return &shim_caps[drive];
+}
+
+size_t disk_get_sector_size(uint8_t drive)
+{
+    return host_sector_size(drive);
+}
+
+// 'HD0P0' -> [drive number][partition number], like the kernel's version (dsk/diskio.c)
+uint16_t drive_convert_drive_id(const char *id)
+{
+    uint8_t type, n, drive;
+    uint8_t nfound = 0;
+
+    if((id[0] == 'H' || id[0] == 'h') && (id[1] == 'D' || id[1] == 'd'))
+        type = HOST_DRIVE_HD;
+    else if((id[0] == 'C' || id[0] == 'c') && (id[1] == 'D' || id[1] == 'd'))
+        type = HOST_DRIVE_CD;
+    else
+        return (uint16_t) MAX;
+
+    if(id[2] < '0' || id[2] > '9')
+        return (uint16_t) MAX;
+
+    n = (uint8_t) (id[2] - '0');
+
+    for(drive = 0; drive < DISKIO_MAX_DRIVES; ++drive)
+        if(host_drive_type(drive) == type && nfound++ == n)
+            break;
+
+    if(drive == DISKIO_MAX_DRIVES)
+        return (uint16_t) MAX;
+
+    if(id[3] != DISKIO_DISKID_P && id[3] != (DISKIO_DISKID_P + 0x20))
+        return (uint16_t) ((drive << DISKIO_DISK_NUMBER) | 0xFF);
+
+    if(id[4] < '0' || id[4] > '9')
+        return (uint16_t) MAX;
+
+    return (uint16_t) ((drive << DISKIO_DISK_NUMBER) | (uint8_t) (id[4] - '0'));
+}
+
+uint8_t diskio_device_read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf)
+{
+    return host_read(drive, LBA, sctrRead, buf);
+}
+
+uint8_t diskio_device_write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf)
+{
+    return host_write(drive, LBA, sctrWrite, buf);
+}
+
+uint8_t diskio_device_flush(unsigned char drive)
+{
+    return host_flush(drive);
+}
+
+// the image files can't overlap anything, the batch is just done in order
+uint8_t diskio_device_submit(blkdev_req_t *reqs, unsigned int n)
+{
+    err_t err = EXIT_CODE_GLOBAL_SUCCESS;
+
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        blkdev_req_t *r = &reqs[i];
+
+        r->err = (r->write) ? host_write(r->unit, r->lba, r->nlba, r->buf) : host_read(r->unit, r->lba, r->nlba, r->buf);
+        err = (err) ? err : r->err;
+    }
+
+    return err;
+}
+
+void readahead_invalidate(uint8_t drive, uint32_t lba, uint32_t nlba)
+{
+    (void) drive;
+    (void) lba;
+    (void) nlba;
+}
+
+uint8_t read(unsigned char drive, unsigned int LBA, unsigned int sctrRead, unsigned char *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    uint8_t err = diskio_device_read(drive, LBA, sctrRead, buf);
+    ioqueue_read_overlay(drive, LBA, sctrRead, buf);
+
+    return err;
+}
+
+uint8_t write(unsigned char drive, unsigned int LBA, unsigned int sctrWrite, unsigned char *buf)
+{
+    if(drive >= DISKIO_MAX_DRIVES)
+        return EXIT_CODE_GLOBAL_OUT_OF_RANGE;
+
+    if(ioqueue_is_plugged(drive))
+        return ioqueue_write(drive, LBA, sctrWrite, buf);
+
+    uint8_t err = diskio_device_write(drive, LBA, sctrWrite, buf);
+    return (err) ? err : diskio_device_flush(drive);
+}
+
+/* --- drivers --- */
+
+void driver_addInternalDriver(unsigned int identifier)
+{
+    (void) identifier;
+}
+
+void driver_exec_int(unsigned int type, unsigned int *data)
+{
+    switch(type & 0xFFU)
+    {
+        case FS_TYPE_FAT32:
+            fat_handler(data);
+        break;
+
+        case FS_TYPE_ISO:
+            iso_handler(data);
+        break;
+
+        default:
+            data[4] = EXIT_CODE_GLOBAL_UNSUPPORTED;
+        break;
+    }
+}
+
+/* --- fsh.h --- */
+
+static uint32_t fsh_driver(const char *path)
+{
+    return ((path[0] == 'C' || path[0] == 'c') && (path[1] == 'D' || path[1] == 'd')) ? FS_TYPE_ISO : FS_TYPE_FAT32;
+}
+
+static void fsh_exec(const char *path, uint32_t *drv)
+{
+    driver_exec_int(DRIVER_TYPE_FS | fsh_driver(path), drv);
+}
+
+void fsh_mount(void)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN];
+
+    shim_caps_init();
+    MBR_enumerate();
+
+    // what cd_init() does
+    for(uint8_t i = 0; i < DISKIO_MAX_DRIVES; ++i)
+    {
+        if(host_drive_type(i) != HOST_DRIVE_CD)
+            continue;
+
+        drv[0] = DRV_COMMAND_INIT;
+        drv[1] = i;
+        drv[2] = FS_TYPE_ISO;
+        drv[4] = EXIT_CODE_GLOBAL_SUCCESS;
+        driver_exec_int(DRIVER_TYPE_FS | FS_TYPE_ISO, &drv[0]);
+    }
+}
+
+void *fsh_read_file(const char *path, unsigned int *size, unsigned char *err)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_READ, (uint32_t) path, 0, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    *size = drv[3];
+    *err = (uint8_t) drv[4];
+
+    return (void *) drv[2];
+}
+
+unsigned char fsh_write_file(const char *path, const void *buf, unsigned int size, unsigned char attrib)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_WRITE, (uint32_t) path, (uint32_t) buf, size, attrib};
+    fsh_exec(path, &drv[0]);
+
+    return (uint8_t) drv[4];
+}
+
+unsigned char fsh_rename(const char *path, const char *new_name)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_RENAME, (uint32_t) path, (uint32_t) new_name, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    return (uint8_t) drv[4];
+}
+
+unsigned char fsh_delete(const char *path)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_DELETE, (uint32_t) path, 0, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    return (uint8_t) drv[4];
+}
+
+unsigned char fsh_mkdir(const char *path)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_MKDIR, (uint32_t) path, 0, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    return (uint8_t) drv[4];
+}
+
+unsigned char fsh_file_info(const char *path, unsigned int *size, unsigned char *attrib)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_GET_FILE_INFO, (uint32_t) path, 0, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    fs_file_info_t *info = (fs_file_info_t *) drv[2];
+
+    if(!info)
+        return (uint8_t) ((drv[4]) ? drv[4] : EXIT_CODE_GLOBAL_GENERAL_FAIL);
+
+    *size = info->file_size;
+    *attrib = info->file_type;
+    vfree(info);
+
+    return (uint8_t) drv[4];
+}
+
+static void fsh_copy_dirents(fsh_dirent_t *out, const fs_dir_contents_t *c, uint32_t n)
+{
+    for(uint32_t i = 0; i < n; ++i)
+    {
+        memcpy(&out[i].name[0], (void *) &c[i].name[0], FSH_MAX_NAME_LEN + 1);
+        out[i].name[FSH_MAX_NAME_LEN] = '\0';
+        out[i].attrib = c[i].attrib;
+        out[i].size = c[i].file_size;
+    }
+}
+
+fsh_dirent_t *fsh_dir_contents(const char *path, unsigned int *n, unsigned char *err)
+{
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_GET_DIR_CONTENTS, (uint32_t) path, 0, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    fsh_exec(path, &drv[0]);
+
+    fs_dir_contents_t *c = (fs_dir_contents_t *) drv[2];
+
+    *err = (uint8_t) drv[4];
+    *n = 0;
+
+    if(!c)
+    {
+        *err = (*err) ? *err : EXIT_CODE_GLOBAL_GENERAL_FAIL;
+        return NULL;
+    }
+
+    *n = drv[3] / sizeof(fs_dir_contents_t);
+    fsh_dirent_t *out = host_alloc((*n) ? *n * sizeof(fsh_dirent_t) : 1);
+
+    fsh_copy_dirents(out, c, *n);
+    vfree(c);
+
+    return out;
+}
+
+static fsh_handle_t *fsh_open_handle(const char *path, uint32_t command, unsigned char *err)
+{
+    fsh_handle_t *h = host_alloc(sizeof(fsh_handle_t));
+
+    memset(h, sizeof(fsh_handle_t), 0);
+    h->driver = fsh_driver(path);
+
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {command, (uint32_t) path, (uint32_t) &h->h, 0, EXIT_CODE_GLOBAL_SUCCESS};
+    driver_exec_int(DRIVER_TYPE_FS | h->driver, &drv[0]);
+
+    *err = (uint8_t) drv[4];
+
+    if(*err)
+        { host_free(h); return NULL; }
+
+    return h;
+}
+
+fsh_handle_t *fsh_open(const char *path, unsigned int *size, unsigned char *err)
+{
+    fsh_handle_t *h = fsh_open_handle(path, FS_COMMAND_OPEN, err);
+
+    if(h)
+        *size = h->h.size;
+
+    return h;
+}
+
+static uint32_t fsh_io_at(fsh_handle_t *h, uint32_t command, uint32_t offset, const void *buf, uint32_t size, unsigned char *err)
+{
+    h->h.offset = offset;
+
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {command, (uint32_t) &h->h, (uint32_t) buf, size, EXIT_CODE_GLOBAL_SUCCESS};
+    driver_exec_int(DRIVER_TYPE_FS | h->driver, &drv[0]);
+
+    *err = (uint8_t) drv[4];
+    return drv[3];
+}
+
+unsigned int fsh_read_at(fsh_handle_t *h, unsigned int offset, void *buf, unsigned int size, unsigned char *err)
+{
+    return fsh_io_at(h, FS_COMMAND_READ_AT, offset, buf, size, err);
+}
+
+unsigned int fsh_write_at(fsh_handle_t *h, unsigned int offset, const void *buf, unsigned int size, unsigned char *err)
+{
+    return fsh_io_at(h, FS_COMMAND_WRITE_AT, offset, buf, size, err);
+}
+
+fsh_handle_t *fsh_opendir(const char *path, unsigned char flags, unsigned char *err)
+{
+    fsh_handle_t *h = fsh_open_handle(path, FS_COMMAND_OPENDIR, err);
+
+    if(h)
+        h->h.flags = flags;
+
+    return h;
+}
+
+unsigned int fsh_readdir(fsh_handle_t *h, fsh_dirent_t *out, unsigned int n, unsigned char *err)
+{
+    fs_dir_contents_t *c = host_alloc(n * sizeof(fs_dir_contents_t));
+
+    uint32_t drv[SHIM_DRIVER_PACKET_LEN] = {FS_COMMAND_READDIR, (uint32_t) &h->h, (uint32_t) c, n, EXIT_CODE_GLOBAL_SUCCESS};
+    driver_exec_int(DRIVER_TYPE_FS | h->driver, &drv[0]);
+
+    *err = (uint8_t) drv[4];
+
+    uint32_t got = (*err) ? 0 : drv[3];
+    fsh_copy_dirents(out, c, got);
+    host_free(c);
+
+    return got;
+}
+
+void fsh_close(fsh_handle_t *h)
+{
+    if(h)
+        host_free(h);
+}
+
+void fsh_free(void *ptr)
+{
+    if(ptr)
+        host_free(ptr);
+}
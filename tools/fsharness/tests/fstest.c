@@ -0,0 +1,725 @@
+/*
+MIT license
+Copyright (c) 2022 Maarten Vermeulen
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+// Correctness tests of the FAT32 and ISO9660 drivers. What the drivers read from an image
+// is compared with what the host tools extracted from the same image (the "view", see
+// scripts/mkimages.sh). The write tests apply every change to a copy of the view as well,
+// scripts/check.sh then compares that copy with what the host tools see in the image afterwards.
+//
+//  fstest read <image> <manifest> <view>          FAT32 image (HD0P0) or ISO image (.iso, CD0)
+//  fstest write <image> <manifest> <view copy>    FAT32 image, is modified
+//  fstest full <image> <manifest> <view copy>     nearly full FAT32 image, writes that don't fit
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../include/host.h"
+#include "../include/fsh.h"
+
+#define MANIFEST_MAX_ENTRIES    4096
+#define PATH_LEN                512
+#define MANIFEST_PATH_LEN       256     // manifest paths are relative, they leave room for the drive or view
+
+#define READDIR_CHUNK           7       // entries per fsh_readdir(), odd so that it doesn't line up with sectors
+#define READ_AT_CHUNK           1000    // bytes per fsh_read_at() in the sequential read test
+#define NO_SPACE_SIZE           (4u << 20)  // more than is left on a nearly full image (see images.conf)
+
+typedef struct manifest_entry_t
+{
+    char type;          // 'd' or 'f'
+    unsigned int size;
+    char path[MANIFEST_PATH_LEN];
+} manifest_entry_t;
+
+static manifest_entry_t manifest[MANIFEST_MAX_ENTRIES];
+static unsigned int n_manifest = 0;
+
+static const char *drive;   // "HD0P0" or "CD0"
+static const char *view;
+
+static unsigned int n_checks = 0;
+static unsigned int n_failed = 0;
+
+static void check(int ok, const char *what, const char *path)
+{
+    n_checks++;
+
+    if(ok)
+        return;
+
+    n_failed++;
+    printf("FAIL: %s: %s\n", what, path);
+}
+
+static void drive_path(char *out, const char *path)
+{
+    if(path[0])
+        snprintf(out, PATH_LEN, "%s/%s", drive, path);
+    else
+        snprintf(out, PATH_LEN, "%s", drive);
+}
+
+static void host_path(char *out, const char *path)
+{
+    snprintf(out, PATH_LEN, "%s/%s", view, path);
+}
+
+static void load_manifest(const char *file)
+{
+    char line[PATH_LEN + 32];
+    FILE *f = fopen(file, "r");
+
+    if(!f)
+        { perror(file); exit(2); }
+
+    // lines of `find -printf '%y %s %P\n'`
+    while(fgets(line, sizeof(line), f) && n_manifest < MANIFEST_MAX_ENTRIES)
+    {
+        manifest_entry_t *e = &manifest[n_manifest];
+        char *path = strchr(&line[2], ' ');
+
+        if(!path || (line[0] != 'd' && line[0] != 'f'))
+            continue;
+
+        path[strcspn(path, "\n")] = '\0';
+
+        e->type = line[0];
+        e->size = (unsigned int) strtoul(&line[2], NULL, 10);
+        snprintf(e->path, MANIFEST_PATH_LEN, "%s", path + 1);
+
+        n_manifest++;
+    }
+
+    fclose(f);
+}
+
+static unsigned char *load_host_file(const char *path, unsigned int *size)
+{
+    char p[PATH_LEN];
+    host_path(p, path);
+
+    FILE *f = fopen(p, "rb");
+
+    if(!f)
+        { perror(p); exit(2); }
+
+    fseek(f, 0, SEEK_END);
+    *size = (unsigned int) ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    unsigned char *b = malloc(*size + 1);
+
+    if(fread(b, 1, *size, f) != *size)
+        { perror(p); exit(2); }
+
+    fclose(f);
+    return b;
+}
+
+static void save_host_file(const char *path, const void *buf, unsigned int size)
+{
+    char p[PATH_LEN];
+    host_path(p, path);
+
+    FILE *f = fopen(p, "wb");
+
+    if(!f || fwrite(buf, 1, size, f) != size)
+        { perror(p); exit(2); }
+
+    fclose(f);
+}
+
+static const char *base_name(const char *path)
+{
+    const char *s = strrchr(path, '/');
+    return (s) ? s + 1 : path;
+}
+
+// is `path` a direct child of `dir`?
+static int is_child(const char *dir, const char *path)
+{
+    size_t len = strlen(dir);
+
+    if(len && (strncmp(dir, path, len) || path[len] != '/'))
+        return 0;
+
+    return strchr(&path[(len) ? len + 1 : 0], '/') == NULL;
+}
+
+static void fill_pattern(unsigned char *buf, unsigned int size, unsigned int seed)
+{
+    for(unsigned int i = 0; i < size; ++i)
+        buf[i] = (unsigned char) ((i * 31u + seed * 7u + (i >> 9)) & 0xFF);
+}
+
+/* --- read tests --- */
+
+static void test_file(const manifest_entry_t *e)
+{
+    char p[PATH_LEN];
+    unsigned int host_size, size;
+    unsigned char err, attrib;
+
+    drive_path(p, e->path);
+    unsigned char *expect = load_host_file(e->path, &host_size);
+
+    // whole file
+    unsigned char *b = fsh_read_file(p, &size, &err);
+
+    check(b && !err, "read file", p);
+    check(!b || size == host_size, "read file size", p);
+    check(!b || size != host_size || !memcmp(b, expect, size), "read file contents", p);
+    fsh_free(b);
+
+    check(!fsh_file_info(p, &size, &attrib) && size == host_size && !(attrib & FSH_ATTRIB_DIR), "file info", p);
+
+    // through a handle, in odd chunks from start to end and at a few offsets
+    fsh_handle_t *h = fsh_open(p, &size, &err);
+    check(h && !err && size == host_size, "open", p);
+
+    if(!h)
+        { free(expect); return; }
+
+    unsigned char *chunk = malloc(READ_AT_CHUNK);
+    int same = 1;
+
+    for(unsigned int off = 0; off < host_size; off += READ_AT_CHUNK)
+    {
+        unsigned int want = (host_size - off < READ_AT_CHUNK) ? host_size - off : READ_AT_CHUNK;
+        unsigned int got = fsh_read_at(h, off, chunk, READ_AT_CHUNK, &err);
+
+        same = same && !err && got == want && !memcmp(chunk, &expect[off], want);
+    }
+
+    check(same, "sequential read_at", p);
+
+    const unsigned int offsets[] = {host_size / 2 + 1, host_size - host_size / 3, host_size - 1, 511, 4097};
+
+    for(unsigned int i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+    {
+        unsigned int off = offsets[i];
+
+        if(off >= host_size)
+            continue;
+
+        unsigned int want = (host_size - off < READ_AT_CHUNK) ? host_size - off : READ_AT_CHUNK;
+        unsigned int got = fsh_read_at(h, off, chunk, READ_AT_CHUNK, &err);
+
+        check(!err && got == want && !memcmp(chunk, &expect[off], want), "random read_at", p);
+    }
+
+    // at the end of the file
+    check(fsh_read_at(h, host_size, chunk, READ_AT_CHUNK, &err) == 0, "read_at past the end", p);
+
+    fsh_close(h);
+    free(chunk);
+    free(expect);
+}
+
+static int listed(const fsh_dirent_t *entries, unsigned int n, const manifest_entry_t *e)
+{
+    for(unsigned int i = 0; i < n; ++i)
+    {
+        if(strcmp(entries[i].name, base_name(e->path)))
+            continue;
+
+        if(e->type == 'd')
+            return (entries[i].attrib & FSH_ATTRIB_DIR) != 0;
+
+        return !(entries[i].attrib & FSH_ATTRIB_DIR) && entries[i].size == e->size;
+    }
+
+    return 0;
+}
+
+static unsigned int count_real(const fsh_dirent_t *entries, unsigned int n)
+{
+    unsigned int real = 0;
+
+    for(unsigned int i = 0; i < n; ++i)
+        real += strcmp(entries[i].name, ".") && strcmp(entries[i].name, "..");
+
+    return real;
+}
+
+static void test_dir_listing(const char *p, const char *dir, const fsh_dirent_t *entries, unsigned int n, const char *what)
+{
+    char msg[PATH_LEN];
+    unsigned int children = 0;
+
+    for(unsigned int i = 0; i < n_manifest; ++i)
+    {
+        if(!is_child(dir, manifest[i].path))
+            continue;
+
+        children++;
+
+        snprintf(msg, PATH_LEN, "%s lists %s", what, base_name(manifest[i].path));
+        check(listed(entries, n, &manifest[i]), msg, p);
+    }
+
+    snprintf(msg, PATH_LEN, "%s lists %u entries, not %u", what, count_real(entries, n), children);
+    check(count_real(entries, n) == children, msg, p);
+}
+
+static void test_dir(const char *dir)
+{
+    char p[PATH_LEN];
+    unsigned char err;
+    unsigned int n;
+
+    drive_path(p, dir);
+
+    // all at once
+    fsh_dirent_t *all = fsh_dir_contents(p, &n, &err);
+    check(all && !err, "dir contents", p);
+
+    if(all)
+        test_dir_listing(p, dir, all, n, "dir contents");
+
+    fsh_free(all);
+
+    // streamed
+    fsh_handle_t *h = fsh_opendir(p, 0, &err);
+    check(h && !err, "opendir", p);
+
+    if(!h)
+        return;
+
+    unsigned int total = 0, size = 64;
+    fsh_dirent_t *entries = malloc(size * sizeof(fsh_dirent_t));
+
+    while(1)
+    {
+        if(total + READDIR_CHUNK > size)
+            { size = size * 2; entries = realloc(entries, size * sizeof(fsh_dirent_t)); }
+
+        unsigned int got = fsh_readdir(h, &entries[total], READDIR_CHUNK, &err);
+        check(!err, "readdir", p);
+
+        if(!got || err)
+            break;
+
+        total += got;
+    }
+
+    test_dir_listing(p, dir, entries, total, "readdir");
+
+    fsh_close(h);
+    free(entries);
+}
+
+static void test_missing(void)
+{
+    char p[PATH_LEN];
+    unsigned int size;
+    unsigned char err, attrib;
+
+    drive_path(p, "NOTHERE.TXT");
+
+    void *b = fsh_read_file(p, &size, &err);
+    check(!b && err, "read of a missing file fails", p);
+    fsh_free(b);
+
+    check(fsh_file_info(p, &size, &attrib) != 0, "info of a missing file fails", p);
+    check(fsh_open(p, &size, &err) == NULL && err, "open of a missing file fails", p);
+}
+
+static void test_read(void)
+{
+    test_dir("");
+
+    for(unsigned int i = 0; i < n_manifest; ++i)
+    {
+        if(manifest[i].type == 'd')
+            test_dir(manifest[i].path);
+        else
+            test_file(&manifest[i]);
+    }
+
+    test_missing();
+}
+
+/* --- write tests (FAT32 only) --- */
+
+// reads `path` back through the driver and compares it with `expect`
+static void verify(const char *path, const unsigned char *expect, unsigned int size, const char *what)
+{
+    char p[PATH_LEN];
+    unsigned int got_size;
+    unsigned char err;
+
+    drive_path(p, path);
+    unsigned char *b = fsh_read_file(p, &got_size, &err);
+
+    check(b && !err && got_size == size && !memcmp(b, expect, size), what, p);
+    fsh_free(b);
+}
+
+static void write_new(const char *path, unsigned int size, unsigned int seed)
+{
+    char p[PATH_LEN];
+    unsigned char *b = malloc(size + 1);
+
+    drive_path(p, path);
+    fill_pattern(b, size, seed);
+
+    check(!fsh_write_file(p, b, size, 0), "write", p);
+    save_host_file(path, b, size);
+    verify(path, b, size, "read back written file");
+
+    free(b);
+}
+
+static const manifest_entry_t *largest_file(void)
+{
+    const manifest_entry_t *big = NULL;
+
+    for(unsigned int i = 0; i < n_manifest; ++i)
+        if(manifest[i].type == 'f' && (!big || manifest[i].size > big->size))
+            big = &manifest[i];
+
+    return big;
+}
+
+static void test_write_at(const char *path)
+{
+    char p[PATH_LEN];
+    unsigned int size;
+    unsigned char err;
+
+    drive_path(p, path);
+    unsigned char *b = load_host_file(path, &size);
+
+    fsh_handle_t *h = fsh_open(p, &size, &err);
+    check(h && !err, "open for write_at", p);
+
+    if(!h)
+        { free(b); return; }
+
+    // in place, crossing a sector (and probably a cluster) boundary
+    unsigned char patch[3000];
+    unsigned int off = (size > sizeof(patch) * 2) ? size / 2 - 7 : 0;
+    unsigned int n = (size - off < sizeof(patch)) ? size - off : (unsigned int) sizeof(patch);
+
+    fill_pattern(patch, sizeof(patch), 99);
+
+    check(fsh_write_at(h, off, patch, n, &err) == n && !err, "write_at in place", p);
+    memcpy(&b[off], patch, n);
+
+    // appends, the first one not ending on a sector
+    unsigned int grown = size;
+
+    for(unsigned int i = 0; i < 3; ++i)
+    {
+        unsigned int add = (i == 0) ? 123 : (i == 1) ? 5000 : 70000;
+        b = realloc(b, grown + add);
+        fill_pattern(&b[grown], add, 100 + i);
+
+        check(fsh_write_at(h, grown, &b[grown], add, &err) == add && !err, "write_at append", p);
+        grown += add;
+    }
+
+    // what was written is there through the same handle
+    unsigned char *back = malloc(grown);
+    check(fsh_read_at(h, 0, back, grown, &err) == grown && !err && !memcmp(back, b, grown), "read_at after write_at", p);
+
+    // a write past the end is refused
+    check(fsh_write_at(h, grown + 1, patch, 1, &err) == 0 && err, "write_at past the end fails", p);
+
+    fsh_close(h);
+
+    save_host_file(path, b, grown);
+    verify(path, b, grown, "read back after write_at");
+
+    free(back);
+    free(b);
+}
+
+static void test_overwrite(const char *path, unsigned int size, unsigned int seed)
+{
+    char p[PATH_LEN];
+    unsigned char *b = malloc(size + 1);
+
+    drive_path(p, path);
+    fill_pattern(b, size, seed);
+
+    check(!fsh_write_file(p, b, size, 0), "overwrite", p);
+    save_host_file(path, b, size);
+    verify(path, b, size, "read back overwritten file");
+
+    free(b);
+}
+
+static void test_rename(const char *path, const char *new_name)
+{
+    char p[PATH_LEN], from[PATH_LEN], to[PATH_LEN], new_path[PATH_LEN];
+    unsigned int size, old_size;
+    unsigned char err;
+
+    drive_path(p, path);
+    unsigned char *b = load_host_file(path, &size);
+
+    // same directory, new name
+    snprintf(new_path, PATH_LEN, "%.*s%s", (int) (base_name(path) - path), path, new_name);
+
+    check(!fsh_rename(p, new_name), "rename", p);
+
+    void *old = fsh_read_file(p, &old_size, &err);
+    check(!old, "old name is gone after rename", p);
+    fsh_free(old);
+
+    verify(new_path, b, size, "read renamed file");
+
+    host_path(from, path);
+    host_path(to, new_path);
+    rename(from, to);
+
+    free(b);
+}
+
+static void test_delete(const char *path)
+{
+    char p[PATH_LEN], h[PATH_LEN];
+    unsigned int size;
+    unsigned char err;
+
+    drive_path(p, path);
+    check(!fsh_delete(p), "delete", p);
+
+    void *b = fsh_read_file(p, &size, &err);
+    check(!b, "deleted file is gone", p);
+    fsh_free(b);
+
+    host_path(h, path);
+    remove(h);
+}
+
+static void test_mkdir(void)
+{
+    char p[PATH_LEN], h[PATH_LEN];
+    unsigned int size;
+    unsigned char attrib;
+
+    drive_path(p, "NEWDIR/SUB");
+    check(!fsh_mkdir(p), "mkdir", p);
+    check(!fsh_file_info(p, &size, &attrib) && (attrib & FSH_ATTRIB_DIR), "new directory exists", p);
+
+    host_path(h, "NEWDIR");
+    mkdir(h, 0755);
+    host_path(h, "NEWDIR/SUB");
+    mkdir(h, 0755);
+
+    write_new("NEWDIR/SUB/INSIDE.BIN", 9000, 5);
+
+    // enough entries for the directory to need more clusters
+    for(unsigned int i = 0; i < 300; ++i)
+    {
+        char name[PATH_LEN];
+        snprintf(name, PATH_LEN, "NEWDIR/F%04u.DAT", i);
+        write_new(name, (i % 5) * 700, i);
+    }
+
+    // delete some of them again, leaving holes for the next writes
+    for(unsigned int i = 0; i < 300; i += 7)
+    {
+        char name[PATH_LEN];
+        snprintf(name, PATH_LEN, "NEWDIR/F%04u.DAT", i);
+        test_delete(name);
+    }
+
+    write_new("NEWDIR/HOLE.DAT", 2000, 77);
+
+    // only empty directories can be deleted
+    check(fsh_delete(p) != 0, "delete of a directory that isn't empty fails", p);
+
+    drive_path(p, "NEWDIR/GONE");
+    check(!fsh_mkdir(p), "mkdir", p);
+    check(!fsh_delete(p), "delete of an empty directory", p);
+    check(fsh_file_info(p, &size, &attrib) != 0, "deleted directory is gone", p);
+}
+
+// what one handle appends, another handle on the same file reads
+static void test_two_handles(const char *path)
+{
+    char p[PATH_LEN];
+    unsigned int size, size2;
+    unsigned char err, err2;
+
+    drive_path(p, path);
+    unsigned char *b = load_host_file(path, &size);
+
+    fsh_handle_t *h = fsh_open(p, &size, &err);
+    fsh_handle_t *h2 = fsh_open(p, &size2, &err2);
+    check(h && h2 && !err && !err2, "open twice", p);
+
+    if(!h || !h2)
+        { fsh_close(h); fsh_close(h2); free(b); return; }
+
+    unsigned int add = 9000;
+    b = realloc(b, size + add * 2);
+    fill_pattern(&b[size], add, 12);
+
+    check(fsh_write_at(h, size, &b[size], add, &err) == add && !err, "append through the first handle", p);
+    unsigned char *back = malloc(add);
+    check(fsh_read_at(h2, size, back, add, &err) == add && !err && !memcmp(back, &b[size], add), "read it through the second", p);
+    free(back);
+
+    // the second handle appends behind it, the file keeps both
+    fill_pattern(&b[size + add], add, 13);
+    check(fsh_write_at(h2, size + add, &b[size + add], add, &err) == add && !err, "append through the second handle", p);
+
+    fsh_close(h);
+    fsh_close(h2);
+
+    save_host_file(path, b, size + add * 2);
+    verify(path, b, size + add * 2, "read back after appends through two handles");
+
+    free(b);
+}
+
+static void test_write(void)
+{
+    const manifest_entry_t *big = largest_file();
+
+    write_new("NEW1.TXT", 10, 1);
+    write_new("NEW2.BIN", 300000, 2);
+    write_new("EMPTY.TXT", 0, 3);
+
+    if(big)
+    {
+        char path[PATH_LEN];
+        snprintf(path, PATH_LEN, "%s", big->path);
+
+        test_write_at(path);
+        test_overwrite(path, big->size * 2 + 1000, 4);
+        test_overwrite(path, big->size / 3 + 1, 5);
+        test_rename(path, "RENAMED.BIN");
+    }
+
+    test_write_at("NEW1.TXT");
+    test_two_handles("NEW1.TXT");
+    test_overwrite("NEW2.BIN", 1, 6);
+    test_delete("NEW2.BIN");
+
+    test_mkdir();
+}
+
+/* --- out of space (nearly full FAT32 image) --- */
+
+// a write that doesn't fit fails with EXIT_CODE_FS_NO_SPACE and leaves the file as it was;
+// check.sh has fsck.fat look for the clusters it may have taken and not given back
+static void test_no_space(void)
+{
+    char p[PATH_LEN];
+    unsigned int size;
+    unsigned char err;
+    unsigned char *b = malloc(NO_SPACE_SIZE);
+
+    fill_pattern(b, NO_SPACE_SIZE, 8);
+
+    // a new file
+    drive_path(p, "TOOBIG.BIN");
+    check(fsh_write_file(p, b, NO_SPACE_SIZE, 0) == FSH_ERR_NO_SPACE, "write of a new file that doesn't fit", p);
+
+    void *gone = fsh_read_file(p, &size, &err);
+    check(!gone && err, "no file is left of a write that didn't fit", p);
+    fsh_free(gone);
+
+    // an existing file, rewritten as a whole and appended to
+    write_new("SMALL.BIN", 3000, 9);
+    write_new("NOSIZE.BIN", 0, 10);
+
+    const char *files[] = {"SMALL.BIN", "NOSIZE.BIN"};
+
+    for(unsigned int i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+    {
+        unsigned char *old = load_host_file(files[i], &size);
+
+        drive_path(p, files[i]);
+        check(fsh_write_file(p, b, NO_SPACE_SIZE, 0) == FSH_ERR_NO_SPACE, "overwrite that doesn't fit", p);
+        verify(files[i], old, size, "file is unchanged after an overwrite that didn't fit");
+
+        fsh_handle_t *h = fsh_open(p, &size, &err);
+        check(h && !err, "open for write_at", p);
+
+        if(h)
+        {
+            check(fsh_write_at(h, size, b, NO_SPACE_SIZE, &err) == 0 && err == FSH_ERR_NO_SPACE, "write_at append that doesn't fit", p);
+            fsh_close(h);
+        }
+
+        verify(files[i], old, size, "file is unchanged after an append that didn't fit");
+        free(old);
+    }
+
+    // what the failed writes took has been given back
+    write_new("AFTER.BIN", 300000, 11);
+
+    free(b);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: fstest read|write|full <image> <manifest> <view>\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 5)
+        usage();
+
+    int full = !strcmp(argv[1], "full");
+    int wr = full || !strcmp(argv[1], "write");
+    size_t len = strlen(argv[2]);
+    int iso = len > 4 && !strcmp(&argv[2][len - 4], ".iso");
+
+    if((!wr && strcmp(argv[1], "read")) || (wr && iso))
+        usage();
+
+    if(host_attach(argv[2], (iso) ? HOST_DRIVE_CD : HOST_DRIVE_HD, wr) < 0)
+        return 2;
+
+    drive = (iso) ? "CD0" : "HD0P0";
+    view = argv[4];
+
+    load_manifest(argv[3]);
+    fsh_mount();
+
+    if(full)
+        test_no_space();
+    else if(wr)
+        test_write();
+    else
+        test_read();
+
+    host_detach_all();
+
+    printf("%s %s: %u checks, %u failed\n", argv[1], argv[2], n_checks, n_failed);
+    return n_failed != 0;
+}